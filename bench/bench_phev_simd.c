@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "phev_simd.h"
+#include "phev_core.h"
+
+#define BENCH_FRAMES 4096
+#define BENCH_ROUNDS 200
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t bench_buildFrames(uint8_t *buffer, size_t frameLength, size_t frames)
+{
+    size_t offset = 0;
+
+    for (size_t f = 0; f < frames; f++)
+    {
+        uint8_t *frame = buffer + offset;
+
+        frame[0] = 0x6f;
+        frame[1] = (uint8_t)(frameLength - 2);
+        for (size_t i = 2; i < frameLength - 1; i++)
+        {
+            frame[i] = (uint8_t) rand();
+        }
+        frame[frameLength - 1] = phev_core_checksum(frame);
+        offset += frameLength;
+    }
+    return offset;
+}
+
+static double bench_unmaskAndValidate(const uint8_t *encoded, uint8_t *decoded, size_t len, uint8_t xor)
+{
+    uint8_t checksums[BENCH_FRAMES];
+    volatile size_t sink = 0;
+    double start = bench_now();
+
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        phev_simd_xor(decoded, encoded, len, xor);
+        sink += phev_simd_checksumFrames(decoded, len, checksums, BENCH_FRAMES);
+    }
+
+    return (double) BENCH_FRAMES * BENCH_ROUNDS / (bench_now() - start);
+}
+
+static double bench_validatePerFrame(const uint8_t *encoded, size_t frameLength, uint8_t xor)
+{
+    volatile size_t sink = 0;
+    double start = bench_now();
+
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        for (size_t f = 0; f < BENCH_FRAMES; f++)
+        {
+            sink += phev_core_validateChecksumXOR(encoded + f * frameLength, xor);
+        }
+    }
+
+    return (double) BENCH_FRAMES * BENCH_ROUNDS / (bench_now() - start);
+}
+
+int main(void)
+{
+    const size_t frameLengths[] = {6, 24, 64, 257};
+    const uint8_t xor = 0x5a;
+
+    for (size_t l = 0; l < sizeof(frameLengths) / sizeof(frameLengths[0]); l++)
+    {
+        size_t frameLength = frameLengths[l];
+        uint8_t *clear = malloc(frameLength * BENCH_FRAMES);
+        uint8_t *encoded = malloc(frameLength * BENCH_FRAMES);
+        uint8_t *decoded = malloc(frameLength * BENCH_FRAMES);
+        size_t len = bench_buildFrames(clear, frameLength, BENCH_FRAMES);
+
+        phev_simd_setEnabled(true);
+        phev_simd_xor(encoded, clear, len, xor);
+
+        phev_simd_setEnabled(false);
+        double scalarBatch = bench_unmaskAndValidate(encoded, decoded, len, xor);
+        double scalarFrame = bench_validatePerFrame(encoded, frameLength, xor);
+
+        phev_simd_setEnabled(true);
+        double simdBatch = bench_unmaskAndValidate(encoded, decoded, len, xor);
+        double simdFrame = bench_validatePerFrame(encoded, frameLength, xor);
+
+        printf("frame %3zu bytes  batch unmask+checksum  scalar %12.0f  %-6s %12.0f frames/s (x%.2f)\n",
+               frameLength, scalarBatch, phev_simd_implementation(), simdBatch, simdBatch / scalarBatch);
+        printf("frame %3zu bytes  validateChecksumXOR    scalar %12.0f  %-6s %12.0f frames/s (x%.2f)\n",
+               frameLength, scalarFrame, phev_simd_implementation(), simdFrame, simdFrame / scalarFrame);
+
+        free(clear);
+        free(encoded);
+        free(decoded);
+    }
+
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include "msg_core.h"
 #include "phev_service.h"
 #include "phev_pipe.h"
+#include "phev_command.h"
 
 #define KO_WF_CONNECT_INFO_GS_SP 1
 #define KO_WF_REG_DISP_SP 16
@@ -83,6 +84,11 @@ typedef struct phevSettings_t {
     bool my18;
     messagingClient_t * in;
     messagingClient_t * out;
+    phevServiceOutputFormat_t outputFormat;
+    // Only needed with a passed in out client, lets a reactor or fleet follow the socket when the car reconnects
+    phev_pipe_socketHandler_t socketHandler;
+    // Optional with a passed in out client, reconnects it without waiting for the connect
+    phev_pipe_connectHandler_t connectHandler;
 } phevSettings_t;
 
 typedef enum phevAirConMode_t {
@@ -113,6 +119,13 @@ bool phev_isACError(phevCtx_t * ctx);
 void phev_removeACError(phevCtx_t * ctx, phevCallBack_t callback);
 void phev_airConMY19(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t time,phevCallBack_t callback);
 void phev_airConMode(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t time,phevCallBack_t callback);
+phevCommand_t * phev_headLightsAsync(phevCtx_t * ctx, bool on, phevCommandCallBack_t callback, void * userCtx);
+phevCommand_t * phev_parkingLightsAsync(phevCtx_t * ctx, bool on, phevCommandCallBack_t callback, void * userCtx);
+phevCommand_t * phev_airConAsync(phevCtx_t * ctx, bool on, phevCommandCallBack_t callback, void * userCtx);
+phevCommand_t * phev_updateAllAsync(phevCtx_t * ctx, phevCommandCallBack_t callback, void * userCtx);
+phevCommand_t * phev_removeACErrorAsync(phevCtx_t * ctx, phevCommandCallBack_t callback, void * userCtx);
+phevCommand_t * phev_airConMY19Async(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t time, phevCommandCallBack_t callback, void * userCtx);
+phevCommand_t * phev_airConModeAsync(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t time, phevCommandCallBack_t callback, void * userCtx);
 bool phev_running(phevCtx_t * ctx);
 int phev_batteryLevel(phevCtx_t * ctx);
 int phev_batteryWarning(phevCtx_t * ctx);
@@ -121,6 +134,13 @@ int phev_remainingChargeTime(phevCtx_t * ctx);
 phevServiceHVAC_t *  phev_HVACStatus(phevCtx_t * ctx);
 phevData_t * phev_getRegister(phevCtx_t * ctx, uint8_t reg);
 char * phev_statusAsJson(phevCtx_t * ctx);
+// Changes whenever the status json would be different
+uint32_t phev_statusVersion(phevCtx_t * ctx);
+// Safe from any thread, history changes on the pipe loop the next time it runs. Returns 0 when capacity is more than
+// PHEV_MODEL_HISTORY_SIZE or the command queue is full.
+int phev_enableRegisterHistory(phevCtx_t * ctx, uint8_t reg, size_t capacity);
+size_t phev_registerHistoryLatest(phevCtx_t * ctx, uint8_t reg, phevRegisterHistoryEntry_t * out, size_t max);
+size_t phev_registerHistoryRange(phevCtx_t * ctx, uint8_t reg, uint64_t from, uint64_t to, phevRegisterHistoryEntry_t * out, size_t max);
 messagingClient_t * phev_createIncomingMessageClient(void);
 void phev_disconnect(phevCtx_t * ctx);
 void phev_disconnectCar(phevCtx_t * ctx);
@@ -0,0 +1,60 @@
+#ifndef _PHEV_COMMAND_H_
+#define _PHEV_COMMAND_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Handles for vehicle commands that complete on the pipe loop, callers poll, wait or take a completion callback so
+// outstanding commands never need a thread each
+
+typedef struct phevCtx_t phevCtx_t;
+
+typedef enum phevCommandStatus_t {
+    PHEV_COMMAND_PENDING,
+    PHEV_COMMAND_SUCCESS,
+    PHEV_COMMAND_TIMEOUT,
+    PHEV_COMMAND_DISCONNECTED,
+    PHEV_COMMAND_CANCELLED,
+    PHEV_COMMAND_REJECTED,
+} phevCommandStatus_t;
+
+typedef struct phevCommand_t phevCommand_t;
+
+// Called once on the pipe loop thread when the command completes, not called for a cancelled command
+typedef void (* phevCommandCallBack_t)(phevCommand_t * command, void * userCtx);
+
+struct phevCommand_t {
+    phevCtx_t * ctx;
+    uint8_t reg;
+    atomic_int status;
+    atomic_int refs;
+    uint64_t submitted;
+    uint64_t completed;
+    phevCommandCallBack_t callback;
+    void * userCtx;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+};
+
+// Returns NULL only when out of memory, a command the pipe cannot queue comes back as rejected
+phevCommand_t * phev_command_submit(phevCtx_t * ctx, const uint8_t reg, const uint8_t * data, const size_t length, phevCommandCallBack_t callback, void * userCtx);
+
+phevCommand_t * phev_command_submitRegister(phevCtx_t * ctx, const uint8_t reg, const uint8_t value, phevCommandCallBack_t callback, void * userCtx);
+
+phevCommandStatus_t phev_command_status(phevCommand_t * command);
+
+// Waits up to timeout milliseconds, or forever when negative, and returns pending if the command is still running
+phevCommandStatus_t phev_command_wait(phevCommand_t * command, int timeout);
+
+// The command may still reach the car, only its completion is dropped
+bool phev_command_cancel(phevCommand_t * command);
+
+// Milliseconds from submit to completion, 0 while pending
+uint64_t phev_command_latency(phevCommand_t * command);
+
+// Every handle returned by submit must be released once, it stays valid for the pipe until it completes
+void phev_command_release(phevCommand_t * command);
+
+#endif
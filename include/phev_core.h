@@ -33,6 +33,12 @@
 #define START_SEND_MY18 0xf2
 #define START_RESP_MY18 0x2f
 
+#define PHEV_CORE_MAX_FRAME_LENGTH (UINT8_MAX + 2)
+
+#ifndef PHEV_CORE_STREAM_BUFFER_SIZE
+#define PHEV_CORE_STREAM_BUFFER_SIZE (4096)
+#endif
+
 #define VIN_LEN 17
 #define MAC_ADDR_SIZE 6
 
@@ -81,9 +87,121 @@ typedef struct phevMessage_t
     uint8_t XOR;
 } phevMessage_t;
 
-static bool phev_core_my18 = false;
+// Decoded frame that owns its payload inline, message.data points into frame
+typedef struct phevMessageView_t
+{
+    phevMessage_t message;
+    uint8_t frame[PHEV_CORE_MAX_FRAME_LENGTH];
+} phevMessageView_t;
 
-const static uint8_t allowedCommands[] = {START_SEND, START_RESP, SEND_CMD, RESP_CMD, PING_SEND_CMD, PING_RESP_CMD, START_RESP_MY18, START_SEND_MY18, PING_SEND_CMD_MY18, PING_RESP_CMD_MY18,0x5e,0xcd,0xba,0x6e,0xcc,0xbb,0x3e,0x4f,0x4e,0xe4};
+// message_t ctx for inbound frames, decoded is set when the frame has already been decoded
+typedef struct phevMessageCtx_t
+{
+    uint8_t XOR;
+    bool encoded;
+    phevMessage_t *decoded;
+} phevMessageCtx_t;
+
+typedef struct phevDecodedMessage_t
+{
+    phevMessageCtx_t ctx;
+    phevMessageView_t view;
+} phevDecodedMessage_t;
+
+typedef enum
+{
+    PHEV_CORE_FRAME_INVALID,
+    PHEV_CORE_FRAME_INCOMPLETE,
+    PHEV_CORE_FRAME_COMPLETE,
+} phevFrameStatus_t;
+
+// Per connection byte ring, size must be a power of two
+typedef struct phevStreamParser_t
+{
+    uint8_t buffer[PHEV_CORE_STREAM_BUFFER_SIZE];
+    size_t head;
+    size_t tail;
+} phevStreamParser_t;
+
+#define PHEV_CORE_XOR_PREDICT_LAST 0
+#define PHEV_CORE_XOR_PREDICT_COMMAND 1
+#define PHEV_CORE_XOR_PREDICT_PING 2
+#define PHEV_CORE_XOR_PREDICTIONS 3
+
+// Per session XOR keys tried before searching, a key of zero means no prediction
+typedef struct phevXORPredictor_t
+{
+    uint8_t keys[PHEV_CORE_XOR_PREDICTIONS];
+    uint32_t hits;
+    uint32_t misses;
+} phevXORPredictor_t;
+
+#define PHEV_CORE_TEMPLATE_MAX_DATA 8
+
+// Pre-encoded frame with a fixed command, type and length, only the register, data and checksum are patched per send
+typedef struct phevFrameTemplate_t
+{
+    uint8_t frame[PHEV_CORE_TEMPLATE_MAX_DATA + 5];
+    uint8_t command;
+    uint8_t type;
+    uint8_t length;
+    uint8_t xor;
+    uint8_t headerSum;
+    bool valid;
+} phevFrameTemplate_t;
+
+#define PHEV_CORE_CMD_ALLOWED 0x01
+#define PHEV_CORE_CMD_INCOMING 0x02
+#define PHEV_CORE_CMD_OUTGOING 0x04
+#define PHEV_CORE_CMD_CLEAR_INCOMING 0x08
+#define PHEV_CORE_CMD_CLEAR_OUTGOING 0x10
+
+typedef enum
+{
+    PHEV_CORE_XOR_KEEP,
+    PHEV_CORE_XOR_KEY,
+    PHEV_CORE_XOR_KEY_ODD,
+    PHEV_CORE_XOR_ZERO,
+} phevXORRule_t;
+
+typedef enum
+{
+    PHEV_CORE_MODEL_ANY,
+    PHEV_CORE_MODEL_PRE_MY18,
+    PHEV_CORE_MODEL_MY18,
+} phevModelYear_t;
+
+// Every command byte the protocol knows, the 256 entry lookup table is generated from this list
+// X(command, flags, XOR rule, model year, ack command)
+#define PHEV_CORE_COMMANDS(X) \
+    X(START_SEND, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_OUTGOING, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_ANY, START_RESP) \
+    X(START_RESP, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_INCOMING, PHEV_CORE_XOR_KEY, PHEV_CORE_MODEL_ANY, START_SEND) \
+    X(SEND_CMD, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_OUTGOING | PHEV_CORE_CMD_CLEAR_OUTGOING, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_ANY, RESP_CMD) \
+    X(RESP_CMD, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_INCOMING | PHEV_CORE_CMD_CLEAR_INCOMING, PHEV_CORE_XOR_KEY, PHEV_CORE_MODEL_ANY, SEND_CMD) \
+    X(0x6e, PHEV_CORE_CMD_ALLOWED, PHEV_CORE_XOR_KEY_ODD, PHEV_CORE_MODEL_MY18, 0xe6) \
+    X(PING_SEND_CMD, PHEV_CORE_CMD_ALLOWED, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_PRE_MY18, PING_RESP_CMD) \
+    X(PING_RESP_CMD, PHEV_CORE_CMD_ALLOWED, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_PRE_MY18, PING_SEND_CMD) \
+    X(PING_SEND_CMD_MY18, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_OUTGOING | PHEV_CORE_CMD_CLEAR_OUTGOING, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_MY18, PING_RESP_CMD_MY18) \
+    X(PING_RESP_CMD_MY18, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_INCOMING | PHEV_CORE_CMD_CLEAR_INCOMING, PHEV_CORE_XOR_KEY, PHEV_CORE_MODEL_MY18, PING_SEND_CMD_MY18) \
+    X(0x3e, PHEV_CORE_CMD_ALLOWED, PHEV_CORE_XOR_KEY_ODD, PHEV_CORE_MODEL_MY18, 0xe3) \
+    X(SEND_CMD_MY18, PHEV_CORE_CMD_OUTGOING | PHEV_CORE_CMD_CLEAR_OUTGOING, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_MY18, RESP_CMD_MY18) \
+    X(RESP_CMD_MY18, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_INCOMING | PHEV_CORE_CMD_CLEAR_INCOMING, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_MY18, SEND_CMD_MY18) \
+    X(0x4e, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_INCOMING | PHEV_CORE_CMD_CLEAR_INCOMING, PHEV_CORE_XOR_ZERO, PHEV_CORE_MODEL_MY18, 0xe4) \
+    X(0xe4, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_OUTGOING | PHEV_CORE_CMD_CLEAR_OUTGOING, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_MY18, 0x4e) \
+    X(0x4f, PHEV_CORE_CMD_ALLOWED, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_MY18, 0xf4) \
+    X(0x2e, PHEV_CORE_CMD_INCOMING | PHEV_CORE_CMD_CLEAR_INCOMING, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_MY18, 0xe2) \
+    X(0xbb, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_INCOMING | PHEV_CORE_CMD_OUTGOING | PHEV_CORE_CMD_CLEAR_INCOMING, PHEV_CORE_XOR_KEY, PHEV_CORE_MODEL_MY18, 0xbb) \
+    X(0xba, PHEV_CORE_CMD_ALLOWED, PHEV_CORE_XOR_KEY_ODD, PHEV_CORE_MODEL_MY18, 0xab) \
+    X(0xcc, PHEV_CORE_CMD_ALLOWED | PHEV_CORE_CMD_INCOMING | PHEV_CORE_CMD_OUTGOING | PHEV_CORE_CMD_CLEAR_INCOMING, PHEV_CORE_XOR_KEEP, PHEV_CORE_MODEL_MY18, 0xcc) \
+    X(0xcd, PHEV_CORE_CMD_ALLOWED, PHEV_CORE_XOR_KEY_ODD, PHEV_CORE_MODEL_MY18, 0xdc)
+
+typedef struct phevCommandInfo_t
+{
+    uint8_t flags;
+    uint8_t xorRule;
+    uint8_t modelYear;
+    uint8_t ack;
+} phevCommandInfo_t;
 
 phevMessage_t * phev_core_createMessage(const uint8_t command, const uint8_t type, const uint8_t reg, const uint8_t * data, const size_t length);
 
@@ -95,6 +213,34 @@ bool phev_core_validateMessage(const uint8_t * data, const size_t len);
 
 int phev_core_decodeMessage(const uint8_t *data, const size_t len, phevMessage_t *message);
 
+size_t phev_core_decodeMessageView(const uint8_t *data, const size_t len, phevMessageView_t *view);
+
+bool phev_core_attachDecodedMessage(message_t *message, phevDecodedMessage_t *decoded);
+
+phevMessage_t * phev_core_getDecodedMessage(const message_t *message, phevMessageView_t *view);
+
+phevFrameStatus_t phev_core_checkIncomingFrame(const uint8_t *data, const size_t len, uint8_t *xor);
+
+void phev_core_initXORPredictor(phevXORPredictor_t *predictor);
+
+void phev_core_seedXORPredictor(phevXORPredictor_t *predictor, const uint8_t currentXOR, const uint8_t commandXOR, const uint8_t pingXOR);
+
+phevFrameStatus_t phev_core_predictIncomingFrame(const uint8_t *data, const size_t len, phevXORPredictor_t *predictor, uint8_t *xor);
+
+void phev_core_streamParserInit(phevStreamParser_t *parser);
+
+size_t phev_core_streamParserWrite(phevStreamParser_t *parser, const uint8_t *data, const size_t len);
+
+size_t phev_core_streamParserPending(const phevStreamParser_t *parser);
+
+void phev_core_initFrameTemplate(phevFrameTemplate_t *frameTemplate, const uint8_t command, const uint8_t type, const uint8_t length, const uint8_t xor);
+
+bool phev_core_frameTemplateMatches(const phevFrameTemplate_t *frameTemplate, const uint8_t command, const uint8_t type, const uint8_t length, const uint8_t xor);
+
+size_t phev_core_patchFrameTemplate(phevFrameTemplate_t *frameTemplate, const uint8_t reg, const uint8_t *data);
+
+message_t * phev_core_streamParserNextMessage(phevStreamParser_t *parser, phevXORPredictor_t *predictor);
+
 int phev_core_encodeMessage(phevMessage_t *message,uint8_t **data);
 
 message_t * phev_core_extractMessage(const uint8_t *data, const size_t len, const uint8_t xor);
@@ -121,6 +267,8 @@ phevMessage_t *phev_core_pingMessage(const uint8_t number);
 
 phevMessage_t *phev_core_responseHandler(phevMessage_t * message);
 
+uint8_t phev_core_ackCommand(const uint8_t command);
+
 uint8_t phev_core_checksum(const uint8_t * data);
 
 message_t * phev_core_convertToMessage(phevMessage_t * message);
@@ -131,6 +279,8 @@ message_t * phev_core_XORInboundMessage(const message_t * message,const uint8_t)
 
 phevMessage_t * phev_core_copyMessage(phevMessage_t *);
 
+const phevCommandInfo_t * phev_core_commandInfo(const uint8_t command);
+
 uint8_t phev_core_getXOR(const uint8_t * data,const uint8_t xor);
 
 uint8_t phev_core_getMessageLength(const uint8_t * data);
@@ -147,6 +297,9 @@ uint8_t phev_core_getType(const uint8_t *data);
 
 bool phev_core_validateChecksum(const uint8_t *data);
 
+// Checks the checksum of a frame still encoded with xor
+bool phev_core_validateChecksumXOR(const uint8_t *data, const uint8_t xor);
+
 message_t * phev_core_extractIncomingMessageAndXOR(const uint8_t * data);
 
 message_t * phev_core_extractOutgoingMessageAndXOR(const uint8_t * data);
@@ -159,6 +312,8 @@ message_t * phev_core_createMsgXOR(const uint8_t * data, const size_t length, co
 
 uint8_t phev_core_getMessageXOR(const message_t * message);
 
+bool phev_core_messageEncoded(const message_t * message);
+
 #define phev_core_strdup(...) strdup(...)
 
 #endif
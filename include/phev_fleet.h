@@ -0,0 +1,100 @@
+#ifndef _PHEV_FLEET_H_
+#define _PHEV_FLEET_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "phev.h"
+#include "phev_pipe.h"
+
+// Runs many vehicle sessions on a fixed pool of worker threads. A dispatcher thread waits on the sockets and timers,
+// queues each ready session on its home worker and idle workers steal from the others, a session only ever runs on one
+// worker at a time.
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifndef PHEV_FLEET_MAX_EVENTS
+#define PHEV_FLEET_MAX_EVENTS 64
+#endif
+
+#ifndef PHEV_FLEET_MAX_WAIT
+#define PHEV_FLEET_MAX_WAIT (1000)
+#endif
+
+typedef struct phevFleetSession_t
+{
+    phevCtx_t *phev;
+    int fd;
+    uint32_t connections;
+    bool connecting;
+    size_t worker;
+    bool used;
+    bool scheduled;
+    bool readable;
+    uint64_t cpuTime;
+    uint64_t steps;
+} phevFleetSession_t;
+
+typedef struct phevFleetSessionStats_t
+{
+    uint64_t cpuTime;
+    uint64_t steps;
+} phevFleetSessionStats_t;
+
+typedef struct phevFleet_t phevFleet_t;
+
+typedef struct phevFleetWorker_t
+{
+    phevFleet_t *fleet;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    size_t *queue;
+    size_t head;
+    size_t count;
+    size_t index;
+    uint64_t steps;
+    uint64_t steals;
+} phevFleetWorker_t;
+
+struct phevFleet_t
+{
+    phevFleetSession_t *sessions;
+    size_t capacity;
+    size_t numberOfSessions;
+    phevFleetWorker_t *workers;
+    size_t numberOfWorkers;
+    pthread_t dispatcher;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t idle;
+    atomic_size_t pending;
+    int epoll;
+    int wakeFd;
+    bool running;
+};
+
+phevFleet_t *phev_fleet_create(size_t capacity, size_t workers);
+
+void phev_fleet_destroy(phevFleet_t *fleet);
+
+// The session must already be started, fd is the socket behind its out client or -1 if it is not connected yet. A
+// session whose pipe has a socket handler is followed by the worker after every step, so reconnects need nothing else.
+int phev_fleet_add(phevFleet_t *fleet, phevCtx_t *phev, int fd);
+
+// Only needed for a session whose pipe has no socket handler
+int phev_fleet_setSocket(phevFleet_t *fleet, phevCtx_t *phev, int fd);
+
+// Blocks until the session is not running on a worker
+// Also closes a connect the session still has in progress
+int phev_fleet_remove(phevFleet_t *fleet, phevCtx_t *phev);
+
+int phev_fleet_start(phevFleet_t *fleet);
+
+void phev_fleet_stop(phevFleet_t *fleet);
+
+// CPU time in nanoseconds spent stepping the session
+int phev_fleet_sessionStats(phevFleet_t *fleet, const phevCtx_t *phev, phevFleetSessionStats_t *stats);
+
+#endif
+#endif
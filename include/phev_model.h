@@ -6,22 +6,81 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifndef PHEV_MODEL_REGISTER_SIZE
+#define PHEV_MODEL_REGISTER_SIZE 64
+#endif
+
+#ifndef PHEV_MODEL_HISTORY_SIZE
+#define PHEV_MODEL_HISTORY_SIZE 64
+#endif
 
 typedef struct phevRegister_t
 {
     size_t length;
-    uint8_t data[]; 
+    uint8_t data[PHEV_MODEL_REGISTER_SIZE];
 } phevRegister_t;
 
-typedef struct phevModel_t
+typedef struct phevRegisterHistoryEntry_t
 {
-    phevRegister_t * registers[256];
+    uint64_t time;
+    size_t length;
+    uint8_t data[PHEV_MODEL_REGISTER_SIZE];
+} phevRegisterHistoryEntry_t;
+
+// Ring of the last capacity values a register changed to, oldest is overwritten once it is full. The ring is always
+// PHEV_MODEL_HISTORY_SIZE entries and is kept once allocated, changing capacity only resets it, so a reader racing a
+// change indexes a live ring and just retries.
+typedef struct phevRegisterHistory_t
+{
+    size_t capacity;
+    size_t head;
+    size_t count;
+    phevRegisterHistoryEntry_t entries[PHEV_MODEL_HISTORY_SIZE];
+} phevRegisterHistory_t;
 
+// The registers are one flat slab of fixed size slots updated in place, a slot is only set once it has a version.
+// Each change to a register stamps it with the next model version, so anything built from a set of registers is
+// stale once the highest of their versions moves.
+// Writers take writeLock, in practice it is only contended when a register is set from outside the pipe loop.
+// Readers go through the sequence lock, which is odd while a write is in progress, they copy what they need and retry
+// if the sequence moved underneath them so a writer never waits for a reader. A reader that finds a write in
+// progress spins briefly and then yields, so on a single core it does not starve the writer it is waiting for.
+typedef struct phevModel_t
+{
+    phevRegister_t registers[256];
+    uint32_t versions[256];
+    uint32_t version;
+    phevRegisterHistory_t * histories[256];
+    atomic_uint sequence;
+    pthread_mutex_t writeLock;
 } phevModel_t;
 
 
 phevModel_t * phev_model_create(void);
+// Safe from any thread, writers are serialised
 int phev_model_setRegister(phevModel_t *, uint8_t, const uint8_t *, size_t);
+// Time is milliseconds from the timer clock, setRegister uses phev_timer_now()
+int phev_model_setRegisterAt(phevModel_t *, uint8_t, const uint8_t *, size_t, uint64_t);
 phevRegister_t * phev_model_getRegister(phevModel_t *, uint8_t);
+// No copy, the slot is updated in place when the register is next set so only peek while nothing else can set it
+const phevRegister_t * phev_model_peekRegister(const phevModel_t *, uint8_t);
+// Safe from any thread, copies the register and returns 1 if it is set, otherwise the copy has zero length
+int phev_model_readRegister(const phevModel_t *, uint8_t, phevRegister_t *);
+// Copies the registers as they all were at one instant and returns the highest of their versions
+uint32_t phev_model_snapshotRegisters(const phevModel_t *, const uint8_t *, size_t, phevRegister_t *);
+uint32_t phev_model_registerVersion(const phevModel_t *, uint8_t);
+// Zero only when the register is set to exactly this data and length
+int phev_model_compareRegisterData(const phevModel_t *, uint8_t, const uint8_t *, size_t);
 int phev_model_compareRegister(phevModel_t *, uint8_t, const uint8_t *);
+// Keeps the last capacity changes of the register, zero stops keeping them. Existing history is dropped.
+// Capacity is at most PHEV_MODEL_HISTORY_SIZE. Safe from any thread, though phev_enableRegisterHistory makes the change
+// on the pipe loop.
+int phev_model_enableHistory(phevModel_t *, uint8_t, size_t);
+// Newest first, returns the number of entries copied
+size_t phev_model_historyLatest(const phevModel_t *, uint8_t, phevRegisterHistoryEntry_t *, size_t);
+// Oldest first, entries with from <= time <= to
+size_t phev_model_historyRange(const phevModel_t *, uint8_t, uint64_t, uint64_t, phevRegisterHistoryEntry_t *, size_t);
 #endif
\ No newline at end of file
@@ -6,11 +6,15 @@
 #include <time.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "msg_core.h"
 #include "msg_pipe.h"
 #include "phev_core.h"
+#include "phev_timer.h"
+#include "phev_tcpip.h"
 #define PHEV_PIPE_MAX_EVENT_HANDLERS 10
-#define PHEV_PIPE_MAX_UPDATE_CALLBACKS 10
+#define PHEV_PIPE_INITIAL_PENDING_UPDATES 16
+#define PHEV_PIPE_MAX_REGISTERS 256
 #ifndef PHEV_CONNECT_WAIT_TIME
 #define PHEV_CONNECT_WAIT_TIME (1000)
 #endif
@@ -19,6 +23,60 @@
 #define PHEV_CONNECT_MAX_RETRIES (5)
 #endif
 
+#ifndef PHEV_CONNECT_MAX_BACKOFF
+#define PHEV_CONNECT_MAX_BACKOFF (60000)
+#endif
+
+#ifndef PHEV_PIPE_MAX_PENDING_UPDATES
+#define PHEV_PIPE_MAX_PENDING_UPDATES (1024)
+#endif
+
+#ifndef PHEV_PIPE_UPDATE_TIMEOUT
+#define PHEV_PIPE_UPDATE_TIMEOUT (2000)
+#endif
+
+#ifndef PHEV_PIPE_UPDATE_MAX_RETRIES
+#define PHEV_PIPE_UPDATE_MAX_RETRIES (3)
+#endif
+
+#ifndef PHEV_PIPE_UPDATE_MAX_BACKOFF
+#define PHEV_PIPE_UPDATE_MAX_BACKOFF (16000)
+#endif
+
+#ifndef PHEV_PIPE_PING_INTERVAL
+#define PHEV_PIPE_PING_INTERVAL (1000)
+#endif
+
+#ifndef PHEV_PIPE_PING_MAX_INTERVAL
+#define PHEV_PIPE_PING_MAX_INTERVAL (8000)
+#endif
+
+#ifndef PHEV_PIPE_PING_HEALTHY_RTT
+#define PHEV_PIPE_PING_HEALTHY_RTT (250)
+#endif
+
+#define PHEV_PIPE_PING_SEQUENCES 0x30
+#define PHEV_PIPE_RTT_BUCKETS 16
+
+#ifndef PHEV_PIPE_TIME_SYNC_INTERVAL
+#define PHEV_PIPE_TIME_SYNC_INTERVAL (30000)
+#endif
+
+#ifndef PHEV_PIPE_COMMAND_QUEUE_SIZE
+#define PHEV_PIPE_COMMAND_QUEUE_SIZE (64)
+#endif
+
+#define PHEV_PIPE_COMMAND_MAX_DATA 16
+#define PHEV_PIPE_CACHE_LINE 64
+
+#define PHEV_PIPE_ACK_TEMPLATES 4
+
+#ifndef PHEV_PIPE_DECODED_MESSAGES
+#define PHEV_PIPE_DECODED_MESSAGES (16)
+#endif
+
+#define PHEV_PIPE_SOCKET_UNKNOWN (-2)
+
 #define PHEV_PIPE_ECU_VERSION_SIZE 11
 #define PHEV_PIPE_DATE_INFO_SIZE 6
 
@@ -33,13 +91,13 @@
 #endif
 #define _POSIX_C_SOURCE 200809L // or greater
 #include <time.h>
-#define SLEEP(msecs)                      \
-    do                                    \
-    {                                     \
-        struct timespec ts;               \
-        ts.tv_sec = msecs / 1000;         \
-        ts.tv_nsec = msecs % 1000 * 1000; \
-        nanosleep(&ts, NULL);             \
+#define SLEEP(msecs)                           \
+    do                                         \
+    {                                          \
+        struct timespec ts;                    \
+        ts.tv_sec = (msecs) / 1000;            \
+        ts.tv_nsec = (msecs) % 1000 * 1000000; \
+        nanosleep(&ts, NULL);                  \
     } while (0)
 #elif __XTENSA__
 #include "freertos/FreeRTOS.h"
@@ -92,26 +150,84 @@ typedef struct phev_pipe_ctx_t phev_pipe_ctx_t;
 typedef int (* phevPipeEventHandler_t)(phev_pipe_ctx_t *ctx, phevPipeEvent_t *event);
 typedef void (* phevErrorHandler_t)(phevError_t *error);
 typedef void (* phev_pipe_updateRegisterCallback_t)(phev_pipe_ctx_t *ctx, uint8_t reg, void *customCtx);
+// Work submitted from another thread and run by the pipe loop, data is a copy of what was submitted
+typedef void (* phev_pipe_task_t)(phev_pipe_ctx_t *ctx, const uint8_t *data, size_t length, void *customCtx);
 typedef void (* phevRegistrationComplete_t)(phev_pipe_ctx_t *ctx);
+// Returns the socket behind a connected out client
+typedef int (* phev_pipe_socketHandler_t)(messagingClient_t *client);
+// Connects the out client without waiting, 0 once it is connected. The pipe keeps the connect in progress between calls.
+typedef int (* phev_pipe_connectHandler_t)(messagingClient_t *client, phevTcpConnect_t *connect);
+
+// A register update waiting for its ack, chained to the other updates for the same register through next
+typedef struct phev_pipe_pendingUpdate_t
+{
+    phev_pipe_updateRegisterCallback_t callback;
+    phev_pipe_updateRegisterCallback_t timeoutCallback;
+    void * ctx;
+    uint8_t reg;
+    uint8_t * value;
+    size_t length;
+    uint64_t deadline;
+    int retries;
+    int next;
+    bool used;
+} phev_pipe_pendingUpdate_t;
 
 typedef struct phev_pipe_updateRegisterCtx_t
 {
-    phev_pipe_updateRegisterCallback_t callbacks[PHEV_PIPE_MAX_UPDATE_CALLBACKS];
-    bool used[PHEV_PIPE_MAX_UPDATE_CALLBACKS];
-    uint8_t registers[PHEV_PIPE_MAX_UPDATE_CALLBACKS];
-    uint8_t * values[PHEV_PIPE_MAX_UPDATE_CALLBACKS];
-    size_t lengths[PHEV_PIPE_MAX_UPDATE_CALLBACKS];
-    void * ctx[PHEV_PIPE_MAX_UPDATE_CALLBACKS];
+    phev_pipe_pendingUpdate_t * updates;
+    size_t capacity;
+    int byRegister[PHEV_PIPE_MAX_REGISTERS];
+    int freeList;
+    uint64_t nextDeadline;
     size_t numberOfCallbacks;
+    bool handlerRegistered;
 } phev_pipe_updateRegisterCtx_t;
 
+// A register update or task submitted from another thread, sequence says whether the slot is free or holds a command
+typedef struct phev_pipe_command_t
+{
+    atomic_size_t sequence;
+    phev_pipe_task_t task;
+    uint8_t reg;
+    uint8_t data[PHEV_PIPE_COMMAND_MAX_DATA];
+    size_t length;
+    phev_pipe_updateRegisterCallback_t callback;
+    phev_pipe_updateRegisterCallback_t timeoutCallback;
+    void * ctx;
+} phev_pipe_command_t;
+
+// Bounded queue with many submitting threads and the pipe loop as the only consumer, size must be a power of two
+typedef struct phev_pipe_commandQueue_t
+{
+    phev_pipe_command_t commands[PHEV_PIPE_COMMAND_QUEUE_SIZE];
+    atomic_size_t enqueuePos;
+    uint8_t padding[PHEV_PIPE_CACHE_LINE - sizeof(atomic_size_t)];
+    size_t dequeuePos;
+} phev_pipe_commandQueue_t;
+
+// Round trip times in milliseconds, histogram bucket n counts times below 2^n with the last one open ended, the
+// average is an EWMA scaled by 8
+typedef struct phev_pipe_pingStats_t
+{
+    uint64_t sentAt[PHEV_PIPE_PING_SEQUENCES];
+    uint32_t histogram[PHEV_PIPE_RTT_BUCKETS];
+    uint32_t rttAverage;
+    uint32_t lastRtt;
+    uint32_t minRtt;
+    uint32_t maxRtt;
+    uint32_t samples;
+    uint32_t lost;
+    uint32_t interval;
+    int lastSequence;
+} phev_pipe_pingStats_t;
+
 typedef struct phev_pipe_ctx_t
 {
     msg_pipe_ctx_t *pipe;
     phevPipeEventHandler_t eventHandler[PHEV_PIPE_MAX_EVENT_HANDLERS];
     int eventHandlers;
     phevErrorHandler_t errorHandler;
-    time_t lastPingTime;
     uint8_t currentPing;
     uint8_t pingResponse;
     bool connected;
@@ -122,6 +238,27 @@ typedef struct phev_pipe_ctx_t
     bool encrypt;
     bool registerDevice;
     phevRegistrationComplete_t registrationCompleteCallback;
+    phevStreamParser_t stream;
+    phevXORPredictor_t xorPredictor;
+    phevFrameTemplate_t pingTemplate;
+    phevFrameTemplate_t timeSyncTemplate;
+    phevFrameTemplate_t ackTemplates[PHEV_PIPE_ACK_TEMPLATES];
+    phevDecodedMessage_t decoded[PHEV_PIPE_DECODED_MESSAGES];
+    phevTimerWheel_t timers;
+    phevTimer_t pingTimer;
+    phev_pipe_pingStats_t ping;
+    phevTimer_t timeSyncTimer;
+    phevTimer_t updateTimer;
+    phevTimer_t reconnectTimer;
+    uint32_t connectAttempts;
+    uint32_t connectSeed;
+    uint32_t connections;
+    phev_pipe_socketHandler_t socketHandler;
+    phev_pipe_connectHandler_t connectHandler;
+    phevTcpConnect_t connect;
+    bool startPending;
+    uint8_t startMac[6];
+    phev_pipe_commandQueue_t commands;
     void *ctx;
 } phev_pipe_ctx_t;
 
@@ -145,10 +282,15 @@ typedef struct phev_pipe_settings_t
     phevErrorHandler_t errorHandler;
     bool registerDevice;
     phevRegistrationComplete_t registrationCompleteCallback;
+    phev_pipe_socketHandler_t socketHandler;
+    phev_pipe_connectHandler_t connectHandler;
     void *ctx;
 } phev_pipe_settings_t;
 
 void phev_pipe_loop(phev_pipe_ctx_t *);
+// readable is set when the pipe's socket is ready, which while connecting means the connecting socket is writable
+void phev_pipe_step(phev_pipe_ctx_t *ctx, bool readable);
+uint64_t phev_pipe_connectBackoff(phev_pipe_ctx_t *ctx);
 phev_pipe_ctx_t *phev_pipe_createPipe(phev_pipe_settings_t);
 void phev_pipe_waitForConnection(phev_pipe_ctx_t *ctx);
 message_t *phev_pipe_outputChainInputTransformer(void *, message_t *);
@@ -158,6 +300,9 @@ void phev_pipe_deregisterEventHandler(phev_pipe_ctx_t *, phevPipeEventHandler_t)
 message_t *phev_pipe_commandResponder(void *, message_t *);
 messageBundle_t *phev_pipe_outputSplitter(void *, message_t *);
 void phev_pipe_ping(phev_pipe_ctx_t *);
+void phev_pipe_pingReceived(phev_pipe_ctx_t *ctx, const uint8_t sequence, const uint64_t now);
+uint32_t phev_pipe_pingRtt(const phev_pipe_ctx_t *ctx);
+void phev_pipe_sendTimeSync(phev_pipe_ctx_t *ctx);
 void phev_pipe_resetPing(phev_pipe_ctx_t *);
 void phev_pipe_start(phev_pipe_ctx_t *ctx, uint8_t *mac);
 void phev_pipe_sendMac(phev_pipe_ctx_t *ctx, uint8_t *mac);
@@ -165,6 +310,22 @@ void phev_pipe_updateRegister(phev_pipe_ctx_t *, const uint8_t, const uint8_t);
 void phev_pipe_updateComplexRegister(phev_pipe_ctx_t *, const uint8_t, const uint8_t *, size_t);
 void phev_pipe_updateComplexRegisterWithCallback(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t * data, size_t length, phev_pipe_updateRegisterCallback_t callback, void * customCtx);
 void phev_pipe_updateRegisterWithCallback(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t value, phev_pipe_updateRegisterCallback_t callback, void * customCtx);
+void phev_pipe_updateComplexRegisterWithTimeout(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t * data, size_t length, phev_pipe_updateRegisterCallback_t callback, phev_pipe_updateRegisterCallback_t timeoutCallback, void * customCtx);
+void phev_pipe_checkPendingUpdates(phev_pipe_ctx_t *ctx, uint64_t now);
+void phev_pipe_failPendingUpdates(phev_pipe_ctx_t *ctx);
+bool phev_pipe_submitUpdate(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t * data, size_t length, phev_pipe_updateRegisterCallback_t callback, phev_pipe_updateRegisterCallback_t timeoutCallback, void * customCtx);
+// Safe to call from any thread, the task runs on the pipe loop the next time it runs
+bool phev_pipe_submitTask(phev_pipe_ctx_t *ctx, phev_pipe_task_t task, const uint8_t * data, size_t length, void * customCtx);
+size_t phev_pipe_drainCommands(phev_pipe_ctx_t *ctx);
+bool phev_pipe_commandsPending(phev_pipe_ctx_t *ctx);
+uint64_t phev_pipe_nextTimeout(phev_pipe_ctx_t *ctx);
+// The socket the out client is connected with, -1 when it is not connected and PHEV_PIPE_SOCKET_UNKNOWN without a
+// socket handler. connections counts every time the out client connects, so a reused socket number can be told apart.
+int phev_pipe_socket(phev_pipe_ctx_t *ctx);
+// The socket of a connect still in progress, -1 when there is none. Wait for it to be writable then step the pipe.
+int phev_pipe_connectingSocket(phev_pipe_ctx_t *ctx);
+// Closes a connect still in progress, for a pipe that will not be stepped again
+void phev_pipe_abortConnect(phev_pipe_ctx_t *ctx);
 phevPipeEvent_t *phev_pipe_createRegisterEvent(phev_pipe_ctx_t *phevCtx, phevMessage_t *phevMessage);
 void phev_pipe_outboundPublish(phev_pipe_ctx_t * ctx, message_t * message);
 void phev_pipe_pingOutboundPublish(phev_pipe_ctx_t * ctx, message_t * message);
@@ -0,0 +1,63 @@
+#ifndef _PHEV_REACTOR_H_
+#define _PHEV_REACTOR_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "phev_pipe.h"
+
+// Drives many pipes from one thread, each pipe is stepped when its socket is readable or one of its timers is due
+
+#ifndef PHEV_REACTOR_MAX_EVENTS
+#define PHEV_REACTOR_MAX_EVENTS 64
+#endif
+
+#ifndef PHEV_REACTOR_MAX_WAIT
+#define PHEV_REACTOR_MAX_WAIT (1000)
+#endif
+
+typedef struct phevReactorSession_t
+{
+    phev_pipe_ctx_t *pipe;
+    int fd;
+    uint32_t connections;
+    bool connecting;
+    bool used;
+} phevReactorSession_t;
+
+typedef struct phevReactor_t
+{
+    int epoll;
+    int wakeFd;
+    phevReactorSession_t *sessions;
+    size_t capacity;
+    size_t numberOfSessions;
+    atomic_bool running;
+} phevReactor_t;
+
+phevReactor_t *phev_reactor_create(size_t capacity);
+
+void phev_reactor_destroy(phevReactor_t *reactor);
+
+// fd is the socket behind the pipe's out client, -1 if it is not connected yet. A pipe with a socket handler is
+// followed after every step, so its socket is watched again each time it reconnects, and while a connect is in
+// progress its connecting socket is watched for writing.
+int phev_reactor_add(phevReactor_t *reactor, phev_pipe_ctx_t *pipe, int fd);
+
+// Only needed for a pipe without a socket handler, -1 stops watching it
+int phev_reactor_setSocket(phevReactor_t *reactor, phev_pipe_ctx_t *pipe, int fd);
+
+// Also closes a connect the pipe still has in progress
+int phev_reactor_remove(phevReactor_t *reactor, phev_pipe_ctx_t *pipe);
+
+uint64_t phev_reactor_nextTimeout(phevReactor_t *reactor);
+
+// Waits at most maxWait ms and steps every pipe that is ready, returns the number stepped or -1 on error
+int phev_reactor_step(phevReactor_t *reactor, int maxWait);
+
+void phev_reactor_run(phevReactor_t *reactor);
+
+// Safe to call from any thread, run returns once its current wait is woken
+void phev_reactor_stop(phevReactor_t *reactor);
+
+#endif
@@ -4,6 +4,7 @@
 #ifndef _PHEV_SERVICE_H_
 #define _PHEV_SERVICE_H_
 #include <stdbool.h>
+#include <pthread.h>
 #include "phev_core.h"
 #include "phev_pipe.h"
 #include "phev_model.h"
@@ -47,6 +48,41 @@
 #define PHEV_SERVICE_START_MESSAGE_JSON "startMessage"
 #define PHEV_SERVICE_START_MESSAGE_DATA_JSON "data"
 
+// Largest json register update, 255 data bytes of up to four characters each plus the surrounding object
+#ifndef PHEV_SERVICE_OUTPUT_BUFFER_SIZE
+#define PHEV_SERVICE_OUTPUT_BUFFER_SIZE 1280
+#endif
+
+#ifndef PHEV_SERVICE_JSON_MAX_DEPTH
+#define PHEV_SERVICE_JSON_MAX_DEPTH 16
+#endif
+
+// Binary register updates are framed as type, register, length, data, xor then the time in seconds since the epoch as
+// four bytes big endian. Bundles are the frames back to back.
+#define PHEV_SERVICE_BINARY_UPDATED_REGISTER 0x01
+#define PHEV_SERVICE_BINARY_UPDATED_REGISTER_ACK 0x02
+#define PHEV_SERVICE_BINARY_START_MESSAGE 0x03
+#define PHEV_SERVICE_BINARY_HEADER_SIZE 3
+#define PHEV_SERVICE_BINARY_TRAILER_SIZE 5
+
+// The input splitter hands each command on as this tag, the register and then the value bytes. No json document
+// starts with a zero byte so a raw command can never be taken for one.
+#define PHEV_SERVICE_SPLIT_COMMAND_TAG 0x00
+#define PHEV_SERVICE_SPLIT_COMMAND_HEADER_SIZE 2
+
+// The last register update frame seen with each encoded register byte, a repeat of the same raw frame can be filtered
+// without decoding it as long as the register has not changed since
+typedef struct phevServiceFrameFingerprint_t {
+    uint64_t hash;
+    uint32_t version;
+    uint8_t reg;
+} phevServiceFrameFingerprint_t;
+
+typedef enum {
+    PHEV_SERVICE_OUTPUT_JSON = 0,
+    PHEV_SERVICE_OUTPUT_BINARY,
+} phevServiceOutputFormat_t;
+
 
 typedef struct phevServiceCtx_t phevServiceCtx_t;
 
@@ -62,6 +98,9 @@ typedef struct phevServiceSettings_t {
     phevServiceYieldHandler_t yieldHandler;
     bool my18;
     void * ctx;
+    phevServiceOutputFormat_t outputFormat;
+    phev_pipe_socketHandler_t socketHandler;
+    phev_pipe_connectHandler_t connectHandler;
 
 } phevServiceSettings_t;
 
@@ -74,7 +113,16 @@ typedef struct phevServiceCtx_t {
     bool exit;
     phevRegisterCtx_t * registrationCtx;
     bool registerDevice;
+    bool my18;
     void * ctx;
+    char * statusJson;
+    uint32_t statusVersion;
+    pthread_mutex_t statusLock;
+    char outputBuffer[PHEV_SERVICE_OUTPUT_BUFFER_SIZE];
+    phevServiceOutputFormat_t outputFormat;
+    phev_pipe_socketHandler_t socketHandler;
+    phev_pipe_connectHandler_t connectHandler;
+    phevServiceFrameFingerprint_t frameFingerprints[256];
 } phevServiceCtx_t;
 
 typedef struct phevServiceHVAC_t {
@@ -92,18 +140,31 @@ bool phev_service_validateCommand(const char * command);
 phevMessage_t * phev_service_jsonCommandToPhevMessage(const char * command);
 phev_pipe_ctx_t * phev_service_createPipe(phevServiceCtx_t * ctx, messagingClient_t * in, messagingClient_t * out);
 phev_pipe_ctx_t * phev_service_createPipeRegister(phevServiceCtx_t * ctx, messagingClient_t * in, messagingClient_t * out);
+// Takes a whole json command document
 message_t * phev_service_jsonInputTransformer(void *, message_t *);
+// Takes the commands from phev_service_inputSplitter, anything else is dropped
+message_t * phev_service_commandInputTransformer(void *, message_t *);
 message_t * phev_service_jsonOutputTransformer(void *, message_t *);
+message_t * phev_service_binaryOutputTransformer(void *, message_t *);
+// Only call before the pipe loop starts or from the loop thread itself, such as from an event handler
+void phev_service_setOutputFormat(phevServiceCtx_t * ctx, phevServiceOutputFormat_t format);
 int phev_service_getBatteryLevel(phevServiceCtx_t * ctx);
 int phev_service_getBatteryWarning(phevServiceCtx_t * ctx);
 int phev_service_getACError(phevServiceCtx_t * ctx);
 int phev_service_doorIsLocked(phevServiceCtx_t * ctx);
+// Safe to call from any thread, the pipe loop is never blocked by it
 char * phev_service_statusAsJson(phevServiceCtx_t * ctx);
+// Only rendered again when one of the registers in the status has changed, the string belongs to the service and is
+// only valid until the next call so it is for a single reader, other threads should use statusAsJson
+const char * phev_service_statusJson(phevServiceCtx_t * ctx, uint32_t * version);
+uint32_t phev_service_statusVersion(const phevServiceCtx_t * ctx);
 bool phev_service_outputFilter(void *ctx, message_t * message);
 messageBundle_t * phev_service_inputSplitter(void * ctx, message_t * message);
 void phev_service_loop(phevServiceCtx_t * ctx);
 message_t * phev_service_jsonResponseAggregator(void * ctx, messageBundle_t * bundle);
+message_t * phev_service_binaryResponseAggregator(void * ctx, messageBundle_t * bundle);
 phevRegister_t * phev_service_getRegister(const phevServiceCtx_t * ctx, const uint8_t reg);
+// Safe from any thread, the model serialises it with the pipe loop's own updates
 void phev_service_setRegister(const phevServiceCtx_t * ctx, const uint8_t reg, const uint8_t * data, const size_t length);
 char * phev_service_getRegisterJson(const phevServiceCtx_t * ctx, const uint8_t reg);
 char * phev_service_getDateSync(const phevServiceCtx_t * ctx);
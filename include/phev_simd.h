@@ -0,0 +1,22 @@
+#ifndef _PHEV_SIMD_H_
+#define _PHEV_SIMD_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Byte kernels run on every frame, dispatched at runtime to AVX2, SSE2 or NEON with a scalar fallback
+
+void phev_simd_xor(uint8_t *dest, const uint8_t *src, const size_t len, const uint8_t xor);
+
+uint8_t phev_simd_sum(const uint8_t *data, const size_t len);
+
+uint8_t phev_simd_xorSum(const uint8_t *data, const size_t len, const uint8_t xor);
+
+size_t phev_simd_checksumFrames(const uint8_t *data, const size_t len, uint8_t *checksums, const size_t maxFrames);
+
+// Switches the kernels for the whole process, safe to call while other threads are using them
+void phev_simd_setEnabled(const bool enabled);
+
+const char *phev_simd_implementation(void);
+
+#endif
@@ -7,6 +7,30 @@
 
 #define TCP_READ_TIMEOUT 1000
 
+// A connect still in progress after this many ms is abandoned and the next call starts a new one
+#ifndef PHEV_TCP_CONNECT_TIMEOUT
+#define PHEV_TCP_CONNECT_TIMEOUT 2000
+#endif
+
+// A connect in progress, each client keeps its own so nothing is shared between sessions. soc is -1 when there is none.
+typedef struct phevTcpConnect_t
+{
+    int soc;
+    int flags;
+    uint64_t started;
+} phevTcpConnect_t;
+
+void phev_tcpClientConnectInit(phevTcpConnect_t *pending);
+
+// Never waits. Starts a connect, or checks the one in progress, and returns the socket once it is connected. Returns -1
+// while pending->soc is still in progress, which is the socket to wait on for writing, and when the connect failed.
+int phev_tcpClientConnect(phevTcpConnect_t *pending, const char *host, uint16_t port);
+
+// Closes a connect still in progress
+void phev_tcpClientConnectAbort(phevTcpConnect_t *pending);
+
+// For msg-core's tcpip connect hook, which has nowhere to keep a connect in progress, so this one waits up to
+// PHEV_TCP_CONNECT_TIMEOUT. The pipe reconnects with phev_tcpClientConnect instead when it has a connect handler.
 int phev_tcpClientConnectSocket(const char *host, uint16_t port);
 
 int phev_tcpClientDisconnectSocket(int soc);
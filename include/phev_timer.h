@@ -0,0 +1,61 @@
+#ifndef _PHEV_TIMER_H_
+#define _PHEV_TIMER_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Hierarchical timer wheel, times are milliseconds from a monotonic clock
+
+#ifndef PHEV_TIMER_RESOLUTION
+#define PHEV_TIMER_RESOLUTION (10)
+#endif
+
+#define PHEV_TIMER_LEVELS 4
+#define PHEV_TIMER_SLOT_BITS 6
+#define PHEV_TIMER_SLOTS (1 << PHEV_TIMER_SLOT_BITS)
+#define PHEV_TIMER_NEVER UINT64_MAX
+
+typedef struct phevTimer_t phevTimer_t;
+typedef void (* phevTimerCallback_t)(phevTimer_t *timer, void *ctx);
+
+struct phevTimer_t
+{
+    phevTimer_t *next;
+    phevTimer_t *prev;
+    uint64_t expires;
+    uint8_t level;
+    uint8_t slot;
+    bool active;
+    phevTimerCallback_t callback;
+    void *ctx;
+};
+
+typedef struct phevTimerWheel_t
+{
+    phevTimer_t *slots[PHEV_TIMER_LEVELS][PHEV_TIMER_SLOTS];
+    uint64_t occupied[PHEV_TIMER_LEVELS];
+    uint64_t tick;
+    size_t active;
+} phevTimerWheel_t;
+
+uint64_t phev_timer_now(void);
+
+void phev_timer_initWheel(phevTimerWheel_t *wheel, const uint64_t now);
+
+void phev_timer_init(phevTimer_t *timer, phevTimerCallback_t callback, void *ctx);
+
+void phev_timer_start(phevTimerWheel_t *wheel, phevTimer_t *timer, const uint64_t delay);
+
+void phev_timer_startAt(phevTimerWheel_t *wheel, phevTimer_t *timer, const uint64_t expires);
+
+void phev_timer_stop(phevTimerWheel_t *wheel, phevTimer_t *timer);
+
+bool phev_timer_active(const phevTimer_t *timer);
+
+size_t phev_timer_advance(phevTimerWheel_t *wheel, const uint64_t now);
+
+uint64_t phev_timer_time(const phevTimerWheel_t *wheel);
+
+uint64_t phev_timer_nextDeadline(const phevTimerWheel_t *wheel);
+
+#endif
@@ -174,6 +174,25 @@ messagingClient_t * phev_createOutgoingMessageClient(const char * host, const ui
     return out;
 }
 
+// The socket msg-core's tcpip client is connected with
+static int phev_tcpipSocket(messagingClient_t * client)
+{
+    return ((tcpip_ctx_t *) client->ctx)->socket;
+}
+// Does what msg-core's tcpip connect does, except that the connect in progress is kept by the pipe between retries
+static int phev_tcpipConnect(messagingClient_t * client, phevTcpConnect_t * connect)
+{
+    tcpip_ctx_t * tcpip = (tcpip_ctx_t *) client->ctx;
+    int soc = phev_tcpClientConnect(connect, tcpip->host, tcpip->port);
+
+    if(soc < 0)
+    {
+        return -1;
+    }
+    tcpip->socket = soc;
+
+    return 0;
+}
 phevCtx_t * phev_init(phevSettings_t settings)
 {
     LOG_V(TAG,"START - init");
@@ -183,6 +202,8 @@ phevCtx_t * phev_init(phevSettings_t settings)
     phevServiceSettings_t * serviceSettings;
     messagingClient_t * in = NULL;
     messagingClient_t * out = NULL;
+    phev_pipe_socketHandler_t socketHandler = settings.socketHandler;
+    phev_pipe_connectHandler_t connectHandler = settings.connectHandler;
 
     if(settings.in)
     {
@@ -204,6 +225,8 @@ phevCtx_t * phev_init(phevSettings_t settings)
         LOG_D(TAG,"Using default outgoing messaging client");
 
         out = phev_createOutgoingMessageClient(settings.host,settings.port);
+        socketHandler = phev_tcpipSocket;
+        connectHandler = phev_tcpipConnect;
     }
 
     LOG_D(TAG,"Settings event handler %p", phev_pipeEventHandler);
@@ -220,6 +243,9 @@ phevCtx_t * phev_init(phevSettings_t settings)
         .yieldHandler = NULL,
         .my18 = settings.my18,
         .ctx = ctx,
+        .outputFormat = settings.outputFormat,
+        .socketHandler = socketHandler,
+        .connectHandler = connectHandler,
     };
     ctx->serviceCtx = phev_service_create(s);
 
@@ -228,14 +254,13 @@ phevCtx_t * phev_init(phevSettings_t settings)
     return ctx;
 }
 
-static phevCtx_t * glob_phev_ctx = NULL;
-
 void phev_registrationComplete(phev_pipe_ctx_t * ctx)
 {
-    phevCtx_t * phevCtx = glob_phev_ctx;
+    phevCtx_t * phevCtx = (phevCtx_t *) ((phevServiceCtx_t *) ctx->ctx)->ctx;
 
     phevEvent_t ev = {
         .type = PHEV_REGISTRATION_COMPLETE,
+        .ctx = phevCtx,
     };
     phevCtx->eventHandler(&ev);
 
@@ -246,8 +271,6 @@ phevCtx_t * phev_registerDevice(phevSettings_t settings)
 
     phevCtx_t * ctx = phev_init(settings);
 
-    glob_phev_ctx = ctx;
-
     phev_service_register((const char *) settings.mac, ctx->serviceCtx, phev_registrationComplete);
 
     LOG_V(TAG,"END - registerDevice");
@@ -282,21 +305,43 @@ static void phev_registerUpdateCallback(phev_pipe_ctx_t *ctx, uint8_t reg, void
     cbCtx->callback(cbCtx->ctx, NULL);
     free(cbCtx);
 }
+static void phev_registerUpdateFailed(phev_pipe_ctx_t *ctx, uint8_t reg, void * customCtx)
+{
+    (void) ctx;
+    (void) reg;
+
+    LOG_W(TAG,"Update to register %02X failed", reg);
+    free(customCtx);
+}
+// Commands are queued for the pipe loop so they can be issued from any thread
+static void phev_submitUpdate(phevCtx_t * ctx, const uint8_t reg, const uint8_t * data, const size_t length, phevCallBack_t callback)
+{
+    phevCallBackCtx_t * cbCtx = NULL;
+
+    if (callback)
+    {
+        cbCtx = malloc(sizeof(phevCallBackCtx_t));
+        cbCtx->callback = callback;
+        cbCtx->ctx = ctx;
+    }
+
+    if (!phev_pipe_submitUpdate(ctx->serviceCtx->pipe, reg, data, length, (callback ? phev_registerUpdateCallback : NULL), (callback ? phev_registerUpdateFailed : NULL), cbCtx))
+    {
+        LOG_E(TAG,"Cannot queue update for register %02X", reg);
+        free(cbCtx);
+    }
+}
+static void phev_submitRegister(phevCtx_t * ctx, const uint8_t reg, const uint8_t value, phevCallBack_t callback)
+{
+    phev_submitUpdate(ctx, reg, &value, 1, callback);
+}
 
 void phev_headLights(phevCtx_t * ctx, bool on, phevCallBack_t callback)
 {
     LOG_V(TAG,"START - headLights");
-    phevCallBackCtx_t * cbCtx = malloc(sizeof(phevCallBackCtx_t));
-
-    cbCtx->callback = callback;
-    cbCtx->ctx = ctx;
 
     LOG_D(TAG,"Switching %s head lights", on ? "ON" : "OFF");
-    if (callback) {
-        phev_pipe_updateRegisterWithCallback(ctx->serviceCtx->pipe, KO_WF_H_LAMP_CONT_SP, (on ? 1 : 2), phev_registerUpdateCallback, cbCtx);
-    } else {
-        phev_pipe_updateRegister(ctx->serviceCtx->pipe, KO_WF_H_LAMP_CONT_SP, (on ? 1 : 2));
-    }
+    phev_submitRegister(ctx, KO_WF_H_LAMP_CONT_SP, (on ? 1 : 2), callback);
 
     LOG_V(TAG,"END - headLights");
 }
@@ -304,17 +349,9 @@ void phev_headLights(phevCtx_t * ctx, bool on, phevCallBack_t callback)
 void phev_parkingLights(phevCtx_t * ctx, bool on, phevCallBack_t callback)
 {
     LOG_V(TAG,"START - parkingLights");
-    phevCallBackCtx_t * cbCtx = malloc(sizeof(phevCallBackCtx_t));
-
-    cbCtx->callback = callback;
-    cbCtx->ctx = ctx;
 
     LOG_D(TAG,"Switching %s parking lights", on ? "ON" : "OFF");
-    if (callback) {
-        phev_pipe_updateRegisterWithCallback(ctx->serviceCtx->pipe, KO_WF_P_LAMP_CONT_SP, (on ? 1 : 2), phev_registerUpdateCallback, cbCtx);
-    } else {
-        phev_pipe_updateRegister(ctx->serviceCtx->pipe, KO_WF_P_LAMP_CONT_SP, (on ? 1 : 2));
-    }
+    phev_submitRegister(ctx, KO_WF_P_LAMP_CONT_SP, (on ? 1 : 2), callback);
 
     LOG_V(TAG,"END - parkingLights");
 }
@@ -322,18 +359,9 @@ void phev_parkingLights(phevCtx_t * ctx, bool on, phevCallBack_t callback)
 void phev_airCon(phevCtx_t * ctx, bool on, phevCallBack_t callback)
 {
     LOG_V(TAG,"START - airCon");
-    phevCallBackCtx_t * cbCtx = malloc(sizeof(phevCallBackCtx_t));
-
-    cbCtx->callback = callback;
-    cbCtx->ctx = ctx;
-
     LOG_D(TAG,"Switching %s air conditioning", on ? "ON" : "OFF");
 
-    if (callback) {
-        phev_pipe_updateRegisterWithCallback(ctx->serviceCtx->pipe,KO_WF_MANUAL_AC_ON_RQ_SP, (on ? 2 : 1), phev_registerUpdateCallback, cbCtx);
-    } else {
-        phev_pipe_updateRegister(ctx->serviceCtx->pipe,KO_WF_MANUAL_AC_ON_RQ_SP, (on ? 1 : 2));
-    }
+    phev_submitRegister(ctx, KO_WF_MANUAL_AC_ON_RQ_SP, (on ? 2 : 1), callback);
     LOG_V(TAG,"END - airCon");
 
 }
@@ -341,18 +369,9 @@ void phev_airCon(phevCtx_t * ctx, bool on, phevCallBack_t callback)
 void phev_updateAll(phevCtx_t * ctx, phevCallBack_t callback)
 {
     LOG_V(TAG,"START - updateAll");
-    phevCallBackCtx_t * cbCtx = malloc(sizeof(phevCallBackCtx_t));
-
-    cbCtx->callback = callback;
-    cbCtx->ctx = ctx;
-
     LOG_D(TAG,"Start Update All");
 
-    if (callback) {
-        phev_pipe_updateRegisterWithCallback(ctx->serviceCtx->pipe,KO_WF_EV_UPDATE_SP, 3, phev_registerUpdateCallback, cbCtx);
-    } else {
-        phev_pipe_updateRegister(ctx->serviceCtx->pipe,KO_WF_EV_UPDATE_SP, 3);
-    }
+    phev_submitRegister(ctx, KO_WF_EV_UPDATE_SP, 3, callback);
     LOG_V(TAG,"END - updateAll");
 
 }
@@ -360,53 +379,46 @@ void phev_updateAll(phevCtx_t * ctx, phevCallBack_t callback)
 void phev_removeACError(phevCtx_t * ctx, phevCallBack_t callback)
 {
     LOG_V(TAG,"START - remove ACError");
-    phevCallBackCtx_t * cbCtx = malloc(sizeof(phevCallBackCtx_t));
-
-    cbCtx->callback = callback;
-    cbCtx->ctx = ctx;
 
-
-    if (callback) {
-        phev_pipe_updateRegisterWithCallback(ctx->serviceCtx->pipe,19, 1, phev_registerUpdateCallback, cbCtx);
-    } else {
-        phev_pipe_updateRegister(ctx->serviceCtx->pipe,19, 1);
-    }
+    phev_submitRegister(ctx, 19, 1, callback);
     LOG_V(TAG,"END - remove ACError");
 
 }
 
 
-void phev_airConMY19(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t time,phevCallBack_t callback)
+static uint8_t phev_airConMY19Time(phevAirConTime_t time)
+{
+    switch(time)
+    {
+        case T10MIN: return 0;
+        case T20MIN: return 1;
+        case T30MIN: return 2;
+    }
+    return 1;
+}
+static uint8_t phev_airConModeValue(phevAirConMode_t mode, phevAirConTime_t time)
 {
-    LOG_V(TAG,"START - airConMY19");
-
     uint8_t val = mode;
-    uint8_t val0 = 1;
 
     switch(time)
     {
-        case T10MIN:
-         val0 = 0; break;
-        case T20MIN:
-         val0 = 1; break;
-        case T30MIN:
-         val0 = 2; break;
+        case T10MIN: val |= 0; break;
+        case T20MIN: val |= 16; break;
+        case T30MIN: val |= 32; break;
     }
+    return val;
+}
 
-    uint8_t data[] = {02, val, val0, 00};
-
-    phevCallBackCtx_t * cbCtx = malloc(sizeof(phevCallBackCtx_t));
+void phev_airConMY19(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t time,phevCallBack_t callback)
+{
+    LOG_V(TAG,"START - airConMY19");
 
-    cbCtx->callback = callback;
-    cbCtx->ctx = ctx;
+    uint8_t val = mode;
+    uint8_t data[] = {02, val, phev_airConMY19Time(time), 00};
 
     LOG_D(TAG,"Switching air conditioning mode %d", val);
 
-    if (callback) {
-        phev_pipe_updateComplexRegisterWithCallback(ctx->serviceCtx->pipe,KO_WF_AC_SCH_SP_MY19, data, sizeof(data), phev_registerUpdateCallback, cbCtx);
-    } else {
-        phev_pipe_updateComplexRegister(ctx->serviceCtx->pipe,KO_WF_AC_SCH_SP_MY19, data, sizeof(data));
-    }
+    phev_submitUpdate(ctx, KO_WF_AC_SCH_SP_MY19, data, sizeof(data), callback);
 
     LOG_V(TAG,"END - airConMY19");
 }
@@ -415,31 +427,61 @@ void phev_airConMode(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t ti
 {
     LOG_V(TAG,"START - airConMode");
 
-    uint8_t val = mode;
+    uint8_t val = phev_airConModeValue(mode, time);
+    uint8_t data[] = {0, 0, 255, 255, 255, 255, val, 255, 255, 255, 255, 255, 255, 255, 255};
 
-    switch(time)
-    {
-        case T10MIN: val |= 0; break;
-        case T20MIN: val |= 16; break;
-        case T30MIN: val |= 32; break;
-    }
+    LOG_D(TAG,"Switching air conditioning mode %d", val);
 
-    uint8_t data[] = {0, 0, 255, 255, 255, 255, val, 255, 255, 255, 255, 255, 255, 255, 255};
+    phev_submitUpdate(ctx, KO_WF_AC_SCH_SP, data, sizeof(data), callback);
 
-    phevCallBackCtx_t * cbCtx = malloc(sizeof(phevCallBackCtx_t));
+    LOG_V(TAG,"END - airConMode");
+}
 
-    cbCtx->callback = callback;
-    cbCtx->ctx = ctx;
+phevCommand_t * phev_headLightsAsync(phevCtx_t * ctx, bool on, phevCommandCallBack_t callback, void * userCtx)
+{
+    LOG_D(TAG,"Switching %s head lights", on ? "ON" : "OFF");
 
-    LOG_D(TAG,"Switching air conditioning mode %d", val);
+    return phev_command_submitRegister(ctx, KO_WF_H_LAMP_CONT_SP, (on ? 1 : 2), callback, userCtx);
+}
 
-    if (callback) {
-        phev_pipe_updateComplexRegisterWithCallback(ctx->serviceCtx->pipe,KO_WF_AC_SCH_SP, data, sizeof(data), phev_registerUpdateCallback, cbCtx);
-    } else {
-        phev_pipe_updateComplexRegister(ctx->serviceCtx->pipe,KO_WF_AC_SCH_SP, data, sizeof(data));
-    }
+phevCommand_t * phev_parkingLightsAsync(phevCtx_t * ctx, bool on, phevCommandCallBack_t callback, void * userCtx)
+{
+    LOG_D(TAG,"Switching %s parking lights", on ? "ON" : "OFF");
 
-    LOG_V(TAG,"END - airConMode");
+    return phev_command_submitRegister(ctx, KO_WF_P_LAMP_CONT_SP, (on ? 1 : 2), callback, userCtx);
+}
+
+phevCommand_t * phev_airConAsync(phevCtx_t * ctx, bool on, phevCommandCallBack_t callback, void * userCtx)
+{
+    LOG_D(TAG,"Switching %s air conditioning", on ? "ON" : "OFF");
+
+    return phev_command_submitRegister(ctx, KO_WF_MANUAL_AC_ON_RQ_SP, (on ? 2 : 1), callback, userCtx);
+}
+
+phevCommand_t * phev_updateAllAsync(phevCtx_t * ctx, phevCommandCallBack_t callback, void * userCtx)
+{
+    return phev_command_submitRegister(ctx, KO_WF_EV_UPDATE_SP, 3, callback, userCtx);
+}
+
+phevCommand_t * phev_removeACErrorAsync(phevCtx_t * ctx, phevCommandCallBack_t callback, void * userCtx)
+{
+    return phev_command_submitRegister(ctx, 19, 1, callback, userCtx);
+}
+
+phevCommand_t * phev_airConMY19Async(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t time, phevCommandCallBack_t callback, void * userCtx)
+{
+    uint8_t val = mode;
+    uint8_t data[] = {02, val, phev_airConMY19Time(time), 00};
+
+    return phev_command_submit(ctx, KO_WF_AC_SCH_SP_MY19, data, sizeof(data), callback, userCtx);
+}
+
+phevCommand_t * phev_airConModeAsync(phevCtx_t * ctx, phevAirConMode_t mode, phevAirConTime_t time, phevCommandCallBack_t callback, void * userCtx)
+{
+    uint8_t val = phev_airConModeValue(mode, time);
+    uint8_t data[] = {0, 0, 255, 255, 255, 255, val, 255, 255, 255, 255, 255, 255, 255, 255};
+
+    return phev_command_submit(ctx, KO_WF_AC_SCH_SP, data, sizeof(data), callback, userCtx);
 }
 
 int phev_batteryLevel(phevCtx_t * ctx)
@@ -537,6 +579,47 @@ char * phev_statusAsJson(phevCtx_t * ctx)
     return phev_service_statusAsJson(ctx->serviceCtx);
 }
 
+uint32_t phev_statusVersion(phevCtx_t * ctx)
+{
+    return phev_service_statusVersion(ctx->serviceCtx);
+}
+
+// The request is the register then the capacity
+static void phev_enableHistoryTask(phev_pipe_ctx_t * pipe, const uint8_t * data, size_t length, void * model)
+{
+    (void) pipe;
+    (void) length;
+
+    size_t capacity;
+
+    memcpy(&capacity, &data[1], sizeof(capacity));
+    phev_model_enableHistory((phevModel_t *) model, data[0], capacity);
+}
+int phev_enableRegisterHistory(phevCtx_t * ctx, uint8_t reg, size_t capacity)
+{
+    uint8_t request[1 + sizeof(capacity)];
+
+    if(capacity > PHEV_MODEL_HISTORY_SIZE)
+    {
+        LOG_E(TAG,"Cannot keep %zu entries of history for register %02X, at most %d", capacity, reg, PHEV_MODEL_HISTORY_SIZE);
+        return 0;
+    }
+    request[0] = reg;
+    memcpy(&request[1], &capacity, sizeof(capacity));
+
+    return phev_pipe_submitTask(ctx->serviceCtx->pipe, phev_enableHistoryTask, request, sizeof(request), ctx->serviceCtx->model);
+}
+
+size_t phev_registerHistoryLatest(phevCtx_t * ctx, uint8_t reg, phevRegisterHistoryEntry_t * out, size_t max)
+{
+    return phev_model_historyLatest(ctx->serviceCtx->model, reg, out, max);
+}
+
+size_t phev_registerHistoryRange(phevCtx_t * ctx, uint8_t reg, uint64_t from, uint64_t to, phevRegisterHistoryEntry_t * out, size_t max)
+{
+    return phev_model_historyRange(ctx->serviceCtx->model, reg, from, to, out, max);
+}
+
 void phev_disconnectCar(phevCtx_t * ctx)
 {
     LOG_V(TAG,"START - disconnectCar");
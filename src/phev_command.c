@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include "phev_command.h"
+#include "phev.h"
+#include "phev_pipe.h"
+#include "phev_timer.h"
+#include "logger.h"
+
+const static char *APP_TAG = "PHEV_COMMAND";
+
+static void phev_command_complete(phevCommand_t * command, phevCommandStatus_t status)
+{
+    bool completed = false;
+
+    pthread_mutex_lock(&command->lock);
+    if (atomic_load_explicit(&command->status, memory_order_relaxed) == PHEV_COMMAND_PENDING)
+    {
+        command->completed = phev_timer_now();
+        atomic_store_explicit(&command->status, status, memory_order_release);
+        pthread_cond_broadcast(&command->done);
+        completed = true;
+    }
+    pthread_mutex_unlock(&command->lock);
+
+    if (completed)
+    {
+        LOG_D(APP_TAG, "Command for register %02X completed with status %d in %llums", command->reg, status, (unsigned long long) (command->completed - command->submitted));
+
+        if (command->callback != NULL)
+        {
+            command->callback(command, command->userCtx);
+        }
+    }
+}
+static void phev_command_acked(phev_pipe_ctx_t * ctx, uint8_t reg, void * customCtx)
+{
+    (void) ctx;
+    (void) reg;
+
+    phevCommand_t * command = (phevCommand_t *) customCtx;
+
+    phev_command_complete(command, PHEV_COMMAND_SUCCESS);
+    phev_command_release(command);
+}
+static void phev_command_failed(phev_pipe_ctx_t * ctx, uint8_t reg, void * customCtx)
+{
+    (void) reg;
+
+    phevCommand_t * command = (phevCommand_t *) customCtx;
+
+    phev_command_complete(command, (ctx->connected ? PHEV_COMMAND_TIMEOUT : PHEV_COMMAND_DISCONNECTED));
+    phev_command_release(command);
+}
+phevCommand_t * phev_command_submit(phevCtx_t * ctx, const uint8_t reg, const uint8_t * data, const size_t length, phevCommandCallBack_t callback, void * userCtx)
+{
+    LOG_V(APP_TAG, "START - submit");
+
+    phevCommand_t * command = malloc(sizeof(phevCommand_t));
+
+    if (command == NULL)
+    {
+        LOG_E(APP_TAG, "Cannot allocate command for register %02X", reg);
+        return NULL;
+    }
+
+    command->ctx = ctx;
+    command->reg = reg;
+    command->submitted = phev_timer_now();
+    command->completed = 0;
+    command->callback = callback;
+    command->userCtx = userCtx;
+    atomic_init(&command->status, PHEV_COMMAND_PENDING);
+    // One reference for the caller and one for the pipe
+    atomic_init(&command->refs, 2);
+    pthread_mutex_init(&command->lock, NULL);
+    pthread_cond_init(&command->done, NULL);
+
+    if (!phev_pipe_submitUpdate(ctx->serviceCtx->pipe, reg, data, length, phev_command_acked, phev_command_failed, command))
+    {
+        LOG_E(APP_TAG, "Cannot queue command for register %02X", reg);
+        command->callback = NULL;
+        phev_command_complete(command, PHEV_COMMAND_REJECTED);
+        phev_command_release(command);
+    }
+
+    LOG_V(APP_TAG, "END - submit");
+
+    return command;
+}
+phevCommand_t * phev_command_submitRegister(phevCtx_t * ctx, const uint8_t reg, const uint8_t value, phevCommandCallBack_t callback, void * userCtx)
+{
+    return phev_command_submit(ctx, reg, &value, 1, callback, userCtx);
+}
+phevCommandStatus_t phev_command_status(phevCommand_t * command)
+{
+    return (phevCommandStatus_t) atomic_load_explicit(&command->status, memory_order_acquire);
+}
+phevCommandStatus_t phev_command_wait(phevCommand_t * command, int timeout)
+{
+    struct timespec deadline;
+
+    if (timeout >= 0)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (long) (timeout % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&command->lock);
+    while (atomic_load_explicit(&command->status, memory_order_relaxed) == PHEV_COMMAND_PENDING)
+    {
+        if (timeout < 0)
+        {
+            pthread_cond_wait(&command->done, &command->lock);
+        }
+        else if (pthread_cond_timedwait(&command->done, &command->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&command->lock);
+
+    return phev_command_status(command);
+}
+bool phev_command_cancel(phevCommand_t * command)
+{
+    bool cancelled = false;
+
+    pthread_mutex_lock(&command->lock);
+    if (atomic_load_explicit(&command->status, memory_order_relaxed) == PHEV_COMMAND_PENDING)
+    {
+        command->completed = phev_timer_now();
+        atomic_store_explicit(&command->status, PHEV_COMMAND_CANCELLED, memory_order_release);
+        pthread_cond_broadcast(&command->done);
+        cancelled = true;
+    }
+    pthread_mutex_unlock(&command->lock);
+
+    return cancelled;
+}
+uint64_t phev_command_latency(phevCommand_t * command)
+{
+    if (phev_command_status(command) == PHEV_COMMAND_PENDING)
+    {
+        return 0;
+    }
+    return command->completed - command->submitted;
+}
+void phev_command_release(phevCommand_t * command)
+{
+    if (command == NULL)
+    {
+        return;
+    }
+    if (atomic_fetch_sub_explicit(&command->refs, 1, memory_order_acq_rel) == 1)
+    {
+        pthread_mutex_destroy(&command->lock);
+        pthread_cond_destroy(&command->done);
+        free(command);
+    }
+}
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "phev_core.h"
+#include "phev_simd.h"
 #include "msg_core.h"
 #include "msg_utils.h"
 #include "logger.h"
@@ -18,61 +19,30 @@ uint8_t *phev_core_xorDataWithValue(const uint8_t *data, const uint8_t xor)
 
     LOG_D(APP_TAG, "Decoding data with length %d with XOR %02X", length, xor);
 
-    for (int i = 0; i < length; i++)
-    {
-        decoded[i] = data[i] ^ xor;
-    }
+    phev_simd_xor(decoded, data, length, xor);
 
     LOG_BUFFER_HEXDUMP(APP_TAG, decoded, length, LOG_DEBUG);
     LOG_V(APP_TAG, "END - xorDataWithValue");
 
     return decoded;
 }
+#define PHEV_CORE_COMMAND_INFO(command, flags, xorRule, modelYear, ack) [command] = {flags, xorRule, modelYear, ack},
+
+const static phevCommandInfo_t phev_core_commands[256] = {
+    PHEV_CORE_COMMANDS(PHEV_CORE_COMMAND_INFO)
+};
+
+const phevCommandInfo_t * phev_core_commandInfo(const uint8_t command)
+{
+    return &phev_core_commands[command];
+}
 bool phev_core_checkIncomingCommand(const uint8_t command)
 {
-    switch (command)
-    {
-    case 0x3f:
-        return true;
-    case 0x6f:
-        return true;
-    case 0x4e:
-        return true;
-    case 0x5e:
-        return true;
-    case 0xBB:
-        return true;
-    case 0xCC:
-        return true;
-    case 0x2f:
-        return true;
-    case 0x2e:
-        return true;
-    default:
-        return false;
-    }
+    return (phev_core_commands[command].flags & PHEV_CORE_CMD_INCOMING) != 0;
 }
 bool phev_core_checkOutgoingCommand(const uint8_t command)
 {
-    switch (command)
-    {
-    case 0xf3:
-        return true;
-    case 0xf6:
-        return true;
-    case 0xe4:
-        return true;
-    case 0xe5:
-        return true;
-    case 0xBB:
-        return true;
-    case 0xCC:
-        return true;
-    case 0xf2:
-        return true;
-    default:
-        return false;
-    }
+    return (phev_core_commands[command].flags & PHEV_CORE_CMD_OUTGOING) != 0;
 }
 
 bool phev_core_validateChecksum(const uint8_t *data)
@@ -95,59 +65,120 @@ bool phev_core_validateChecksum(const uint8_t *data)
 }
 bool phev_core_validateChecksumXOR(const uint8_t *data, const uint8_t xor)
 {
-    uint8_t *decodedData = phev_core_xorDataWithValue(data, xor);
-
-    bool valid = phev_core_validateChecksum(decodedData);
-
-    free(decodedData);
+    size_t length = (data[1] ^ xor) + 2;
 
-    return valid;
+    return phev_simd_xorSum(data, length - 1, xor) == (data[length - 1] ^ xor);
 }
-message_t *phev_core_unencodedIncomingMessage(const uint8_t *data)
+bool phev_core_unencodedIncomingCommand(const uint8_t command)
 {
-    uint8_t command = data[0];
-    uint8_t length = data[1] + 2;
+    return (phev_core_commands[command].flags & PHEV_CORE_CMD_CLEAR_INCOMING) != 0;
+}
+phevFrameStatus_t phev_core_checkFrameWithXOR(const uint8_t *data, const size_t len, const uint8_t xor)
+{
+    if (!phev_core_checkIncomingCommand(data[0] ^ xor) || (data[1] ^ xor) < 3)
+    {
+        return PHEV_CORE_FRAME_INVALID;
+    }
+    if ((size_t)(data[1] ^ xor) + 2 > len)
+    {
+        return PHEV_CORE_FRAME_INCOMPLETE;
+    }
+    return (phev_core_validateChecksumXOR(data, xor) ? PHEV_CORE_FRAME_COMPLETE : PHEV_CORE_FRAME_INVALID);
+}
+phevFrameStatus_t phev_core_checkIncomingFrame(const uint8_t *data, const size_t len, uint8_t *xor)
+{
+    if (len < 3)
+    {
+        return PHEV_CORE_FRAME_INCOMPLETE;
+    }
 
-    if(phev_core_validateChecksum(data))
+    phevFrameStatus_t status = phev_core_checkFrameWithXOR(data, len, 0);
+
+    if (status == PHEV_CORE_FRAME_COMPLETE)
     {
-        switch (data[0])
-        {
-        case 0x4e:
-        {
-            LOG_D(APP_TAG, "Start (4E) unencoded");
-            return msg_utils_createMsg(data, length);
-        }
-        case 0x5e:
-        {
-            LOG_D(APP_TAG, "Start (5E) unencoded");
-            return msg_utils_createMsg(data, length);
-        }
-        case 0x3f:
-        {
-            LOG_D(APP_TAG, "Ping response unencoded");
-            return msg_utils_createMsg(data, length);
-        }
-        case 0x6f:
+        *xor = 0;
+        return (phev_core_unencodedIncomingCommand(data[0]) ? PHEV_CORE_FRAME_COMPLETE : PHEV_CORE_FRAME_INVALID);
+    }
+
+    bool incomplete = (status == PHEV_CORE_FRAME_INCOMPLETE);
+    const uint8_t candidates[] = {data[2], data[2] ^ 1};
+
+    for (int i = 0; i < sizeof(candidates); i++)
+    {
+        status = phev_core_checkFrameWithXOR(data, len, candidates[i]);
+
+        if (status == PHEV_CORE_FRAME_COMPLETE)
         {
-            LOG_D(APP_TAG, "Command unencoded");
-            return msg_utils_createMsg(data, length);
+            *xor = candidates[i];
+            return PHEV_CORE_FRAME_COMPLETE;
         }
-        case 0xbb:
+        incomplete |= (status == PHEV_CORE_FRAME_INCOMPLETE);
+    }
+
+    return (incomplete ? PHEV_CORE_FRAME_INCOMPLETE : PHEV_CORE_FRAME_INVALID);
+}
+void phev_core_initXORPredictor(phevXORPredictor_t *predictor)
+{
+    memset(predictor, 0, sizeof(phevXORPredictor_t));
+}
+void phev_core_seedXORPredictor(phevXORPredictor_t *predictor, const uint8_t currentXOR, const uint8_t commandXOR, const uint8_t pingXOR)
+{
+    predictor->keys[PHEV_CORE_XOR_PREDICT_LAST] = currentXOR;
+    predictor->keys[PHEV_CORE_XOR_PREDICT_COMMAND] = commandXOR;
+    predictor->keys[PHEV_CORE_XOR_PREDICT_PING] = pingXOR;
+}
+phevFrameStatus_t phev_core_predictIncomingFrame(const uint8_t *data, const size_t len, phevXORPredictor_t *predictor, uint8_t *xor)
+{
+    if (len < 3)
+    {
+        return PHEV_CORE_FRAME_INCOMPLETE;
+    }
+
+    bool seeded = false;
+
+    for (int i = 0; i < PHEV_CORE_XOR_PREDICTIONS; i++)
+    {
+        uint8_t key = predictor->keys[i];
+
+        seeded |= (key != 0);
+
+        // The type byte decodes to request or response so only keys within one bit of it can match
+        if (key == 0 || (key ^ data[2]) > 1 || (i > 0 && key == predictor->keys[i - 1]))
         {
-            LOG_D(APP_TAG, "BB Command unencoded");
-            return msg_utils_createMsg(data, length);
+            continue;
         }
-        case 0xcc:
+        if (phev_core_checkFrameWithXOR(data, len, key) == PHEV_CORE_FRAME_COMPLETE)
         {
-            LOG_D(APP_TAG, "CC Command unencoded");
-            return msg_utils_createMsg(data, length);
+            predictor->hits++;
+            predictor->keys[PHEV_CORE_XOR_PREDICT_LAST] = key;
+            *xor = key;
+            return PHEV_CORE_FRAME_COMPLETE;
         }
-        case 0x2e:
+    }
+
+    phevFrameStatus_t status = phev_core_checkIncomingFrame(data, len, xor);
+
+    if (status == PHEV_CORE_FRAME_COMPLETE && *xor != 0)
+    {
+        if (seeded)
         {
-            LOG_D(APP_TAG, "2E Command unencoded");
-            return msg_utils_createMsg(data, length);
-        }
+            predictor->misses++;
+            LOG_D(APP_TAG, "XOR prediction missed, found %02X", *xor);
         }
+        predictor->keys[PHEV_CORE_XOR_PREDICT_LAST] = *xor;
+    }
+
+    return status;
+}
+message_t *phev_core_unencodedIncomingMessage(const uint8_t *data)
+{
+    uint8_t command = data[0];
+    uint8_t length = data[1] + 2;
+
+    if(phev_core_validateChecksum(data) && (phev_core_commands[command].flags & PHEV_CORE_CMD_CLEAR_INCOMING))
+    {
+        LOG_D(APP_TAG, "Command %02X unencoded", command);
+        return msg_utils_createMsg(data, length);
     }
     LOG_E(APP_TAG,"Unknown unencoded command %02X", command);
     return NULL;
@@ -157,31 +188,10 @@ message_t *phev_core_unencodedOutgoingMessage(const uint8_t *data)
     uint8_t command = data[0];
     uint8_t length = data[1] + 2;
 
-    if(phev_core_validateChecksum(data))
+    if(phev_core_validateChecksum(data) && (phev_core_commands[command].flags & PHEV_CORE_CMD_CLEAR_OUTGOING))
     {
-        switch (data[0])
-        {
-        case 0xe4:
-        {
-            LOG_D(APP_TAG, "Start (E4) unencoded");
-            return msg_utils_createMsg(data, length);
-        }
-        case 0xe5:
-        {
-            LOG_D(APP_TAG, "Start (E5) unencoded");
-            return msg_utils_createMsg(data, length);
-        }
-        case 0xf3:
-        {
-            LOG_D(APP_TAG, "Ping response unencoded");
-            return msg_utils_createMsg(data, length);
-        }
-        case 0xf6:
-        {
-            LOG_D(APP_TAG, "Command unencoded");
-            return msg_utils_createMsg(data, length);
-        }
-        }
+        LOG_D(APP_TAG, "Command %02X unencoded", command);
+        return msg_utils_createMsg(data, length);
     }
     LOG_E(APP_TAG,"Unknown unencoded command %02X", command);
     return NULL;
@@ -279,17 +289,35 @@ uint8_t phev_core_getMessageXOR(const message_t * message)
 {
     if(message != NULL && message->ctx != NULL)
     {
-        uint8_t * xor = (uint8_t *) message->ctx;
-        return xor[0];
+        const phevMessageCtx_t * ctx = (const phevMessageCtx_t *) message->ctx;
+        return ctx->XOR;
     }
 
     return 0;
 }
-message_t * phev_core_createMsgXOR(const uint8_t * data, const size_t length, const uint8_t xor)
+bool phev_core_messageEncoded(const message_t * message)
 {
-    uint8_t * ctx = malloc(1);
+    if(message != NULL && message->ctx != NULL)
+    {
+        const phevMessageCtx_t * ctx = (const phevMessageCtx_t *) message->ctx;
+        return ctx->encoded;
+    }
 
-    ctx[0] = xor;
+    return false;
+}
+#define PHEV_CORE_XOR_CTX(n) { .XOR = (n), .encoded = true, .decoded = NULL }
+#define PHEV_CORE_XOR_4(n) PHEV_CORE_XOR_CTX(n), PHEV_CORE_XOR_CTX((n) + 1), PHEV_CORE_XOR_CTX((n) + 2), PHEV_CORE_XOR_CTX((n) + 3)
+#define PHEV_CORE_XOR_16(n) PHEV_CORE_XOR_4(n), PHEV_CORE_XOR_4((n) + 4), PHEV_CORE_XOR_4((n) + 8), PHEV_CORE_XOR_4((n) + 12)
+#define PHEV_CORE_XOR_64(n) PHEV_CORE_XOR_16(n), PHEV_CORE_XOR_16((n) + 16), PHEV_CORE_XOR_16((n) + 32), PHEV_CORE_XOR_16((n) + 48)
+
+// Message contexts point into this table so tagging a message with its XOR never allocates
+const static phevMessageCtx_t phev_core_xorValues[256] = {
+    PHEV_CORE_XOR_64(0), PHEV_CORE_XOR_64(64), PHEV_CORE_XOR_64(128), PHEV_CORE_XOR_64(192)
+};
+
+message_t * phev_core_createMsgXOR(const uint8_t * data, const size_t length, const uint8_t xor)
+{
+    void * ctx = (void *) &phev_core_xorValues[xor];
 
     message_t * message = msg_utils_createMsgCtx(data, length, ctx);
 
@@ -357,41 +385,19 @@ uint8_t phev_core_getXOR(const uint8_t *data, const uint8_t xor)
 
     LOG_D(APP_TAG, "Command is %02x with decoded XOR and %02X with passed XOR", command, data[0] ^ xor);
 
-    if (command == 0xBB)
+    switch (phev_core_commands[command].xorRule)
     {
+    case PHEV_CORE_XOR_KEY:
         newXOR = data[2];
-    }
-    if (command == 0XBA)
-    {
+        break;
+    case PHEV_CORE_XOR_KEY_ODD:
         newXOR = data[2] ^ 1;
-    }
-    if (command == 0x6f)
-    {
-        newXOR = data[2];
-    }
-    if (command == 0x6e)
-    {
-        newXOR = data[2] ^ 1;
-    }
-    if (command == 0x3f)
-    {
-        newXOR = data[2];
-    }
-    if (command == 0x3e)
-    {
-        newXOR = data[2] ^ 1;
-    }
-    if (command == 0xcd)
-    {
-        newXOR = data[2] ^ 1;
-    }
-    if (command == 0x2f)
-    {
-        newXOR = data[2];
-    }
-    if (command == 0x4e)
-    {
+        break;
+    case PHEV_CORE_XOR_ZERO:
         newXOR = 0;
+        break;
+    default:
+        break;
     }
 
     LOG_D(APP_TAG, "Returning new XOR of %02x", newXOR);
@@ -406,15 +412,7 @@ uint8_t phev_core_getType(const uint8_t *data)
 }
 uint8_t phev_core_validateCommand(const uint8_t command)
 {
-    for (int i = 0; i < sizeof(allowedCommands); i++)
-    {
-        if (command == allowedCommands[i])
-        {
-            return command;
-        }
-    }
-
-    return 0;
+    return ((phev_core_commands[command].flags & PHEV_CORE_CMD_ALLOWED) ? command : 0);
 }
 uint8_t * phev_core_getData(const uint8_t *data)
 {
@@ -433,16 +431,7 @@ uint8_t * phev_core_getData(const uint8_t *data)
 }
 uint8_t phev_core_checksum(const uint8_t *data)
 {
-    uint8_t b = 0;
-    int len = data[1] + 2;
-    for (int i = 0;; i++)
-    {
-        if (i >= len - 1)
-        {
-            return b;
-        }
-        b = (uint8_t)(data[i] + b);
-    }
+    return phev_simd_sum(data, data[1] + 1);
 }
 uint8_t phev_core_getChecksum(const uint8_t *data)
 {
@@ -453,7 +442,7 @@ uint8_t phev_core_getChecksum(const uint8_t *data)
 phevMessage_t *phev_core_createMessage(const uint8_t command, const uint8_t type, const uint8_t reg, const uint8_t *data, const size_t length)
 {
     LOG_V(APP_TAG, "START - createMessage");
-    LOG_D(APP_TAG, "Data %d Length %d", data[0], length);
+    LOG_D(APP_TAG, "Data %d Length %d", (length > 0 ? data[0] : 0), length);
     phevMessage_t *message = malloc(sizeof(phevMessage_t));
 
     message->command = command;
@@ -461,9 +450,12 @@ phevMessage_t *phev_core_createMessage(const uint8_t command, const uint8_t type
     message->reg = reg;
     message->length = length;
     message->data = malloc(message->length);
-    memcpy(message->data, data, length);
+    if (length > 0)
+    {
+        memcpy(message->data, data, length);
+    }
     message->XOR = 0;
-    LOG_D(APP_TAG, "Message Data %d", message->data[0]);
+    LOG_D(APP_TAG, "Message Data %d", (length > 0 ? message->data[0] : 0));
 
     LOG_V(APP_TAG, "END - createMessage");
 
@@ -492,22 +484,19 @@ int phev_core_validate_buffer(const uint8_t *msg, const size_t len)
     uint8_t length = msg[1];
     uint8_t cmd = msg[0];
 
-    for (int i = 0; i < sizeof(allowedCommands); i++)
+    if (phev_core_commands[cmd].flags & PHEV_CORE_CMD_ALLOWED)
     {
-        if (cmd == allowedCommands[i])
+        //HACK to handle CD / CC
+        if (cmd == 0xcd)
+        {
+            return 1;
+        }
+        if (length + 2 > len)
         {
-            //HACK to handle CD / CC
-            if (cmd == 0xcd)
-            {
-                return 1;
-            }
-            if (length + 2 > len)
-            {
-                LOG_E(APP_TAG, "Valid command but length incorrect : command %02x length %dx expected %zu", msg[0], length, len);
-                return 0; // length goes past end of message
-            }
-            return 1; //valid message
+            LOG_E(APP_TAG, "Valid command but length incorrect : command %02x length %dx expected %zu", msg[0], length, len);
+            return 0; // length goes past end of message
         }
+        return 1; //valid message
     }
     LOG_E(APP_TAG, "Invalid command %02x length %02x", msg[0], msg[1]);
 
@@ -538,6 +527,207 @@ uint8_t *phev_core_unscramble(const uint8_t *data, const size_t len)
 
     return decodedData;
 }
+static size_t phev_core_fillMessageView(const uint8_t *data, const uint8_t xor, phevMessageView_t *view)
+{
+    size_t length = (data[1] ^ xor) + 2;
+
+    phev_simd_xor(view->frame, data, length, xor);
+
+    view->message.command = view->frame[0];
+    view->message.length = view->frame[1] - 3;
+    view->message.type = view->frame[2];
+    view->message.reg = view->frame[3];
+    view->message.checksum = view->frame[length - 1];
+    view->message.data = (view->message.length > 0 ? view->frame + 4 : NULL);
+    view->message.XOR = xor;
+
+    return length;
+}
+size_t phev_core_decodeMessageView(const uint8_t *data, const size_t len, phevMessageView_t *view)
+{
+    LOG_V(APP_TAG, "START - decodeMessageView");
+
+    uint8_t xor = 0;
+
+    if (!data || !view)
+    {
+        LOG_E(APP_TAG, "Invalid pointer to data or view");
+        return 0;
+    }
+
+    if (phev_core_checkIncomingFrame(data, len, &xor) != PHEV_CORE_FRAME_COMPLETE)
+    {
+        LOG_E(APP_TAG, "Invalid message command %02X length %zu", data[0], len);
+        return 0;
+    }
+
+    size_t length = phev_core_fillMessageView(data, xor, view);
+
+    LOG_V(APP_TAG, "END - decodeMessageView");
+
+    return length;
+}
+bool phev_core_attachDecodedMessage(message_t *message, phevDecodedMessage_t *decoded)
+{
+    LOG_V(APP_TAG, "START - attachDecodedMessage");
+
+    if (!message || !decoded)
+    {
+        LOG_E(APP_TAG, "Invalid pointer to message or decoded slot");
+        return false;
+    }
+
+    uint8_t xor = phev_core_getMessageXOR(message);
+
+    // Frames reaching here have already been validated by the stream parser, so only the XOR needs removing
+    if (message->length < 5 || (size_t) (message->data[1] ^ xor) + 2 != message->length)
+    {
+        LOG_W(APP_TAG, "Cannot attach decoded message length %zu", message->length);
+        return false;
+    }
+
+    phev_core_fillMessageView(message->data, xor, &decoded->view);
+
+    decoded->ctx.XOR = xor;
+    decoded->ctx.encoded = phev_core_messageEncoded(message);
+    decoded->ctx.decoded = &decoded->view.message;
+    message->ctx = &decoded->ctx;
+
+    LOG_V(APP_TAG, "END - attachDecodedMessage");
+
+    return true;
+}
+phevMessage_t * phev_core_getDecodedMessage(const message_t *message, phevMessageView_t *view)
+{
+    if (!message)
+    {
+        return NULL;
+    }
+
+    if (message->ctx != NULL)
+    {
+        const phevMessageCtx_t *ctx = (const phevMessageCtx_t *) message->ctx;
+
+        if (ctx->decoded != NULL && ctx->decoded->length + 5 == message->length && (message->data[0] ^ ctx->XOR) == ctx->decoded->command)
+        {
+            return ctx->decoded;
+        }
+    }
+
+    if (!view || phev_core_decodeMessageView(message->data, message->length, view) == 0)
+    {
+        return NULL;
+    }
+
+    return &view->message;
+}
+void phev_core_initFrameTemplate(phevFrameTemplate_t *frameTemplate, const uint8_t command, const uint8_t type, const uint8_t length, const uint8_t xor)
+{
+    LOG_V(APP_TAG, "START - initFrameTemplate");
+
+    frameTemplate->command = command;
+    frameTemplate->type = type;
+    frameTemplate->length = (length > PHEV_CORE_TEMPLATE_MAX_DATA ? PHEV_CORE_TEMPLATE_MAX_DATA : length);
+    frameTemplate->xor = xor;
+    frameTemplate->frame[0] = command ^ xor;
+    frameTemplate->frame[1] = (frameTemplate->length + 3) ^ xor;
+    frameTemplate->frame[2] = type ^ xor;
+    frameTemplate->headerSum = (uint8_t)(command + frameTemplate->length + 3 + type);
+    frameTemplate->valid = true;
+
+    LOG_V(APP_TAG, "END - initFrameTemplate");
+}
+bool phev_core_frameTemplateMatches(const phevFrameTemplate_t *frameTemplate, const uint8_t command, const uint8_t type, const uint8_t length, const uint8_t xor)
+{
+    return frameTemplate->valid && frameTemplate->command == command && frameTemplate->type == type && frameTemplate->length == length && frameTemplate->xor == xor;
+}
+size_t phev_core_patchFrameTemplate(phevFrameTemplate_t *frameTemplate, const uint8_t reg, const uint8_t *data)
+{
+    const uint8_t xor = frameTemplate->xor;
+    uint8_t checksum = (uint8_t)(frameTemplate->headerSum + reg);
+
+    frameTemplate->frame[3] = reg ^ xor;
+
+    for (int i = 0; i < frameTemplate->length; i++)
+    {
+        frameTemplate->frame[i + 4] = data[i] ^ xor;
+        checksum = (uint8_t)(checksum + data[i]);
+    }
+    frameTemplate->frame[frameTemplate->length + 4] = checksum ^ xor;
+
+    return frameTemplate->length + 5;
+}
+void phev_core_streamParserInit(phevStreamParser_t *parser)
+{
+    parser->head = 0;
+    parser->tail = 0;
+}
+size_t phev_core_streamParserPending(const phevStreamParser_t *parser)
+{
+    return parser->tail - parser->head;
+}
+size_t phev_core_streamParserWrite(phevStreamParser_t *parser, const uint8_t *data, const size_t len)
+{
+    size_t space = PHEV_CORE_STREAM_BUFFER_SIZE - phev_core_streamParserPending(parser);
+    size_t count = (len < space ? len : space);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        parser->buffer[(parser->tail + i) & (PHEV_CORE_STREAM_BUFFER_SIZE - 1)] = data[i];
+    }
+    parser->tail += count;
+
+    return count;
+}
+message_t * phev_core_streamParserNextMessage(phevStreamParser_t *parser, phevXORPredictor_t *predictor)
+{
+    LOG_V(APP_TAG, "START - streamParserNextMessage");
+
+    uint8_t frame[PHEV_CORE_MAX_FRAME_LENGTH];
+
+    while (phev_core_streamParserPending(parser) > 0)
+    {
+        size_t pending = phev_core_streamParserPending(parser);
+        size_t offset = parser->head & (PHEV_CORE_STREAM_BUFFER_SIZE - 1);
+        size_t length = (pending < PHEV_CORE_MAX_FRAME_LENGTH ? pending : PHEV_CORE_MAX_FRAME_LENGTH);
+        const uint8_t *data = parser->buffer + offset;
+
+        if (offset + length > PHEV_CORE_STREAM_BUFFER_SIZE)
+        {
+            size_t first = PHEV_CORE_STREAM_BUFFER_SIZE - offset;
+
+            memcpy(frame, parser->buffer + offset, first);
+            memcpy(frame + first, parser->buffer, length - first);
+            data = frame;
+        }
+
+        uint8_t xor = 0;
+        phevFrameStatus_t status = (predictor ? phev_core_predictIncomingFrame(data, length, predictor, &xor) : phev_core_checkIncomingFrame(data, length, &xor));
+
+        if (status == PHEV_CORE_FRAME_INCOMPLETE)
+        {
+            LOG_D(APP_TAG, "Waiting for rest of frame, %zu bytes pending", pending);
+            break;
+        }
+        if (status == PHEV_CORE_FRAME_INVALID)
+        {
+            LOG_D(APP_TAG, "Skipping byte %02X to resync", data[0]);
+            parser->head++;
+            continue;
+        }
+
+        size_t frameLength = (data[1] ^ xor) + 2;
+        message_t *message = (xor == 0 ? msg_utils_createMsg(data, frameLength) : phev_core_createMsgXOR(data, frameLength, xor));
+
+        parser->head += frameLength;
+
+        LOG_V(APP_TAG, "END - streamParserNextMessage");
+        return message;
+    }
+
+    LOG_V(APP_TAG, "END - streamParserNextMessage");
+    return NULL;
+}
 int phev_core_decodeMessage(const uint8_t *data, const size_t len, phevMessage_t *msg)
 {
     LOG_V(APP_TAG, "START - decodeMessage");
@@ -554,27 +744,17 @@ int phev_core_decodeMessage(const uint8_t *data, const size_t len, phevMessage_t
         return 0;
     }
 
-    message_t * message = phev_core_extractAndDecodeIncomingMessageAndXOR(data);
+    phevMessageView_t view;
 
-    if (message)
+    if (phev_core_decodeMessageView(data, len, &view) > 0)
     {
+        *msg = view.message;
 
-        msg->command = message->data[0];
-        msg->length = message->data[1] - 3;
-        msg->type = message->data[2];
-        msg->reg = message->data[3];
-        msg->checksum = phev_core_getChecksum(message->data);
-        if(msg->length > 0 && message->data)
-        {
-            msg->data = phev_core_getData(message->data);
-        }
-        else
+        if (view.message.length > 0)
         {
-            msg->data = NULL;
+            msg->data = malloc(view.message.length);
+            memcpy(msg->data, view.message.data, view.message.length);
         }
-        msg->XOR = phev_core_getMessageXOR(message);
-
-        msg_utils_destroyMsg(message);
 
         return 1;
     }
@@ -685,9 +865,15 @@ phevMessage_t *phev_core_pingMessage(const uint8_t number)
 
     return phev_core_requestMessage(PING_SEND_CMD_MY18, number, &data, 1);
 }
+uint8_t phev_core_ackCommand(const uint8_t command)
+{
+    const phevCommandInfo_t *info = &phev_core_commands[command];
+
+    return (info->flags ? info->ack : ((command & 0xf) << 4) | ((command & 0xf0) >> 4));
+}
 phevMessage_t *phev_core_responseHandler(phevMessage_t *message)
 {
-    uint8_t command = ((message->command & 0xf) << 4) | ((message->command & 0xf0) >> 4);
+    uint8_t command = phev_core_ackCommand(message->command);
     phevMessage_t *response = phev_core_ackMessage(command, message->reg);
     response->XOR = message->XOR;
     return response;
@@ -730,10 +916,8 @@ uint8_t *phev_core_xorDataOutbound(const uint8_t *data, uint8_t xor)
 
     uint8_t *decoded = malloc(length);
 
-    for (int i = 0; i < length; i++)
-    {
-        decoded[i] = data[i] ^ xor;
-    }
+    phev_simd_xor(decoded, data, length, xor);
+
     return decoded;
 }
 message_t *phev_core_XOROutboundMessage(const message_t *message, const uint8_t xor)
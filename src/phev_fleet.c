@@ -0,0 +1,623 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include "phev_fleet.h"
+#include "logger.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+const static char *APP_TAG = "PHEV_FLEET";
+
+static uint64_t phev_fleet_threadTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+static phev_pipe_ctx_t *phev_fleet_pipe(const phevFleetSession_t *session)
+{
+    return session->phev->serviceCtx->pipe;
+}
+static phevFleetSession_t *phev_fleet_findSession(phevFleet_t *fleet, const phevCtx_t *phev)
+{
+    for (size_t i = 0; i < fleet->capacity; i++)
+    {
+        if (fleet->sessions[i].used && fleet->sessions[i].phev == phev)
+        {
+            return &fleet->sessions[i];
+        }
+    }
+    return NULL;
+}
+static void phev_fleet_wake(phevFleet_t *fleet)
+{
+    uint64_t one = 1;
+
+    if (write(fleet->wakeFd, &one, sizeof(one)) < 0)
+    {
+        LOG_E(APP_TAG, "Cannot wake dispatcher errno %d", errno);
+    }
+}
+// One shot so a socket is reported once until the worker has finished with the session and re-arms it. A connecting
+// socket is ready once it is writable.
+static int phev_fleet_arm(phevFleet_t *fleet, phevFleetSession_t *session, int op)
+{
+    struct epoll_event event = {
+        .events = (session->connecting ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT,
+        .data.ptr = session,
+    };
+
+    if (epoll_ctl(fleet->epoll, op, session->fd, &event) < 0)
+    {
+        LOG_E(APP_TAG, "Cannot watch socket %d errno %d", session->fd, errno);
+        return -1;
+    }
+    return 0;
+}
+static int phev_fleet_watch(phevFleet_t *fleet, phevFleetSession_t *session, int fd, bool connecting)
+{
+    if (session->fd >= 0)
+    {
+        epoll_ctl(fleet->epoll, EPOLL_CTL_DEL, session->fd, NULL);
+        session->fd = -1;
+    }
+    session->connecting = false;
+    if (fd < 0)
+    {
+        return 0;
+    }
+    session->fd = fd;
+    session->connecting = connecting;
+    if (phev_fleet_arm(fleet, session, EPOLL_CTL_ADD) < 0)
+    {
+        session->fd = -1;
+        session->connecting = false;
+        return -1;
+    }
+    return 0;
+}
+// A pipe that has dropped its connection or has submitted commands needs stepping straight away
+static bool phev_fleet_needsStep(phev_pipe_ctx_t *pipe)
+{
+    if (phev_pipe_commandsPending(pipe))
+    {
+        return true;
+    }
+    return !(pipe->pipe->in->connected && pipe->pipe->out->connected) && !phev_timer_active(&pipe->reconnectTimer);
+}
+static void phev_fleet_push(phevFleetWorker_t *worker, size_t index)
+{
+    const size_t capacity = worker->fleet->capacity;
+
+    pthread_mutex_lock(&worker->lock);
+    worker->queue[(worker->head + worker->count) % capacity] = index;
+    worker->count++;
+    pthread_mutex_unlock(&worker->lock);
+}
+// The owner takes its newest work, thieves take the oldest from the other end
+static bool phev_fleet_pop(phevFleetWorker_t *worker, bool steal, size_t *index)
+{
+    const size_t capacity = worker->fleet->capacity;
+    bool found = false;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->count > 0)
+    {
+        if (steal)
+        {
+            *index = worker->queue[worker->head];
+            worker->head = (worker->head + 1) % capacity;
+        }
+        else
+        {
+            *index = worker->queue[(worker->head + worker->count - 1) % capacity];
+        }
+        worker->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return found;
+}
+// Called with the fleet lock held
+static void phev_fleet_schedule(phevFleet_t *fleet, phevFleetSession_t *session, bool readable)
+{
+    session->scheduled = true;
+    session->readable = readable;
+    atomic_fetch_add(&fleet->pending, 1);
+    phev_fleet_push(&fleet->workers[session->worker], (size_t) (session - fleet->sessions));
+}
+static bool phev_fleet_take(phevFleetWorker_t *worker, size_t *index)
+{
+    phevFleet_t *fleet = worker->fleet;
+
+    if (phev_fleet_pop(worker, false, index))
+    {
+        return true;
+    }
+    for (size_t i = 1; i < fleet->numberOfWorkers; i++)
+    {
+        if (phev_fleet_pop(&fleet->workers[(worker->index + i) % fleet->numberOfWorkers], true, index))
+        {
+            worker->steals++;
+            return true;
+        }
+    }
+    return false;
+}
+static void phev_fleet_run(phevFleetWorker_t *worker, phevFleetSession_t *session)
+{
+    phevFleet_t *fleet = worker->fleet;
+    uint64_t start = phev_fleet_threadTime();
+
+    phev_pipe_step(phev_fleet_pipe(session), session->readable);
+
+    uint64_t elapsed = phev_fleet_threadTime() - start;
+
+    worker->steps++;
+
+    pthread_mutex_lock(&fleet->lock);
+    session->cpuTime += elapsed;
+    session->steps++;
+    session->scheduled = false;
+
+    // The pipe may have reconnected during the step, a new socket can reuse the old number so the connection count
+    // tells them apart
+    phev_pipe_ctx_t *pipe = phev_fleet_pipe(session);
+    int fd = phev_pipe_socket(pipe);
+    bool connecting = false;
+
+    if (fd != PHEV_PIPE_SOCKET_UNKNOWN && fd < 0)
+    {
+        fd = phev_pipe_connectingSocket(pipe);
+        connecting = (fd >= 0);
+    }
+    if (fd != PHEV_PIPE_SOCKET_UNKNOWN && (fd != session->fd || connecting != session->connecting || session->connections != pipe->connections))
+    {
+        LOG_D(APP_TAG, "Session %p socket now %d%s", (void *) session->phev, fd, (connecting ? " connecting" : ""));
+        session->connections = pipe->connections;
+        phev_fleet_watch(fleet, session, fd, connecting);
+    }
+    else if (session->fd >= 0 && phev_fleet_arm(fleet, session, EPOLL_CTL_MOD) < 0)
+    {
+        // The client closed its socket, the reconnect timer takes over until a new one is set
+        session->fd = -1;
+        session->connecting = false;
+    }
+    pthread_cond_broadcast(&fleet->idle);
+    pthread_mutex_unlock(&fleet->lock);
+
+    // Its timers may have moved so the dispatcher needs to recalculate its timeout
+    phev_fleet_wake(fleet);
+}
+static void *phev_fleet_worker(void *arg)
+{
+    phevFleetWorker_t *worker = (phevFleetWorker_t *) arg;
+    phevFleet_t *fleet = worker->fleet;
+
+    LOG_D(APP_TAG, "Worker %zu started", worker->index);
+
+    for (;;)
+    {
+        size_t index;
+
+        if (phev_fleet_take(worker, &index))
+        {
+            atomic_fetch_sub(&fleet->pending, 1);
+            phev_fleet_run(worker, &fleet->sessions[index]);
+            continue;
+        }
+
+        pthread_mutex_lock(&fleet->lock);
+        while (fleet->running && atomic_load(&fleet->pending) == 0)
+        {
+            pthread_cond_wait(&fleet->ready, &fleet->lock);
+        }
+        bool running = fleet->running;
+        pthread_mutex_unlock(&fleet->lock);
+
+        if (!running)
+        {
+            break;
+        }
+    }
+
+    LOG_D(APP_TAG, "Worker %zu stopped after %llu steps %llu steals", worker->index, (unsigned long long) worker->steps, (unsigned long long) worker->steals);
+
+    return NULL;
+}
+// Called with the fleet lock held
+static uint64_t phev_fleet_nextTimeout(phevFleet_t *fleet)
+{
+    uint64_t next = PHEV_TIMER_NEVER;
+
+    for (size_t i = 0; i < fleet->capacity; i++)
+    {
+        phevFleetSession_t *session = &fleet->sessions[i];
+
+        if (!session->used || session->scheduled)
+        {
+            continue;
+        }
+        if (phev_fleet_needsStep(phev_fleet_pipe(session)))
+        {
+            return 0;
+        }
+
+        uint64_t timeout = phev_pipe_nextTimeout(phev_fleet_pipe(session));
+
+        if (timeout < next)
+        {
+            next = timeout;
+        }
+    }
+    return next;
+}
+static void *phev_fleet_dispatcher(void *arg)
+{
+    phevFleet_t *fleet = (phevFleet_t *) arg;
+    struct epoll_event events[PHEV_FLEET_MAX_EVENTS];
+
+    for (;;)
+    {
+        pthread_mutex_lock(&fleet->lock);
+        if (!fleet->running)
+        {
+            pthread_mutex_unlock(&fleet->lock);
+            break;
+        }
+        uint64_t timeout = phev_fleet_nextTimeout(fleet);
+        pthread_mutex_unlock(&fleet->lock);
+
+        if (timeout > PHEV_FLEET_MAX_WAIT)
+        {
+            timeout = PHEV_FLEET_MAX_WAIT;
+        }
+
+        int ready = epoll_wait(fleet->epoll, events, PHEV_FLEET_MAX_EVENTS, (int) timeout);
+
+        if (ready < 0)
+        {
+            if (errno != EINTR)
+            {
+                LOG_E(APP_TAG, "epoll_wait failed errno %d", errno);
+            }
+            ready = 0;
+        }
+
+        size_t scheduled = 0;
+
+        pthread_mutex_lock(&fleet->lock);
+        for (int i = 0; i < ready; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                uint64_t count;
+
+                if (read(fleet->wakeFd, &count, sizeof(count)) < 0)
+                {
+                    LOG_E(APP_TAG, "Cannot clear wake up errno %d", errno);
+                }
+                continue;
+            }
+
+            phevFleetSession_t *session = (phevFleetSession_t *) events[i].data.ptr;
+
+            if (session->used && !session->scheduled)
+            {
+                phev_fleet_schedule(fleet, session, true);
+                scheduled++;
+            }
+        }
+
+        uint64_t now = phev_timer_now();
+
+        for (size_t i = 0; i < fleet->capacity; i++)
+        {
+            phevFleetSession_t *session = &fleet->sessions[i];
+
+            if (!session->used || session->scheduled)
+            {
+                continue;
+            }
+
+            phev_pipe_ctx_t *pipe = phev_fleet_pipe(session);
+
+            if (phev_timer_nextDeadline(&pipe->timers) <= now || phev_fleet_needsStep(pipe))
+            {
+                phev_fleet_schedule(fleet, session, false);
+                scheduled++;
+            }
+        }
+        if (scheduled > 0)
+        {
+            pthread_cond_broadcast(&fleet->ready);
+        }
+        pthread_mutex_unlock(&fleet->lock);
+    }
+
+    return NULL;
+}
+phevFleet_t *phev_fleet_create(size_t capacity, size_t workers)
+{
+    LOG_V(APP_TAG, "START - create");
+
+    if (capacity == 0 || workers == 0)
+    {
+        LOG_E(APP_TAG, "Fleet needs at least one session and one worker");
+        return NULL;
+    }
+
+    phevFleet_t *fleet = calloc(1, sizeof(phevFleet_t));
+
+    fleet->sessions = calloc(capacity, sizeof(phevFleetSession_t));
+    fleet->workers = calloc(workers, sizeof(phevFleetWorker_t));
+    fleet->epoll = epoll_create1(EPOLL_CLOEXEC);
+    fleet->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (fleet->sessions == NULL || fleet->workers == NULL || fleet->epoll < 0 || fleet->wakeFd < 0)
+    {
+        LOG_E(APP_TAG, "Cannot create fleet errno %d", errno);
+        if (fleet->epoll >= 0)
+        {
+            close(fleet->epoll);
+        }
+        if (fleet->wakeFd >= 0)
+        {
+            close(fleet->wakeFd);
+        }
+        free(fleet->sessions);
+        free(fleet->workers);
+        free(fleet);
+        return NULL;
+    }
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = NULL,
+    };
+
+    epoll_ctl(fleet->epoll, EPOLL_CTL_ADD, fleet->wakeFd, &event);
+
+    for (size_t i = 0; i < capacity; i++)
+    {
+        fleet->sessions[i].fd = -1;
+    }
+    for (size_t i = 0; i < workers; i++)
+    {
+        fleet->workers[i].fleet = fleet;
+        fleet->workers[i].index = i;
+        fleet->workers[i].queue = malloc(capacity * sizeof(size_t));
+        pthread_mutex_init(&fleet->workers[i].lock, NULL);
+    }
+    fleet->capacity = capacity;
+    fleet->numberOfWorkers = workers;
+    pthread_mutex_init(&fleet->lock, NULL);
+    pthread_cond_init(&fleet->ready, NULL);
+    pthread_cond_init(&fleet->idle, NULL);
+    atomic_init(&fleet->pending, 0);
+
+    LOG_V(APP_TAG, "END - create");
+
+    return fleet;
+}
+void phev_fleet_destroy(phevFleet_t *fleet)
+{
+    if (fleet == NULL)
+    {
+        return;
+    }
+    phev_fleet_stop(fleet);
+
+    for (size_t i = 0; i < fleet->numberOfWorkers; i++)
+    {
+        pthread_mutex_destroy(&fleet->workers[i].lock);
+        free(fleet->workers[i].queue);
+    }
+    pthread_cond_destroy(&fleet->idle);
+    pthread_cond_destroy(&fleet->ready);
+    pthread_mutex_destroy(&fleet->lock);
+    close(fleet->wakeFd);
+    close(fleet->epoll);
+    free(fleet->workers);
+    free(fleet->sessions);
+    free(fleet);
+}
+int phev_fleet_add(phevFleet_t *fleet, phevCtx_t *phev, int fd)
+{
+    LOG_V(APP_TAG, "START - add");
+
+    int ret = -1;
+
+    pthread_mutex_lock(&fleet->lock);
+
+    if (phev_fleet_findSession(fleet, phev) != NULL)
+    {
+        LOG_E(APP_TAG, "Session already added");
+    }
+    else
+    {
+        for (size_t i = 0; i < fleet->capacity; i++)
+        {
+            phevFleetSession_t *session = &fleet->sessions[i];
+
+            if (session->used)
+            {
+                continue;
+            }
+            session->fd = -1;
+            if (phev_fleet_watch(fleet, session, fd, false) == 0)
+            {
+                session->phev = phev;
+                session->connections = phev->serviceCtx->pipe->connections;
+                session->worker = i % fleet->numberOfWorkers;
+                session->scheduled = false;
+                session->cpuTime = 0;
+                session->steps = 0;
+                session->used = true;
+                fleet->numberOfSessions++;
+                ret = 0;
+            }
+            break;
+        }
+        if (ret < 0 && fleet->numberOfSessions == fleet->capacity)
+        {
+            LOG_E(APP_TAG, "No free sessions, capacity %zu", fleet->capacity);
+        }
+    }
+
+    pthread_mutex_unlock(&fleet->lock);
+
+    if (ret == 0)
+    {
+        phev_fleet_wake(fleet);
+    }
+
+    LOG_V(APP_TAG, "END - add");
+
+    return ret;
+}
+int phev_fleet_setSocket(phevFleet_t *fleet, phevCtx_t *phev, int fd)
+{
+    int ret = -1;
+
+    pthread_mutex_lock(&fleet->lock);
+
+    phevFleetSession_t *session = phev_fleet_findSession(fleet, phev);
+
+    if (session == NULL)
+    {
+        LOG_E(APP_TAG, "Session not found");
+    }
+    else
+    {
+        ret = phev_fleet_watch(fleet, session, fd, false);
+    }
+
+    pthread_mutex_unlock(&fleet->lock);
+
+    return ret;
+}
+int phev_fleet_remove(phevFleet_t *fleet, phevCtx_t *phev)
+{
+    int ret = -1;
+
+    pthread_mutex_lock(&fleet->lock);
+
+    phevFleetSession_t *session = phev_fleet_findSession(fleet, phev);
+
+    if (session == NULL)
+    {
+        LOG_E(APP_TAG, "Session not found");
+    }
+    else
+    {
+        while (session->scheduled && fleet->running)
+        {
+            pthread_cond_wait(&fleet->idle, &fleet->lock);
+        }
+        phev_fleet_watch(fleet, session, -1, false);
+        phev_pipe_abortConnect(phev_fleet_pipe(session));
+        session->used = false;
+        session->phev = NULL;
+        fleet->numberOfSessions--;
+        ret = 0;
+    }
+
+    pthread_mutex_unlock(&fleet->lock);
+
+    return ret;
+}
+int phev_fleet_start(phevFleet_t *fleet)
+{
+    LOG_V(APP_TAG, "START - start");
+
+    pthread_mutex_lock(&fleet->lock);
+    if (fleet->running)
+    {
+        pthread_mutex_unlock(&fleet->lock);
+        return -1;
+    }
+    fleet->running = true;
+    pthread_mutex_unlock(&fleet->lock);
+
+    for (size_t i = 0; i < fleet->numberOfWorkers; i++)
+    {
+        if (pthread_create(&fleet->workers[i].thread, NULL, phev_fleet_worker, &fleet->workers[i]) != 0)
+        {
+            LOG_E(APP_TAG, "Cannot start worker %zu", i);
+            return -1;
+        }
+    }
+    if (pthread_create(&fleet->dispatcher, NULL, phev_fleet_dispatcher, fleet) != 0)
+    {
+        LOG_E(APP_TAG, "Cannot start dispatcher");
+        return -1;
+    }
+
+    LOG_V(APP_TAG, "END - start");
+
+    return 0;
+}
+void phev_fleet_stop(phevFleet_t *fleet)
+{
+    pthread_mutex_lock(&fleet->lock);
+    if (!fleet->running)
+    {
+        pthread_mutex_unlock(&fleet->lock);
+        return;
+    }
+    fleet->running = false;
+    pthread_cond_broadcast(&fleet->ready);
+    pthread_cond_broadcast(&fleet->idle);
+    pthread_mutex_unlock(&fleet->lock);
+
+    phev_fleet_wake(fleet);
+
+    pthread_join(fleet->dispatcher, NULL);
+    for (size_t i = 0; i < fleet->numberOfWorkers; i++)
+    {
+        pthread_join(fleet->workers[i].thread, NULL);
+    }
+
+    // Anything still queued is dropped so the sessions can be scheduled again on the next start
+    for (size_t i = 0; i < fleet->numberOfWorkers; i++)
+    {
+        fleet->workers[i].head = 0;
+        fleet->workers[i].count = 0;
+    }
+    for (size_t i = 0; i < fleet->capacity; i++)
+    {
+        fleet->sessions[i].scheduled = false;
+        if (fleet->sessions[i].used && fleet->sessions[i].fd >= 0)
+        {
+            phev_fleet_arm(fleet, &fleet->sessions[i], EPOLL_CTL_MOD);
+        }
+    }
+    atomic_store(&fleet->pending, 0);
+}
+int phev_fleet_sessionStats(phevFleet_t *fleet, const phevCtx_t *phev, phevFleetSessionStats_t *stats)
+{
+    int ret = -1;
+
+    pthread_mutex_lock(&fleet->lock);
+
+    phevFleetSession_t *session = phev_fleet_findSession(fleet, phev);
+
+    if (session != NULL)
+    {
+        stats->cpuTime = session->cpuTime;
+        stats->steps = session->steps;
+        ret = 0;
+    }
+
+    pthread_mutex_unlock(&fleet->lock);
+
+    return ret;
+}
+#endif
@@ -1,30 +1,151 @@
 #include <stdlib.h>
 #include "phev_model.h"
+#include "phev_timer.h"
 #include "logger.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__XTENSA__)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <sched.h>
+#endif
+
+// Spins a reader makes on a write in progress before giving up the cpu
+#define PHEV_MODEL_READ_SPINS 64
+
 const static char * TAG = "PHEV_MODEL";
 
 phevModel_t * phev_model_create(void)
 {
     LOG_V(TAG, "START - create");
-    phevModel_t * model = malloc(sizeof(phevModel_t));
+    phevModel_t * model = calloc(1, sizeof(phevModel_t));
 
-    for(int i=0;i<256;i++)
+    if(model == NULL)
     {
-        model->registers[i] = NULL;
+        LOG_E(TAG,"Cannot allocate memory for model");
+        return NULL;
     }
+    atomic_init(&model->sequence, 0);
+    pthread_mutex_init(&model->writeLock, NULL);
     LOG_I(TAG,"Model created and initialised");
     LOG_V(TAG, "END - createModel");
     return model;
 }
 
+// Only called holding writeLock, which also keeps the slot comparisons writers make before they begin consistent
+static void phev_model_writeBegin(phevModel_t * model)
+{
+    atomic_fetch_add_explicit(&model->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+static void phev_model_writeEnd(phevModel_t * model)
+{
+    atomic_fetch_add_explicit(&model->sequence, 1, memory_order_release);
+}
+static void phev_model_yield(void)
+{
+#if defined(_WIN32)
+    SwitchToThread();
+#elif defined(__XTENSA__)
+    // A delay of 0 only yields to tasks of the same priority, one tick lets a lower priority writer finish
+    vTaskDelay(1);
+#else
+    sched_yield();
+#endif
+}
+static unsigned phev_model_readBegin(const phevModel_t * model)
+{
+    unsigned sequence;
+    unsigned spins = 0;
+
+    while((sequence = atomic_load_explicit(&((phevModel_t *) model)->sequence, memory_order_acquire)) & 1)
+    {
+        // A write is in progress, it only ever covers a few copies unless the writer is not running
+        if(++spins >= PHEV_MODEL_READ_SPINS)
+        {
+            spins = 0;
+            phev_model_yield();
+        }
+    }
+    return sequence;
+}
+static int phev_model_readRetry(const phevModel_t * model, unsigned sequence)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&((phevModel_t *) model)->sequence, memory_order_relaxed) != sequence;
+}
+static void phev_model_appendHistory(phevRegisterHistory_t * history, const uint8_t * data, size_t length, uint64_t time)
+{
+    size_t last = (history->head + PHEV_MODEL_HISTORY_SIZE - 1) % PHEV_MODEL_HISTORY_SIZE;
+
+    // Keep the ring in time order so ranges can be found by bisection
+    if(history->count > 0 && time < history->entries[last].time)
+    {
+        time = history->entries[last].time;
+    }
+
+    phevRegisterHistoryEntry_t * entry = &history->entries[history->head];
+
+    entry->time = time;
+    entry->length = length;
+    memcpy(entry->data,data,length);
+
+    history->head = (history->head + 1) % PHEV_MODEL_HISTORY_SIZE;
+    if(history->count < history->capacity)
+    {
+        history->count++;
+    }
+}
+// The i'th oldest of count entries, only ever indexes the ring even when a reader sees it part way through a change
+static const phevRegisterHistoryEntry_t * phev_model_historyEntry(const phevRegisterHistory_t * history, size_t count, size_t i)
+{
+    return &history->entries[(history->head % PHEV_MODEL_HISTORY_SIZE + PHEV_MODEL_HISTORY_SIZE - count + i) % PHEV_MODEL_HISTORY_SIZE];
+}
+static size_t phev_model_historyCount(const phevRegisterHistory_t * history)
+{
+    if(history == NULL)
+    {
+        return 0;
+    }
+    size_t count = history->count;
+
+    return (count < PHEV_MODEL_HISTORY_SIZE ? count : PHEV_MODEL_HISTORY_SIZE);
+}
 int phev_model_setRegister(phevModel_t * model, uint8_t reg, const uint8_t * data, size_t length)
+{
+    return phev_model_setRegisterAt(model, reg, data, length, phev_timer_now());
+}
+int phev_model_setRegisterAt(phevModel_t * model, uint8_t reg, const uint8_t * data, size_t length, uint64_t time)
 {
     LOG_V(TAG, "START - setRegister");
-    phevRegister_t * out = malloc(sizeof(phevRegister_t) + length);
+
+    if(length > PHEV_MODEL_REGISTER_SIZE)
+    {
+        LOG_E(TAG,"Register %02X length %zu is bigger than %d",reg,length,PHEV_MODEL_REGISTER_SIZE);
+        return 0;
+    }
+
+    phevRegister_t * out = &model->registers[reg];
+
+    pthread_mutex_lock(&model->writeLock);
+    if(model->versions[reg] != 0 && out->length == length && memcmp(out->data,data,length) == 0)
+    {
+        pthread_mutex_unlock(&model->writeLock);
+        LOG_V(TAG, "END - setRegister");
+        return 1;
+    }
+    phev_model_writeBegin(model);
     out->length = length;
     memcpy(out->data,data,length);
-    model->registers[reg] = out;
+    model->versions[reg] = ++model->version;
+    if(model->histories[reg] && model->histories[reg]->capacity > 0)
+    {
+        phev_model_appendHistory(model->histories[reg],data,length,time);
+    }
+    phev_model_writeEnd(model);
+    pthread_mutex_unlock(&model->writeLock);
     LOG_V(TAG, "END - setRegister");
     return 1;
 }
@@ -35,25 +156,25 @@ phevRegister_t * phev_model_getRegister(phevModel_t * model, uint8_t reg)
     LOG_V(TAG, "START - getRegister");
     if(model)
     {
-        phevRegister_t * out = model->registers[reg];
-        if(out == NULL)
+        phevRegister_t out;
+        if(!phev_model_readRegister(model,reg,&out))
         {
             LOG_D(TAG,"Register %d is not set",reg);
             goto phev_model_getRegister_end;
         } else {
-            if(out->length == 0)
+            if(out.length == 0)
             {
                 LOG_D(TAG,"Register data length is zero");
                 goto phev_model_getRegister_end;
             } else {
-                ret = malloc(sizeof(phevRegister_t) + out->length);
+                ret = malloc(sizeof(phevRegister_t));
                 if(ret)
                 {
-                    memcpy(ret, out, sizeof(phevRegister_t) + out->length);
+                    *ret = out;
                 }
                 else
                 {
-                    LOG_E(TAG,"Cannot allocate memory for register - length %zu",out->length);
+                    LOG_E(TAG,"Cannot allocate memory for register - length %zu",out.length);
                 }
                goto phev_model_getRegister_end;
             }
@@ -67,12 +188,99 @@ phev_model_getRegister_end:
     
     return ret;
 }
+const phevRegister_t * phev_model_peekRegister(const phevModel_t * model, uint8_t reg)
+{
+    if(model == NULL || model->versions[reg] == 0 || model->registers[reg].length == 0)
+    {
+        return NULL;
+    }
+    return &model->registers[reg];
+}
+int phev_model_readRegister(const phevModel_t * model, uint8_t reg, phevRegister_t * out)
+{
+    return (phev_model_snapshotRegisters(model, &reg, 1, out) != 0);
+}
+uint32_t phev_model_snapshotRegisters(const phevModel_t * model, const uint8_t * regs, size_t count, phevRegister_t * out)
+{
+    uint32_t version;
+    unsigned sequence;
+
+    if(model == NULL)
+    {
+        memset(out, 0, count * sizeof(phevRegister_t));
+        return 0;
+    }
+    do
+    {
+        sequence = phev_model_readBegin(model);
+        version = 0;
+        for(size_t i = 0; i < count; i++)
+        {
+            uint32_t registerVersion = model->versions[regs[i]];
+
+            out[i] = model->registers[regs[i]];
+            if(registerVersion == 0)
+            {
+                out[i].length = 0;
+            }
+            if(registerVersion > version)
+            {
+                version = registerVersion;
+            }
+        }
+    } while(phev_model_readRetry(model, sequence));
+
+    return version;
+}
+uint32_t phev_model_registerVersion(const phevModel_t * model, uint8_t reg)
+{
+    uint32_t version;
+    unsigned sequence;
+
+    if(model == NULL)
+    {
+        return 0;
+    }
+    do
+    {
+        sequence = phev_model_readBegin(model);
+        version = model->versions[reg];
+    } while(phev_model_readRetry(model, sequence));
+
+    return version;
+}
+int phev_model_compareRegisterData(const phevModel_t * model, uint8_t reg, const uint8_t * data, size_t length)
+{
+    int ret;
+    unsigned sequence;
+
+    if(model == NULL || data == NULL)
+    {
+        return -1;
+    }
+    // Compared in place under the sequence lock as the register can be set from another thread
+    do
+    {
+        sequence = phev_model_readBegin(model);
+
+        const phevRegister_t * out = &model->registers[reg];
+
+        if(model->versions[reg] == 0 || length == 0 || out->length != length || length > PHEV_MODEL_REGISTER_SIZE)
+        {
+            ret = -1;
+        } else {
+            ret = memcmp(data,out->data,length);
+        }
+    } while(phev_model_readRetry(model, sequence));
+
+    return ret;
+}
 int phev_model_compareRegister(phevModel_t * model, uint8_t reg , const uint8_t * data)
 {
     LOG_V(TAG, "START - compareRegister");
     if(model)
     {
-        phevRegister_t * out = phev_model_getRegister(model,reg);
+        const phevRegister_t * out = phev_model_peekRegister(model,reg);
         
         if(out && data)
         {
@@ -98,3 +306,115 @@ int phev_model_compareRegister(phevModel_t * model, uint8_t reg , const uint8_t
     LOG_V(TAG, "END - compareRegister");
     
 }
+int phev_model_enableHistory(phevModel_t * model, uint8_t reg, size_t capacity)
+{
+    LOG_V(TAG, "START - enableHistory");
+
+    if(capacity > PHEV_MODEL_HISTORY_SIZE)
+    {
+        LOG_E(TAG,"Cannot keep %zu entries of history for register %02X, at most %d",capacity,reg,PHEV_MODEL_HISTORY_SIZE);
+        return 0;
+    }
+
+    pthread_mutex_lock(&model->writeLock);
+
+    phevRegisterHistory_t * history = model->histories[reg];
+
+    if(history == NULL && capacity > 0)
+    {
+        history = calloc(1, sizeof(phevRegisterHistory_t));
+        if(history == NULL)
+        {
+            pthread_mutex_unlock(&model->writeLock);
+            LOG_E(TAG,"Cannot allocate history for register %02X",reg);
+            return 0;
+        }
+    }
+    if(history)
+    {
+        phev_model_writeBegin(model);
+        history->capacity = capacity;
+        history->head = 0;
+        history->count = 0;
+        model->histories[reg] = history;
+        phev_model_writeEnd(model);
+    }
+    pthread_mutex_unlock(&model->writeLock);
+
+    LOG_V(TAG, "END - enableHistory");
+    return 1;
+}
+size_t phev_model_historyLatest(const phevModel_t * model, uint8_t reg, phevRegisterHistoryEntry_t * out, size_t max)
+{
+    size_t n;
+    unsigned sequence;
+
+    if(model == NULL)
+    {
+        return 0;
+    }
+    do
+    {
+        sequence = phev_model_readBegin(model);
+
+        const phevRegisterHistory_t * history = model->histories[reg];
+
+        const size_t count = phev_model_historyCount(history);
+
+        n = (max < count ? max : count);
+        for(size_t i = 0; i < n; i++)
+        {
+            out[i] = *phev_model_historyEntry(history, count, count - 1 - i);
+        }
+    } while(phev_model_readRetry(model, sequence));
+
+    return n;
+}
+size_t phev_model_historyRange(const phevModel_t * model, uint8_t reg, uint64_t from, uint64_t to, phevRegisterHistoryEntry_t * out, size_t max)
+{
+    size_t n;
+    unsigned sequence;
+
+    if(model == NULL || from > to)
+    {
+        return 0;
+    }
+    do
+    {
+        sequence = phev_model_readBegin(model);
+
+        const phevRegisterHistory_t * history = model->histories[reg];
+
+        const size_t count = phev_model_historyCount(history);
+
+        n = 0;
+
+        size_t low = 0;
+        size_t high = count;
+
+        while(low < high)
+        {
+            size_t mid = low + (high - low) / 2;
+
+            if(phev_model_historyEntry(history, count, mid)->time < from)
+            {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        for(size_t i = low; i < count && n < max; i++)
+        {
+            const phevRegisterHistoryEntry_t * entry = phev_model_historyEntry(history, count, i);
+
+            if(entry->time > to)
+            {
+                break;
+            }
+            out[n++] = *entry;
+        }
+    } while(phev_model_readRetry(model, sequence));
+
+    return n;
+}
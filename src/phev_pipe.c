@@ -13,11 +13,12 @@ const static char *APP_TAG = "PHEV_PIPE";
 void phev_pipe_resetPing(phev_pipe_ctx_t *ctx)
 {
     LOG_V(APP_TAG, "START - resetPing");
-    time_t now;
 
-    time(&now);
     ctx->currentPing = 1;
-    ctx->lastPingTime = now;
+    ctx->ping.interval = PHEV_PIPE_PING_INTERVAL;
+    ctx->ping.lastSequence = -1;
+    memset(ctx->ping.sentAt, 0, sizeof(ctx->ping.sentAt));
+    phev_timer_start(&ctx->timers, &ctx->pingTimer, ctx->ping.interval);
     LOG_V(APP_TAG, "END - resetPing");
 }
 
@@ -47,9 +48,12 @@ void phev_pipe_disconnectOutput(phev_pipe_ctx_t *ctx)
     LOG_V(APP_TAG,"START - disconnectOutput");
 
     msg_pipe_out_disconnect(ctx->pipe);
+    phev_pipe_abortConnect(ctx);
 
     ctx->connected = false;
 
+    phev_pipe_failPendingUpdates(ctx);
+
     phev_pipe_resetPing(ctx);
 
     ctx->currentXOR = 0;
@@ -58,13 +62,65 @@ void phev_pipe_disconnectOutput(phev_pipe_ctx_t *ctx)
     ctx->encrypt = false;
     ctx->pingResponse = 0;
 
+    phev_core_streamParserInit(&ctx->stream);
+    phev_core_initXORPredictor(&ctx->xorPredictor);
+
     LOG_V(APP_TAG,"END - disconnectOutput");
 }
-void phev_pipe_waitForConnection(phev_pipe_ctx_t *ctx)
+// Exponential backoff with equal jitter, half the delay is fixed and the rest random so a fleet that lost its cars at
+// the same moment does not retry in lockstep
+uint64_t phev_pipe_connectBackoff(phev_pipe_ctx_t *ctx)
 {
-    LOG_V(APP_TAG, "START - waitForConnection");
-    ctx->connected = false;
-    int retries = 0;
+    uint32_t shift = (ctx->connectAttempts < 16 ? ctx->connectAttempts : 16);
+    uint64_t delay = (uint64_t) PHEV_CONNECT_WAIT_TIME << shift;
+
+    if (delay > PHEV_CONNECT_MAX_BACKOFF)
+    {
+        delay = PHEV_CONNECT_MAX_BACKOFF;
+    }
+
+    // xorshift32, each pipe has its own state so sessions on other threads never share a generator
+    uint32_t x = ctx->connectSeed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ctx->connectSeed = x;
+
+    uint64_t half = delay / 2;
+
+    return delay - half + (half > 0 ? x % (half + 1) : 0);
+}
+static void phev_pipe_connectionEstablished(phev_pipe_ctx_t *ctx)
+{
+    ctx->connected = true;
+    ctx->connectAttempts = 0;
+
+    if (ctx->startPending)
+    {
+        LOG_I(APP_TAG, "Connected sending deferred start");
+        ctx->startPending = false;
+        phev_pipe_sendMac(ctx, ctx->startMac);
+        phev_pipe_updateRegister(ctx, KO_WF_EV_UPDATE_SP, 3);
+    }
+}
+static void phev_pipe_connectOut(phev_pipe_ctx_t *ctx)
+{
+    if (ctx->connectHandler == NULL)
+    {
+        msg_pipe_out_connect(ctx->pipe);
+    }
+    else if (ctx->connectHandler(ctx->pipe->out, &ctx->connect) == 0)
+    {
+        ctx->pipe->out->connected = 1;
+    }
+    if (ctx->pipe->out->connected)
+    {
+        ctx->connections++;
+    }
+}
+static void phev_pipe_reconnect(phev_pipe_ctx_t *ctx)
+{
+    LOG_V(APP_TAG, "START - reconnect");
 
     if (!ctx->pipe->in->connected)
     {
@@ -74,57 +130,181 @@ void phev_pipe_waitForConnection(phev_pipe_ctx_t *ctx)
     if (!ctx->pipe->out->connected)
     {
         LOG_V(APP_TAG, "Calling out connect");
-        msg_pipe_out_connect(ctx->pipe);
+        phev_pipe_connectOut(ctx);
     }
-    while (!(ctx->pipe->in->connected && ctx->pipe->out->connected))
+
+    if (ctx->pipe->in->connected && ctx->pipe->out->connected)
     {
-        LOG_I(APP_TAG, "Not connected waiting...");
-        SLEEP(PHEV_CONNECT_WAIT_TIME);
-        if (retries > PHEV_CONNECT_MAX_RETRIES)
+        phev_pipe_connectionEstablished(ctx);
+    }
+    else if (ctx->connect.soc >= 0)
+    {
+        // Still connecting, whoever waits on the connecting socket steps the pipe when it is writable so the timer is
+        // only there to give up on it
+        ctx->connected = false;
+        phev_timer_startAt(&ctx->timers, &ctx->reconnectTimer, ctx->connect.started + PHEV_TCP_CONNECT_TIMEOUT);
+    }
+    else
+    {
+        uint64_t delay = phev_pipe_connectBackoff(ctx);
+
+        ctx->connected = false;
+        ctx->connectAttempts++;
+
+        LOG_I(APP_TAG, "Not connected attempt %u retrying in %llums", ctx->connectAttempts, (unsigned long long) delay);
+        phev_timer_startAt(&ctx->timers, &ctx->reconnectTimer, phev_timer_now() + delay);
+    }
+
+    LOG_V(APP_TAG, "END - reconnect");
+}
+void phev_pipe_waitForConnection(phev_pipe_ctx_t *ctx)
+{
+    LOG_V(APP_TAG, "START - waitForConnection");
+
+    uint32_t attempts = ctx->connectAttempts;
+
+    phev_pipe_reconnect(ctx);
+
+    while (!ctx->connected)
+    {
+        if (ctx->connectAttempts - attempts > PHEV_CONNECT_MAX_RETRIES)
         {
             LOG_E(APP_TAG, "Max retries reached");
             return;
         }
+        LOG_I(APP_TAG, "Not connected waiting...");
+
+        // Only sleeps until the reconnect timer is due, the backoff lives in the timer
+        SLEEP(phev_pipe_nextTimeout(ctx));
+        phev_timer_advance(&ctx->timers, phev_timer_now());
+    }
+
+    LOG_V(APP_TAG, "END - waitForConnection");
+}
+// A ping still unanswered when the next one is due counts as lost and drops back to the fastest interval
+static void phev_pipe_pingCheckLost(phev_pipe_ctx_t *ctx)
+{
+    phev_pipe_pingStats_t *ping = &ctx->ping;
+
+    if (ping->lastSequence >= 0 && ping->sentAt[ping->lastSequence] != 0)
+    {
+        LOG_W(APP_TAG, "No response to ping %d", ping->lastSequence);
+        ping->sentAt[ping->lastSequence] = 0;
+        ping->lost++;
+        ping->interval = PHEV_PIPE_PING_INTERVAL;
+    }
+}
+static void phev_pipe_pingTimer(phevTimer_t *timer, void *ctx)
+{
+    phev_pipe_ctx_t *pipeCtx = (phev_pipe_ctx_t *) ctx;
+
+    if (pipeCtx->pipe->out->connected)
+    {
+        phev_pipe_pingCheckLost(pipeCtx);
+        LOG_V(APP_TAG, "Sending ping");
+        phev_pipe_ping(pipeCtx);
+    }
+    phev_timer_start(&pipeCtx->timers, timer, pipeCtx->ping.interval);
+}
+static void phev_pipe_timeSyncTimer(phevTimer_t *timer, void *ctx)
+{
+    phev_pipe_ctx_t *pipeCtx = (phev_pipe_ctx_t *) ctx;
 
-        if (!ctx->pipe->in->connected)
+    if (pipeCtx->pipe->out->connected && !(pipeCtx->encrypt && pipeCtx->pingXOR == 0))
+    {
+        if (!pipeCtx->registerDevice)
         {
-            LOG_V(APP_TAG, "Calling in connect");
-            msg_pipe_in_connect(ctx->pipe);
+            phev_pipe_sendTimeSync(pipeCtx);
         }
-        if (!ctx->pipe->out->connected)
+        else
         {
-            LOG_V(APP_TAG, "Calling out connect");
-            msg_pipe_out_connect(ctx->pipe);
+            LOG_D(APP_TAG, "Not sending time sync in register device mode");
         }
-        retries++;
     }
+    phev_timer_start(&pipeCtx->timers, timer, PHEV_PIPE_TIME_SYNC_INTERVAL);
+}
+static void phev_pipe_updateTimer(phevTimer_t *timer, void *ctx)
+{
+    (void) timer;
 
-    ctx->connected = true;
-    LOG_V(APP_TAG, "END - waitForConnection");
+    phev_pipe_ctx_t *pipeCtx = (phev_pipe_ctx_t *) ctx;
+
+    phev_pipe_checkPendingUpdates(pipeCtx, phev_timer_time(&pipeCtx->timers));
 }
-void phev_pipe_loop(phev_pipe_ctx_t *ctx)
+static void phev_pipe_reconnectTimer(phevTimer_t *timer, void *ctx)
 {
-    time_t now;
+    (void) timer;
+    phev_pipe_reconnect((phev_pipe_ctx_t *) ctx);
+}
+int phev_pipe_socket(phev_pipe_ctx_t *ctx)
+{
+    if (ctx->socketHandler == NULL)
+    {
+        return PHEV_PIPE_SOCKET_UNKNOWN;
+    }
+    return (ctx->pipe->out->connected ? ctx->socketHandler(ctx->pipe->out) : -1);
+}
+int phev_pipe_connectingSocket(phev_pipe_ctx_t *ctx)
+{
+    return ctx->connect.soc;
+}
+void phev_pipe_abortConnect(phev_pipe_ctx_t *ctx)
+{
+    phev_tcpClientConnectAbort(&ctx->connect);
+}
+uint64_t phev_pipe_nextTimeout(phev_pipe_ctx_t *ctx)
+{
+    uint64_t now = phev_timer_now();
+    uint64_t next = phev_timer_nextDeadline(&ctx->timers);
+
+    return (next > now ? next - now : 0);
+}
+void phev_pipe_step(phev_pipe_ctx_t *ctx, bool readable)
+{
+    phev_timer_advance(&ctx->timers, phev_timer_now());
+    phev_pipe_drainCommands(ctx);
 
     if (ctx->pipe->in->connected && ctx->pipe->out->connected)
     {
-        ctx->connected = true;
-        msg_pipe_loop(ctx->pipe);
+        if (!ctx->connected)
+        {
+            phev_pipe_connectionEstablished(ctx);
+        }
+        if (readable)
+        {
+            msg_pipe_loop(ctx->pipe);
+        }
     }
     else
     {
-        phev_pipe_waitForConnection(ctx);
+        if (ctx->connected)
+        {
+            LOG_W(APP_TAG, "Connection lost");
+            ctx->connected = false;
+            phev_pipe_failPendingUpdates(ctx);
+        }
+        if (!phev_timer_active(&ctx->reconnectTimer))
+        {
+            phev_pipe_reconnect(ctx);
+        }
+        else if (readable && ctx->connect.soc >= 0)
+        {
+            // The connecting socket is ready, finish the connect now rather than when the timer gives up on it
+            phev_timer_stop(&ctx->timers, &ctx->reconnectTimer);
+            phev_pipe_reconnect(ctx);
+        }
     }
+}
+void phev_pipe_loop(phev_pipe_ctx_t *ctx)
+{
+    phev_pipe_step(ctx, true);
 
-    if (ctx->pipe->out->connected)
+    if (!ctx->connected)
     {
-        LOG_V(APP_TAG, "Sending ping");
-        time(&now);
-        if (now > ctx->lastPingTime)
-        {
-            phev_pipe_ping(ctx);
-            time(&ctx->lastPingTime);
-        }
+        // Nothing can arrive while disconnected so sleep until the next timer is due
+        uint64_t timeout = phev_pipe_nextTimeout(ctx);
+
+        SLEEP((timeout < PHEV_CONNECT_WAIT_TIME ? timeout : PHEV_CONNECT_WAIT_TIME));
     }
 }
 void phev_pipe_sendMac(phev_pipe_ctx_t *ctx, uint8_t *mac)
@@ -140,12 +320,28 @@ void phev_pipe_start(phev_pipe_ctx_t *ctx, uint8_t *mac)
 {
     LOG_V(APP_TAG, "START - start");
 
-    phev_pipe_waitForConnection(ctx);
+    // Sent as soon as the car is connected, an unreachable car is retried from the loop rather than blocking here
+    memcpy(ctx->startMac, mac, sizeof(ctx->startMac));
+    ctx->startPending = true;
 
-    phev_pipe_sendMac(ctx, mac);
-    phev_pipe_updateRegister(ctx, KO_WF_EV_UPDATE_SP, 3);
+    phev_timer_stop(&ctx->timers, &ctx->reconnectTimer);
+    phev_pipe_reconnect(ctx);
+
+    if (ctx->startPending)
+    {
+        LOG_I(APP_TAG, "Not connected start deferred");
+    }
     LOG_V(APP_TAG, "END - start");
 }
+static void phev_pipe_initCommandQueue(phev_pipe_commandQueue_t *queue)
+{
+    for (size_t i = 0; i < PHEV_PIPE_COMMAND_QUEUE_SIZE; i++)
+    {
+        atomic_init(&queue->commands[i].sequence, i);
+    }
+    atomic_init(&queue->enqueuePos, 0);
+    queue->dequeuePos = 0;
+}
 phev_pipe_ctx_t *phev_pipe_createPipe(phev_pipe_settings_t settings)
 {
     LOG_V(APP_TAG, "START - createPipe");
@@ -193,12 +389,16 @@ phev_pipe_ctx_t *phev_pipe_createPipe(phev_pipe_settings_t settings)
     }
 
     ctx->updateRegisterCallbacks = malloc(sizeof(phev_pipe_updateRegisterCtx_t));
+    ctx->updateRegisterCallbacks->updates = NULL;
+    ctx->updateRegisterCallbacks->capacity = 0;
+    ctx->updateRegisterCallbacks->freeList = -1;
+    ctx->updateRegisterCallbacks->nextDeadline = 0;
     ctx->updateRegisterCallbacks->numberOfCallbacks = 0;
+    ctx->updateRegisterCallbacks->handlerRegistered = false;
 
-    for (int i = 0; i < PHEV_PIPE_MAX_UPDATE_CALLBACKS; i++)
+    for (int i = 0; i < PHEV_PIPE_MAX_REGISTERS; i++)
     {
-        ctx->updateRegisterCallbacks->callbacks[i] = NULL;
-        ctx->updateRegisterCallbacks->used[i] = false;
+        ctx->updateRegisterCallbacks->byRegister[i] = -1;
     }
     ctx->connected = false;
     ctx->ctx = settings.ctx;
@@ -209,19 +409,49 @@ phev_pipe_ctx_t *phev_pipe_createPipe(phev_pipe_settings_t settings)
     ctx->pingResponse = 0;
     ctx->registerDevice = settings.registerDevice;
 
+    phev_timer_initWheel(&ctx->timers, phev_timer_now());
+    phev_timer_init(&ctx->pingTimer, phev_pipe_pingTimer, ctx);
+    phev_timer_init(&ctx->timeSyncTimer, phev_pipe_timeSyncTimer, ctx);
+    phev_timer_init(&ctx->updateTimer, phev_pipe_updateTimer, ctx);
+    phev_timer_init(&ctx->reconnectTimer, phev_pipe_reconnectTimer, ctx);
+    ctx->connectAttempts = 0;
+    ctx->connections = 0;
+    ctx->socketHandler = settings.socketHandler;
+    ctx->connectHandler = settings.connectHandler;
+    phev_tcpClientConnectInit(&ctx->connect);
+    ctx->connectSeed = ((uint32_t) (uintptr_t) ctx ^ (uint32_t) phev_timer_now()) | 1;
+    ctx->startPending = false;
+    phev_timer_start(&ctx->timers, &ctx->timeSyncTimer, PHEV_PIPE_TIME_SYNC_INTERVAL);
+    phev_pipe_initCommandQueue(&ctx->commands);
+
+    phev_core_streamParserInit(&ctx->stream);
+    phev_core_initXORPredictor(&ctx->xorPredictor);
+    ctx->pingTemplate.valid = false;
+    ctx->timeSyncTemplate.valid = false;
+
+    for (int i = 0; i < PHEV_PIPE_ACK_TEMPLATES; i++)
+    {
+        ctx->ackTemplates[i].valid = false;
+    }
+
+    memset(&ctx->ping, 0, sizeof(ctx->ping));
     phev_pipe_resetPing(ctx);
 
     LOG_V(APP_TAG, "END - createPipe");
 
     return ctx;
 }
-static bool waiting = false;
-static bool bb_waiting = false;
-
-void refreshCallback2(phev_pipe_ctx_t *ctx, uint8_t reg, void *customCtx)
+message_t *phev_pipe_frameFromTemplate(phevFrameTemplate_t *frameTemplate, const uint8_t command, const uint8_t type, const uint8_t reg, const uint8_t *data, const uint8_t length, const uint8_t xor)
 {
-    waiting = false;
-    LOG_I(APP_TAG,"                        REFRESH ACK");
+    if (!phev_core_frameTemplateMatches(frameTemplate, command, type, length, xor))
+    {
+        LOG_D(APP_TAG, "Building frame template for command %02X XOR %02X", command, xor);
+        phev_core_initFrameTemplate(frameTemplate, command, type, length, xor);
+    }
+
+    size_t frameLength = phev_core_patchFrameTemplate(frameTemplate, reg, data);
+
+    return msg_utils_createMsg(frameTemplate->frame, frameLength);
 }
 message_t *phev_pipe_outputChainInputTransformer(void *ctx, message_t *message)
 {
@@ -229,19 +459,19 @@ message_t *phev_pipe_outputChainInputTransformer(void *ctx, message_t *message)
     LOG_D(APP_TAG,"Incoming message");
     LOG_BUFFER_HEXDUMP(APP_TAG, message->data, message->length, LOG_DEBUG);
 
-    phevMessage_t *phevMessage = malloc(sizeof(phevMessage_t));
+    phevMessageView_t view;
     phev_pipe_ctx_t *pipeCtx = (phev_pipe_ctx_t *)ctx;
 
-    int ret = phev_core_decodeMessage(message->data, message->length, phevMessage);
+    phevMessage_t *phevMessage = phev_core_getDecodedMessage(message, &view);
 
-    if (ret == 0)
+    if (phevMessage == NULL)
     {
         LOG_E(APP_TAG, "Invalid message received");
 
         msg_utils_destroyMsg(message);
         return NULL;
     }
-    if(message->ctx != NULL)
+    if(phev_core_messageEncoded(message))
     {
         uint8_t xor = phev_core_getMessageXOR(message);
         //LOG_I(APP_TAG,"Command received XOR changed to %02X",xor);
@@ -271,15 +501,14 @@ message_t *phev_pipe_outputChainInputTransformer(void *ctx, message_t *message)
     {
         pipeCtx->pingResponse = phevMessage->reg;
         LOG_D(APP_TAG,"Server Ping %d\n",phevMessage->reg);
+        phev_pipe_pingReceived(pipeCtx, phevMessage->reg, phev_timer_now());
 
     }
+    phev_core_seedXORPredictor(&pipeCtx->xorPredictor, pipeCtx->currentXOR, pipeCtx->commandXOR, pipeCtx->pingXOR);
 
     LOG_D(APP_TAG, "Command %02x Register %d Length %d Type %d XOR %02X", phevMessage->command, phevMessage->reg, phevMessage->length, phevMessage->type, phevMessage->XOR);
     LOG_BUFFER_HEXDUMP(APP_TAG, phevMessage->data, phevMessage->length, LOG_DEBUG);
 
-    phev_core_destroyMessage(phevMessage);
-
-    //free(phevMessage);
     return message;
 
 }
@@ -294,45 +523,48 @@ message_t *phev_pipe_commandResponder(void *ctx, message_t *message)
     if (message != NULL)
     {
 
-        phevMessage_t phevMsg;
+        phevMessageView_t view;
+        phevMessage_t *phevMsg = phev_core_getDecodedMessage(message, &view);
 
-        phev_core_decodeMessage(message->data, message->length, &phevMsg);
+        if (phevMsg == NULL)
+        {
+            LOG_E(APP_TAG, "Invalid message received");
+            LOG_V(APP_TAG, "END - commandResponder");
+            return NULL;
+        }
 
-        LOG_D(APP_TAG, "Decoded message XOR %02x", phevMsg.XOR);
-        if (phevMsg.command == PING_RESP_CMD || phevMsg.command == PING_RESP_CMD_MY18 || phevMsg.command == 0xbb || phevMsg.command == 0xcd || phevMsg.command == 0xcc)
+        LOG_D(APP_TAG, "Decoded message XOR %02x", phevMsg->XOR);
+        if (phevMsg->command == PING_RESP_CMD || phevMsg->command == PING_RESP_CMD_MY18 || phevMsg->command == 0xbb || phevMsg->command == 0xcd || phevMsg->command == 0xcc)
         {
             LOG_D(APP_TAG, "Ignoring ping");
             LOG_V(APP_TAG, "END - commandResponder");
-            free(phevMsg.data);
             return NULL;
         }
-        if(phevMsg.command == 0x4e || phevMsg.command == 0x5e)
+        if(phevMsg->command == 0x4e || phevMsg->command == 0x5e)
         {
-            LOG_D(APP_TAG, "%02X Command does not get encrypted response",phevMsg.command);
-            LOG_BUFFER_HEXDUMP(APP_TAG,phevMsg.data,phevMsg.length,LOG_DEBUG);
-            phevMessage_t *msg = phev_core_responseHandler(&phevMsg);
-            LOG_D(APP_TAG, "Responded with command %02X  type %d", phevMsg.command,phevMsg.type);
+            LOG_D(APP_TAG, "%02X Command does not get encrypted response",phevMsg->command);
+            LOG_BUFFER_HEXDUMP(APP_TAG,phevMsg->data,phevMsg->length,LOG_DEBUG);
+            phevMessage_t *msg = phev_core_responseHandler(phevMsg);
+            LOG_D(APP_TAG, "Responded with command %02X  type %d", phevMsg->command,phevMsg->type);
             out = phev_core_convertToMessage(msg);
             pipeCtx->encrypt = true;
-            free(phevMsg.data);
             return out;
         }
         if(pipeCtx->registerDevice == true)
         {
             //This is a hack to keep registration working
             LOG_I(APP_TAG,"Not responding to command for registration");
-            free(phevMsg.data);
             return NULL;
         }
 
-        LOG_D(APP_TAG, "Responding to %02X %02X", phevMsg.command, phevMsg.type);
-        if (phevMsg.type == REQUEST_TYPE)
+        LOG_D(APP_TAG, "Responding to %02X %02X", phevMsg->command, phevMsg->type);
+        if (phevMsg->type == REQUEST_TYPE)
         {
-            phevMessage_t *msg = phev_core_responseHandler(&phevMsg);
-            LOG_D(APP_TAG, "Responded with command %02X  type %d", phevMsg.command,phevMsg.type);
+            const uint8_t ack = phev_core_ackCommand(phevMsg->command);
+            const uint8_t ackData = 0;
 
-            out = phev_core_convertToMessage(msg);
-            free(phevMsg.data);
+            ret = phev_pipe_frameFromTemplate(&pipeCtx->ackTemplates[ack % PHEV_PIPE_ACK_TEMPLATES], ack, RESPONSE_TYPE, phevMsg->reg, &ackData, 1, phev_core_getMessageXOR(message));
+            LOG_D(APP_TAG, "Responded with command %02X  type %d", ack, RESPONSE_TYPE);
         }
     }
     if (out)
@@ -727,11 +959,10 @@ message_t *phev_pipe_outputEventTransformer(void *ctx, message_t *message)
 {
     LOG_V(APP_TAG, "START - outputEventTransformer");
 
-    phevMessage_t *phevMessage = malloc(sizeof(phevMessage_t));
-
-    int length = phev_core_decodeMessage(message->data, message->length, phevMessage);
+    phevMessageView_t view;
+    phevMessage_t *phevMessage = phev_core_getDecodedMessage(message, &view);
 
-    if (length == 0)
+    if (phevMessage == NULL)
     {
         LOG_E(APP_TAG, "Invalid message received - something serious happened here as we should only have a valid message at this point");
         LOG_BUFFER_HEXDUMP(APP_TAG, message->data, message->length, LOG_DEBUG);
@@ -743,8 +974,6 @@ message_t *phev_pipe_outputEventTransformer(void *ctx, message_t *message)
 
 //    message_t *ret = phev_core_convertToMessage(phevMessage);
 
-    phev_core_destroyMessage(phevMessage);
-
 //    LOG_V(APP_TAG, "END - outputEventTransformer");
 
     return NULL; //ret;
@@ -792,7 +1021,7 @@ void phev_pipe_deregisterEventHandler(phev_pipe_ctx_t *ctx, phevPipeEventHandler
 
 void phev_pipe_checkXORChanged(phev_pipe_ctx_t * ctx, message_t * message)
 {
-    if(message->ctx != NULL)
+    if(phev_core_messageEncoded(message))
     {
         uint8_t xor =phev_core_getMessageXOR(message);
 
@@ -822,40 +1051,42 @@ messageBundle_t *phev_pipe_outputSplitter(void *ctx, message_t *message)
     }
     LOG_BUFFER_HEXDUMP(APP_TAG, message->data, message->length, LOG_DEBUG);
 
-    message_t * out = phev_core_extractIncomingMessageAndXOR(message->data);
-
-    if (out == NULL)
-    {
-        LOG_E(APP_TAG,"Could not extract message");
-        return NULL;
-    }
-    LOG_D(APP_TAG,"Extract message output");
-    LOG_BUFFER_HEXDUMP(APP_TAG, out->data, out->length, LOG_DEBUG);
-
-    phev_pipe_checkXORChanged(pipeCtx, out);
-
     messageBundle_t *messages = malloc(sizeof(messageBundle_t));
 
     messages->numMessages = 0;
-    messages->messages[messages->numMessages++] = msg_utils_copyMsg(out);
-
-    int total = out->length;
 
-    msg_utils_destroyMsg(out);
+    size_t total = 0;
 
-    while (message->length > total)
+    do
     {
-        out = phev_core_extractIncomingMessageAndXOR(message->data + total);
-        if (out == NULL) {
-            break;
+        total += phev_core_streamParserWrite(&pipeCtx->stream, message->data + total, message->length - total);
+
+        message_t * out = NULL;
+
+        while (messages->numMessages < MAX_MESSAGES && (out = phev_core_streamParserNextMessage(&pipeCtx->stream, &pipeCtx->xorPredictor)) != NULL)
+        {
+            LOG_D(APP_TAG,"Extract message output");
+            LOG_BUFFER_HEXDUMP(APP_TAG, out->data, out->length, LOG_DEBUG);
+            if (messages->numMessages < PHEV_PIPE_DECODED_MESSAGES)
+            {
+                // Later stages read the decoded frame from the message ctx instead of decoding it again
+                phev_core_attachDecodedMessage(out, &pipeCtx->decoded[messages->numMessages]);
+            }
+            phev_pipe_checkXORChanged(pipeCtx, out);
+            messages->messages[messages->numMessages++] = out;
         }
+    } while (total < message->length && messages->numMessages < MAX_MESSAGES);
 
-        LOG_D(APP_TAG,"Extract message output");
-        LOG_BUFFER_HEXDUMP(APP_TAG, out->data, out->length, LOG_DEBUG);
-        phev_pipe_checkXORChanged(pipeCtx,out);
-        total += out->length;
-        messages->messages[messages->numMessages++] = msg_utils_copyMsg(out);
-        msg_utils_destroyMsg(out);
+    if (total < message->length)
+    {
+        LOG_E(APP_TAG, "Message bundle full, dropped %zu bytes", message->length - total);
+    }
+
+    if (messages->numMessages == 0)
+    {
+        LOG_D(APP_TAG, "No complete message yet, %zu bytes pending", phev_core_streamParserPending(&pipeCtx->stream));
+        free(messages);
+        return NULL;
     }
 
     //msg_utils_destroyMsg(message); // Cannot destroy until tests are fixed
@@ -884,11 +1115,12 @@ void phev_pipe_sendTimeSync(phev_pipe_ctx_t *ctx)
         1};
     LOG_D(APP_TAG, "Year %d Month %d Date %d Hour %d Min %d Sec %d\n", pingTime[0], pingTime[1], pingTime[2], pingTime[3], pingTime[4], pingTime[5]);
 
-    phevMessage_t *dateCmd = phev_core_commandMessage(KO_WF_DATE_INFO_SYNC_SP, pingTime, sizeof(pingTime));
-    message_t *message = phev_core_convertToMessage(dateCmd);
+    message_t *message = phev_pipe_frameFromTemplate(&ctx->timeSyncTemplate, SEND_CMD, REQUEST_TYPE, KO_WF_DATE_INFO_SYNC_SP, pingTime, sizeof(pingTime), ctx->commandXOR);
 
 #ifndef NO_TIME_SYNC
-    phev_pipe_commandOutboundPublish(ctx, message);
+    msg_pipe_outboundPublish(ctx->pipe, message);
+#else
+    msg_utils_destroyMsg(message);
 #endif
 
     LOG_V(APP_TAG, "END - sendTimeSync");
@@ -902,37 +1134,92 @@ void phev_pipe_ping(phev_pipe_ctx_t *ctx)
         LOG_I(APP_TAG,"Not sending ping after start message recieved if not got XOR");
         return;
     }
-    if (((ctx->currentPing) % 30) == 0)
-    {
-        if(!ctx->registerDevice)
-        {
-            phev_pipe_sendTimeSync(ctx);
-        }
-        else
-        {
-            LOG_D(APP_TAG,"Not sending time sync in register device mode");
-        }
-    }
-    phevMessage_t *ping = phev_core_pingMessage(ctx->currentPing++);
+    const uint8_t pingData = 0;
+    const uint8_t sequence = ctx->currentPing;
+    message_t *message = phev_pipe_frameFromTemplate(&ctx->pingTemplate, PING_SEND_CMD_MY18, REQUEST_TYPE, ctx->currentPing++, &pingData, 1, ctx->pingXOR);
     ctx->currentPing %= 0x30;
     LOG_D(APP_TAG,"Client Ping %d\n",ctx->currentPing);
-    message_t *message = phev_core_convertToMessage(ping);
 
 #ifndef NO_PING
     if(!ctx->registerDevice)
     {
-        phev_pipe_pingOutboundPublish(ctx, message);
+        msg_pipe_outboundPublish(ctx->pipe, message);
+        ctx->ping.sentAt[sequence % PHEV_PIPE_PING_SEQUENCES] = phev_timer_now();
+        ctx->ping.lastSequence = sequence % PHEV_PIPE_PING_SEQUENCES;
     }
     else
     {
         LOG_I(APP_TAG,"Not sending ping in register device mode");
+        msg_utils_destroyMsg(message);
     }
-
+#else
+    msg_utils_destroyMsg(message);
 #endif
     //msg_utils_destroyMsg(message);
     //phev_core_destroyMessage(ping);
     LOG_V(APP_TAG, "END - ping");
 }
+static bool phev_pipe_pingIdle(phev_pipe_ctx_t *ctx)
+{
+    return ctx->updateRegisterCallbacks->numberOfCallbacks == 0 && !phev_pipe_commandsPending(ctx);
+}
+// Commands want a dead link noticed quickly so go back to the fastest interval
+static void phev_pipe_pingActivity(phev_pipe_ctx_t *ctx)
+{
+    if (ctx->ping.interval <= PHEV_PIPE_PING_INTERVAL)
+    {
+        return;
+    }
+    ctx->ping.interval = PHEV_PIPE_PING_INTERVAL;
+
+    if (!phev_timer_active(&ctx->pingTimer) || ctx->pingTimer.expires > phev_timer_time(&ctx->timers) + ctx->ping.interval)
+    {
+        phev_timer_start(&ctx->timers, &ctx->pingTimer, ctx->ping.interval);
+    }
+}
+void phev_pipe_pingReceived(phev_pipe_ctx_t *ctx, const uint8_t sequence, const uint64_t now)
+{
+    phev_pipe_pingStats_t *ping = &ctx->ping;
+
+    if (sequence >= PHEV_PIPE_PING_SEQUENCES || ping->sentAt[sequence] == 0)
+    {
+        LOG_D(APP_TAG, "Response to unknown ping %d", sequence);
+        return;
+    }
+
+    uint32_t rtt = (uint32_t) (now > ping->sentAt[sequence] ? now - ping->sentAt[sequence] : 0);
+    int bucket = 0;
+
+    ping->sentAt[sequence] = 0;
+
+    while (bucket < PHEV_PIPE_RTT_BUCKETS - 1 && (rtt >> bucket) != 0)
+    {
+        bucket++;
+    }
+    ping->histogram[bucket]++;
+
+    ping->rttAverage = (ping->samples == 0 ? rtt << 3 : ping->rttAverage + rtt - (ping->rttAverage >> 3));
+    ping->minRtt = (ping->samples == 0 || rtt < ping->minRtt ? rtt : ping->minRtt);
+    ping->maxRtt = (rtt > ping->maxRtt ? rtt : ping->maxRtt);
+    ping->lastRtt = rtt;
+    ping->samples++;
+
+    // Back off while the link is quick and nothing is waiting on the car, anything else pings at the base rate
+    if (rtt > PHEV_PIPE_PING_HEALTHY_RTT)
+    {
+        ping->interval = PHEV_PIPE_PING_INTERVAL;
+    }
+    else if (phev_pipe_pingIdle(ctx))
+    {
+        ping->interval = (ping->interval * 2 > PHEV_PIPE_PING_MAX_INTERVAL ? PHEV_PIPE_PING_MAX_INTERVAL : ping->interval * 2);
+    }
+
+    LOG_D(APP_TAG, "Ping %d rtt %ums average %ums interval %ums", sequence, rtt, phev_pipe_pingRtt(ctx), ping->interval);
+}
+uint32_t phev_pipe_pingRtt(const phev_pipe_ctx_t *ctx)
+{
+    return (ctx->ping.rttAverage + 4) >> 3;
+}
 void phev_pipe_updateComplexRegister(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t * data, const size_t length)
 {
     phev_pipe_updateComplexRegisterWithCallback(ctx, reg, data, length, NULL, NULL);
@@ -970,102 +1257,451 @@ void phev_pipe_updateRegisterNoRetry(phev_pipe_ctx_t *ctx, const uint8_t reg, co
     LOG_V(APP_TAG, "END - updateRegister");
 }
 
+static uint64_t phev_pipe_updateBackoff(const int retries)
+{
+    uint64_t timeout = (uint64_t) PHEV_PIPE_UPDATE_TIMEOUT << retries;
+
+    return (timeout > PHEV_PIPE_UPDATE_MAX_BACKOFF ? PHEV_PIPE_UPDATE_MAX_BACKOFF : timeout);
+}
+static int phev_pipe_allocPendingUpdate(phev_pipe_updateRegisterCtx_t *pending)
+{
+    if (pending->freeList == -1)
+    {
+        size_t capacity = (pending->capacity == 0 ? PHEV_PIPE_INITIAL_PENDING_UPDATES : pending->capacity * 2);
+
+        if (capacity > PHEV_PIPE_MAX_PENDING_UPDATES)
+        {
+            capacity = PHEV_PIPE_MAX_PENDING_UPDATES;
+        }
+        if (capacity <= pending->capacity)
+        {
+            return -1;
+        }
+
+        phev_pipe_pendingUpdate_t *updates = realloc(pending->updates, capacity * sizeof(phev_pipe_pendingUpdate_t));
+
+        if (updates == NULL)
+        {
+            return -1;
+        }
+        for (size_t i = pending->capacity; i < capacity; i++)
+        {
+            updates[i].used = false;
+            updates[i].value = NULL;
+            updates[i].next = (i + 1 < capacity ? (int) (i + 1) : -1);
+        }
+        pending->freeList = (int) pending->capacity;
+        pending->updates = updates;
+        pending->capacity = capacity;
+    }
+
+    int index = pending->freeList;
+
+    pending->freeList = pending->updates[index].next;
+    pending->updates[index].next = -1;
+    pending->updates[index].used = true;
+    pending->numberOfCallbacks++;
+
+    return index;
+}
+static void phev_pipe_releasePendingUpdate(phev_pipe_updateRegisterCtx_t *pending, const int index)
+{
+    phev_pipe_pendingUpdate_t *update = &pending->updates[index];
+
+    free(update->value);
+    update->value = NULL;
+    update->length = 0;
+    update->callback = NULL;
+    update->timeoutCallback = NULL;
+    update->ctx = NULL;
+    update->used = false;
+    update->next = pending->freeList;
+
+    pending->freeList = index;
+    pending->numberOfCallbacks--;
+}
+static void phev_pipe_unlinkPendingUpdate(phev_pipe_updateRegisterCtx_t *pending, const int index)
+{
+    int *link = &pending->byRegister[pending->updates[index].reg];
+
+    while (*link != -1 && *link != index)
+    {
+        link = &pending->updates[*link].next;
+    }
+    if (*link == index)
+    {
+        *link = pending->updates[index].next;
+    }
+}
 int phev_pipe_updateRegisterEventHandler(phev_pipe_ctx_t *ctx, phevPipeEvent_t *event)
 {
     LOG_V(APP_TAG, "START - updateRegisterEventHandler");
 
+    phev_pipe_updateRegisterCtx_t *pending = ctx->updateRegisterCallbacks;
 
     if(!event)
     {
         return 0;
     }
 
-    LOG_D(APP_TAG, "Register callbacks %zu",ctx->updateRegisterCallbacks->numberOfCallbacks);
+    LOG_D(APP_TAG, "Register callbacks %zu",pending->numberOfCallbacks);
 
-    if(ctx->updateRegisterCallbacks->numberOfCallbacks == 0)
+    if(pending->numberOfCallbacks == 0)
     {
         LOG_D(APP_TAG,"No register events");
         return 0;
     }
-    if (event->event == PHEV_PIPE_BB && ctx->updateRegisterCallbacks->numberOfCallbacks > 0)
+    if (event->event == PHEV_PIPE_BB)
     {
         LOG_D(APP_TAG,"Resending commands");
-        for(int i=0; i< PHEV_PIPE_MAX_UPDATE_CALLBACKS; i++)
+        for (size_t i = 0; i < pending->capacity; i++)
         {
-            if(ctx->updateRegisterCallbacks->used[i])
+            if (pending->updates[i].used)
             {
-                phev_pipe_updateRegisterNoRetry(ctx, ctx->updateRegisterCallbacks->registers[i], ctx->updateRegisterCallbacks->values[i],ctx->updateRegisterCallbacks->lengths[i]);
+                phev_pipe_updateRegisterNoRetry(ctx, pending->updates[i].reg, pending->updates[i].value, pending->updates[i].length);
             }
         }
 
     }
     if (event->event == PHEV_PIPE_REG_UPDATE_ACK)
     {
-        for (int i = 0; i < PHEV_PIPE_MAX_UPDATE_CALLBACKS; i++)
+        const uint8_t reg = ((phevMessage_t *)event->data)->reg;
+        int index = pending->byRegister[reg];
+
+        pending->byRegister[reg] = -1;
+
+        while (index != -1)
         {
-            if (ctx->updateRegisterCallbacks->used[i] && ctx->updateRegisterCallbacks->registers[i] == ((phevMessage_t *)event->data)->reg)
-            {
-                if(ctx->updateRegisterCallbacks->callbacks[i]!= NULL)
-                {
-                    ctx->updateRegisterCallbacks->callbacks[i](ctx, ctx->updateRegisterCallbacks->registers[i], ctx->updateRegisterCallbacks->ctx[i]);
-                }
-                ctx->updateRegisterCallbacks->callbacks[i] = NULL;
-                ctx->updateRegisterCallbacks->registers[i] = 0;
-                free(ctx->updateRegisterCallbacks->values[i]);
-                ctx->updateRegisterCallbacks->values[i] = NULL;
-                ctx->updateRegisterCallbacks->lengths[i] = 0;
+            int next = pending->updates[index].next;
+            phev_pipe_updateRegisterCallback_t callback = pending->updates[index].callback;
+            void *customCtx = pending->updates[index].ctx;
 
-                ctx->updateRegisterCallbacks->used[i] = false;
+            // Release before calling back so the callback can queue a new update
+            phev_pipe_releasePendingUpdate(pending, index);
 
-                ctx->updateRegisterCallbacks->numberOfCallbacks--;
+            if (callback != NULL)
+            {
+                callback(ctx, reg, customCtx);
             }
+            index = next;
         }
     }
     LOG_V(APP_TAG, "END - updateRegisterEventHandler");
 
     return 0;
 }
+void phev_pipe_checkPendingUpdates(phev_pipe_ctx_t *ctx, uint64_t now)
+{
+    phev_pipe_updateRegisterCtx_t *pending = ctx->updateRegisterCallbacks;
+
+    if (pending->numberOfCallbacks == 0 || now < pending->nextDeadline)
+    {
+        return;
+    }
+
+    LOG_V(APP_TAG, "START - checkPendingUpdates");
+
+    for (size_t i = 0; i < pending->capacity; i++)
+    {
+        if (!pending->updates[i].used || pending->updates[i].deadline > now)
+        {
+            continue;
+        }
+        if (pending->updates[i].retries < PHEV_PIPE_UPDATE_MAX_RETRIES)
+        {
+            pending->updates[i].retries++;
+            pending->updates[i].deadline = now + phev_pipe_updateBackoff(pending->updates[i].retries);
+
+            LOG_W(APP_TAG, "No ack for register %02X, retry %d", pending->updates[i].reg, pending->updates[i].retries);
+            phev_pipe_updateRegisterNoRetry(ctx, pending->updates[i].reg, pending->updates[i].value, pending->updates[i].length);
+        }
+        else
+        {
+            const uint8_t reg = pending->updates[i].reg;
+            phev_pipe_updateRegisterCallback_t timeoutCallback = pending->updates[i].timeoutCallback;
+            void *customCtx = pending->updates[i].ctx;
+
+            LOG_E(APP_TAG, "Update to register %02X timed out after %d retries", reg, PHEV_PIPE_UPDATE_MAX_RETRIES);
+
+            phev_pipe_unlinkPendingUpdate(pending, (int) i);
+            phev_pipe_releasePendingUpdate(pending, (int) i);
+
+            if (timeoutCallback != NULL)
+            {
+                timeoutCallback(ctx, reg, customCtx);
+            }
+        }
+    }
+
+    bool found = false;
+
+    pending->nextDeadline = 0;
+
+    for (size_t i = 0; i < pending->capacity; i++)
+    {
+        if (pending->updates[i].used && (!found || pending->updates[i].deadline < pending->nextDeadline))
+        {
+            pending->nextDeadline = pending->updates[i].deadline;
+            found = true;
+        }
+    }
+
+    if (found)
+    {
+        phev_timer_startAt(&ctx->timers, &ctx->updateTimer, pending->nextDeadline);
+    }
+    else
+    {
+        phev_timer_stop(&ctx->timers, &ctx->updateTimer);
+    }
+
+    LOG_V(APP_TAG, "END - checkPendingUpdates");
+}
+// Nothing sent before the connection dropped will be acked, the timeout callbacks run with the pipe disconnected
+void phev_pipe_failPendingUpdates(phev_pipe_ctx_t *ctx)
+{
+    phev_pipe_updateRegisterCtx_t *pending = ctx->updateRegisterCallbacks;
+
+    if (pending->numberOfCallbacks == 0)
+    {
+        return;
+    }
+
+    LOG_V(APP_TAG, "START - failPendingUpdates");
+
+    for (size_t i = 0; i < pending->capacity; i++)
+    {
+        if (!pending->updates[i].used)
+        {
+            continue;
+        }
+
+        const uint8_t reg = pending->updates[i].reg;
+        phev_pipe_updateRegisterCallback_t timeoutCallback = pending->updates[i].timeoutCallback;
+        void *customCtx = pending->updates[i].ctx;
+
+        LOG_W(APP_TAG, "Update to register %02X failed by disconnect", reg);
+
+        phev_pipe_unlinkPendingUpdate(pending, (int) i);
+        phev_pipe_releasePendingUpdate(pending, (int) i);
+
+        if (timeoutCallback != NULL)
+        {
+            timeoutCallback(ctx, reg, customCtx);
+        }
+    }
+    phev_timer_stop(&ctx->timers, &ctx->updateTimer);
+
+    LOG_V(APP_TAG, "END - failPendingUpdates");
+}
 void phev_pipe_updateRegisterWithCallback(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t value, phev_pipe_updateRegisterCallback_t callback, void *customCtx)
 {
     LOG_V(APP_TAG, "START - updateRegisterWithCallback");
 
-    uint8_t * data = malloc(1);
-    data[0] = value;
+    const uint8_t data = value;
 
-    phev_pipe_updateComplexRegisterWithCallback(ctx, reg, data, 1, callback, customCtx);
+    phev_pipe_updateComplexRegisterWithCallback(ctx, reg, &data, 1, callback, customCtx);
 
     LOG_V(APP_TAG, "END - updateRegisterWithCallback");
 
 }
 void phev_pipe_updateComplexRegisterWithCallback(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t * data, const size_t length, phev_pipe_updateRegisterCallback_t callback, void *customCtx)
 {
-    LOG_V(APP_TAG, "START - updateRegisterWithCallback");
+    phev_pipe_updateComplexRegisterWithTimeout(ctx, reg, data, length, callback, NULL, customCtx);
+}
+void phev_pipe_updateComplexRegisterWithTimeout(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t * data, const size_t length, phev_pipe_updateRegisterCallback_t callback, phev_pipe_updateRegisterCallback_t timeoutCallback, void *customCtx)
+{
+    LOG_V(APP_TAG, "START - updateComplexRegisterWithTimeout");
+
+    phev_pipe_updateRegisterCtx_t *pending = ctx->updateRegisterCallbacks;
+
+    int index = phev_pipe_allocPendingUpdate(pending);
+
+    if (index < 0)
+    {
+        LOG_E(APP_TAG, "Cannot add update for register %02X, %zu updates already pending", reg, pending->numberOfCallbacks);
+        return;
+    }
+
+    phev_pipe_pendingUpdate_t *update = &pending->updates[index];
+
+    update->value = malloc(length);
+    memcpy(update->value, data, length);
+    update->length = length;
+    update->reg = reg;
+    update->callback = callback;
+    update->timeoutCallback = timeoutCallback;
+    update->ctx = customCtx;
+    update->retries = 0;
+    update->deadline = phev_timer_now() + phev_pipe_updateBackoff(0);
+
+    // Append so acks complete updates to the same register in the order they were sent
+    int *link = &pending->byRegister[reg];
 
-    for (int i = 0; i < PHEV_PIPE_MAX_UPDATE_CALLBACKS; i++)
+    while (*link != -1)
     {
-        if (ctx->updateRegisterCallbacks->used[i] == false)
+        link = &pending->updates[*link].next;
+    }
+    *link = index;
+
+    if (pending->numberOfCallbacks == 1 || update->deadline < pending->nextDeadline)
+    {
+        pending->nextDeadline = update->deadline;
+        phev_timer_startAt(&ctx->timers, &ctx->updateTimer, pending->nextDeadline);
+    }
+
+    phev_pipe_pingActivity(ctx);
+
+    if (!pending->handlerRegistered)
+    {
+        phev_pipe_registerEventHandler(ctx, (phevPipeEventHandler_t)phev_pipe_updateRegisterEventHandler);
+        pending->handlerRegistered = true;
+    }
+
+    phev_pipe_updateRegisterNoRetry(ctx, reg, data, length);
+
+    LOG_V(APP_TAG, "END - updateComplexRegisterWithTimeout");
+}
+// Claims the next free slot for the caller to fill in and publish, NULL when the queue is full
+static phev_pipe_command_t *phev_pipe_claimCommand(phev_pipe_commandQueue_t *queue, size_t *claimed)
+{
+    phev_pipe_command_t *command = NULL;
+    size_t pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+
+    for (;;)
+    {
+        command = &queue->commands[pos & (PHEV_PIPE_COMMAND_QUEUE_SIZE - 1)];
+
+        size_t sequence = atomic_load_explicit(&command->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+        if (diff == 0)
         {
-            uint8_t * dataCopy = malloc(length);
-            memcpy(dataCopy, data, length);
-            ctx->updateRegisterCallbacks->used[i] = true;
-            ctx->updateRegisterCallbacks->callbacks[i] = callback;
-            ctx->updateRegisterCallbacks->registers[i] = reg;
-            ctx->updateRegisterCallbacks->values[i] = dataCopy;
-            ctx->updateRegisterCallbacks->lengths[i] = length;
-            ctx->updateRegisterCallbacks->ctx[i] = customCtx;
+            // Claim the slot, another thread may have got there first in which case pos is reloaded
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueuePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+        }
+    }
+    *claimed = pos;
+
+    return command;
+}
+// Safe to call from any thread, the update is made by the pipe loop the next time it runs
+bool phev_pipe_submitUpdate(phev_pipe_ctx_t *ctx, const uint8_t reg, const uint8_t * data, size_t length, phev_pipe_updateRegisterCallback_t callback, phev_pipe_updateRegisterCallback_t timeoutCallback, void * customCtx)
+{
+    LOG_V(APP_TAG, "START - submitUpdate");
 
-            ctx->updateRegisterCallbacks->numberOfCallbacks++;
+    if (length == 0 || length > PHEV_PIPE_COMMAND_MAX_DATA)
+    {
+        LOG_E(APP_TAG, "Cannot submit update for register %02X with length %zu", reg, length);
+        return false;
+    }
+
+    size_t pos;
+    phev_pipe_command_t *command = phev_pipe_claimCommand(&ctx->commands, &pos);
 
-            phev_pipe_registerEventHandler(ctx, (phevPipeEventHandler_t)phev_pipe_updateRegisterEventHandler);
+    if (command == NULL)
+    {
+        LOG_E(APP_TAG, "Command queue full, dropping update for register %02X", reg);
+        return false;
+    }
 
-            phev_pipe_updateRegisterNoRetry(ctx, reg, data, length);
+    command->task = NULL;
+    command->reg = reg;
+    memcpy(command->data, data, length);
+    command->length = length;
+    command->callback = callback;
+    command->timeoutCallback = timeoutCallback;
+    command->ctx = customCtx;
 
-            LOG_V(APP_TAG, "END - updateRegisterWithCallback");
-            return;
+    // Publishes the command to the pipe loop
+    atomic_store_explicit(&command->sequence, pos + 1, memory_order_release);
+
+    LOG_V(APP_TAG, "END - submitUpdate");
+
+    return true;
+}
+bool phev_pipe_submitTask(phev_pipe_ctx_t *ctx, phev_pipe_task_t task, const uint8_t * data, size_t length, void * customCtx)
+{
+    LOG_V(APP_TAG, "START - submitTask");
+
+    if (task == NULL || length > PHEV_PIPE_COMMAND_MAX_DATA)
+    {
+        LOG_E(APP_TAG, "Cannot submit task with length %zu", length);
+        return false;
+    }
+
+    size_t pos;
+    phev_pipe_command_t *command = phev_pipe_claimCommand(&ctx->commands, &pos);
+
+    if (command == NULL)
+    {
+        LOG_E(APP_TAG, "Command queue full, dropping task");
+        return false;
+    }
+
+    command->task = task;
+    if (length > 0)
+    {
+        memcpy(command->data, data, length);
+    }
+    command->length = length;
+    command->ctx = customCtx;
+
+    atomic_store_explicit(&command->sequence, pos + 1, memory_order_release);
+
+    LOG_V(APP_TAG, "END - submitTask");
+
+    return true;
+}
+bool phev_pipe_commandsPending(phev_pipe_ctx_t *ctx)
+{
+    phev_pipe_commandQueue_t *queue = &ctx->commands;
+    phev_pipe_command_t *command = &queue->commands[queue->dequeuePos & (PHEV_PIPE_COMMAND_QUEUE_SIZE - 1)];
+
+    return atomic_load_explicit(&command->sequence, memory_order_acquire) == queue->dequeuePos + 1;
+}
+// Only the thread running the pipe loop may drain, at most one queue's worth so producers cannot hold the loop
+size_t phev_pipe_drainCommands(phev_pipe_ctx_t *ctx)
+{
+    phev_pipe_commandQueue_t *queue = &ctx->commands;
+    size_t drained = 0;
+
+    while (drained < PHEV_PIPE_COMMAND_QUEUE_SIZE && phev_pipe_commandsPending(ctx))
+    {
+        phev_pipe_command_t *command = &queue->commands[queue->dequeuePos & (PHEV_PIPE_COMMAND_QUEUE_SIZE - 1)];
+
+        if (command->task)
+        {
+            command->task(ctx, command->data, command->length, command->ctx);
         }
+        else
+        {
+            phev_pipe_updateComplexRegisterWithTimeout(ctx, command->reg, command->data, command->length, command->callback, command->timeoutCallback, command->ctx);
+        }
+
+        // Hand the slot back to the producers for the next lap round the ring
+        atomic_store_explicit(&command->sequence, queue->dequeuePos + PHEV_PIPE_COMMAND_QUEUE_SIZE, memory_order_release);
+        queue->dequeuePos++;
+        drained++;
+    }
+
+    if (drained > 0)
+    {
+        LOG_D(APP_TAG, "Drained %zu submitted commands", drained);
     }
 
-    LOG_W(APP_TAG, "Cannot add update register handler too many allocated %d",ctx->updateRegisterCallbacks->numberOfCallbacks);
+    return drained;
 }
 
 void phev_pipe_pingOutboundPublish(phev_pipe_ctx_t * ctx, message_t * message)
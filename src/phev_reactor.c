@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <errno.h>
+#include "phev_reactor.h"
+#include "logger.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+const static char *APP_TAG = "PHEV_REACTOR";
+
+static phevReactorSession_t *phev_reactor_findSession(phevReactor_t *reactor, const phev_pipe_ctx_t *pipe)
+{
+    for (size_t i = 0; i < reactor->capacity; i++)
+    {
+        if (reactor->sessions[i].used && reactor->sessions[i].pipe == pipe)
+        {
+            return &reactor->sessions[i];
+        }
+    }
+    return NULL;
+}
+static int phev_reactor_watch(phevReactor_t *reactor, phevReactorSession_t *session, int fd, bool connecting)
+{
+    if (session->fd >= 0)
+    {
+        // The socket may already have been closed, which removes it from the epoll set anyway
+        epoll_ctl(reactor->epoll, EPOLL_CTL_DEL, session->fd, NULL);
+        session->fd = -1;
+    }
+    session->connecting = false;
+
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    struct epoll_event event = {
+        .events = (connecting ? EPOLLOUT : EPOLLIN),
+        .data.ptr = session,
+    };
+
+    if (epoll_ctl(reactor->epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        LOG_E(APP_TAG, "Cannot watch socket %d errno %d", fd, errno);
+        return -1;
+    }
+    session->fd = fd;
+    session->connecting = connecting;
+
+    return 0;
+}
+// The pipe reconnects by itself, so watch whatever socket it has now. A new connection may reuse the old socket
+// number, which is only removed from the epoll set when it is closed, so that has to be added again too.
+static void phev_reactor_follow(phevReactor_t *reactor, phevReactorSession_t *session)
+{
+    int fd = phev_pipe_socket(session->pipe);
+    bool connecting = false;
+
+    if (fd == PHEV_PIPE_SOCKET_UNKNOWN)
+    {
+        return;
+    }
+    if (fd < 0)
+    {
+        fd = phev_pipe_connectingSocket(session->pipe);
+        connecting = (fd >= 0);
+    }
+    if (fd != session->fd || connecting != session->connecting || session->connections != session->pipe->connections)
+    {
+        LOG_D(APP_TAG, "Pipe %p socket now %d%s", (void *) session->pipe, fd, (connecting ? " connecting" : ""));
+        session->connections = session->pipe->connections;
+        phev_reactor_watch(reactor, session, fd, connecting);
+    }
+}
+static void phev_reactor_stepSession(phevReactor_t *reactor, phevReactorSession_t *session, bool readable)
+{
+    phev_pipe_step(session->pipe, readable);
+    phev_reactor_follow(reactor, session);
+}
+// A pipe that has dropped its connection or has submitted commands needs stepping straight away
+static bool phev_reactor_needsStep(phev_pipe_ctx_t *pipe)
+{
+    if (phev_pipe_commandsPending(pipe))
+    {
+        return true;
+    }
+    return !(pipe->pipe->in->connected && pipe->pipe->out->connected) && !phev_timer_active(&pipe->reconnectTimer);
+}
+phevReactor_t *phev_reactor_create(size_t capacity)
+{
+    LOG_V(APP_TAG, "START - create");
+
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll < 0)
+    {
+        LOG_E(APP_TAG, "Cannot create epoll instance errno %d", errno);
+        return NULL;
+    }
+
+    phevReactor_t *reactor = malloc(sizeof(phevReactor_t));
+
+    reactor->sessions = calloc(capacity, sizeof(phevReactorSession_t));
+    reactor->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (reactor->sessions == NULL || reactor->wakeFd < 0)
+    {
+        LOG_E(APP_TAG, "Cannot create reactor for %zu sessions errno %d", capacity, errno);
+        if (reactor->wakeFd >= 0)
+        {
+            close(reactor->wakeFd);
+        }
+        close(epoll);
+        free(reactor->sessions);
+        free(reactor);
+        return NULL;
+    }
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = NULL,
+    };
+
+    epoll_ctl(epoll, EPOLL_CTL_ADD, reactor->wakeFd, &event);
+
+    for (size_t i = 0; i < capacity; i++)
+    {
+        reactor->sessions[i].fd = -1;
+    }
+    reactor->epoll = epoll;
+    reactor->capacity = capacity;
+    reactor->numberOfSessions = 0;
+    atomic_init(&reactor->running, false);
+
+    LOG_V(APP_TAG, "END - create");
+
+    return reactor;
+}
+void phev_reactor_destroy(phevReactor_t *reactor)
+{
+    if (reactor == NULL)
+    {
+        return;
+    }
+    close(reactor->wakeFd);
+    close(reactor->epoll);
+    free(reactor->sessions);
+    free(reactor);
+}
+int phev_reactor_add(phevReactor_t *reactor, phev_pipe_ctx_t *pipe, int fd)
+{
+    LOG_V(APP_TAG, "START - add");
+
+    if (phev_reactor_findSession(reactor, pipe) != NULL)
+    {
+        LOG_E(APP_TAG, "Pipe already added");
+        return -1;
+    }
+
+    for (size_t i = 0; i < reactor->capacity; i++)
+    {
+        phevReactorSession_t *session = &reactor->sessions[i];
+
+        if (!session->used)
+        {
+            session->fd = -1;
+            if (phev_reactor_watch(reactor, session, fd, false) < 0)
+            {
+                return -1;
+            }
+            session->pipe = pipe;
+            session->connections = pipe->connections;
+            session->used = true;
+            reactor->numberOfSessions++;
+
+            LOG_D(APP_TAG, "Added pipe %p socket %d as session %zu", (void *) pipe, fd, i);
+            LOG_V(APP_TAG, "END - add");
+
+            return 0;
+        }
+    }
+
+    LOG_E(APP_TAG, "No free sessions, capacity %zu", reactor->capacity);
+
+    return -1;
+}
+int phev_reactor_setSocket(phevReactor_t *reactor, phev_pipe_ctx_t *pipe, int fd)
+{
+    phevReactorSession_t *session = phev_reactor_findSession(reactor, pipe);
+
+    if (session == NULL)
+    {
+        LOG_E(APP_TAG, "Pipe not found");
+        return -1;
+    }
+    return phev_reactor_watch(reactor, session, fd, false);
+}
+int phev_reactor_remove(phevReactor_t *reactor, phev_pipe_ctx_t *pipe)
+{
+    phevReactorSession_t *session = phev_reactor_findSession(reactor, pipe);
+
+    if (session == NULL)
+    {
+        LOG_E(APP_TAG, "Pipe not found");
+        return -1;
+    }
+    phev_reactor_watch(reactor, session, -1, false);
+    phev_pipe_abortConnect(pipe);
+    session->pipe = NULL;
+    session->used = false;
+    reactor->numberOfSessions--;
+
+    return 0;
+}
+uint64_t phev_reactor_nextTimeout(phevReactor_t *reactor)
+{
+    uint64_t next = PHEV_TIMER_NEVER;
+
+    for (size_t i = 0; i < reactor->capacity; i++)
+    {
+        phevReactorSession_t *session = &reactor->sessions[i];
+
+        if (!session->used)
+        {
+            continue;
+        }
+        if (phev_reactor_needsStep(session->pipe))
+        {
+            return 0;
+        }
+
+        uint64_t timeout = phev_pipe_nextTimeout(session->pipe);
+
+        if (timeout < next)
+        {
+            next = timeout;
+        }
+    }
+
+    return next;
+}
+int phev_reactor_step(phevReactor_t *reactor, int maxWait)
+{
+    struct epoll_event events[PHEV_REACTOR_MAX_EVENTS];
+    uint64_t timeout = phev_reactor_nextTimeout(reactor);
+
+    if (maxWait >= 0 && timeout > (uint64_t) maxWait)
+    {
+        timeout = (uint64_t) maxWait;
+    }
+
+    int ready = epoll_wait(reactor->epoll, events, PHEV_REACTOR_MAX_EVENTS, (timeout == PHEV_TIMER_NEVER ? -1 : (int) timeout));
+
+    if (ready < 0)
+    {
+        if (errno != EINTR)
+        {
+            LOG_E(APP_TAG, "epoll_wait failed errno %d", errno);
+            return -1;
+        }
+        ready = 0;
+    }
+
+    int stepped = 0;
+
+    for (int i = 0; i < ready; i++)
+    {
+        if (events[i].data.ptr == NULL)
+        {
+            uint64_t count;
+
+            if (read(reactor->wakeFd, &count, sizeof(count)) < 0)
+            {
+                LOG_E(APP_TAG, "Cannot clear wake up errno %d", errno);
+            }
+            continue;
+        }
+
+        phevReactorSession_t *session = (phevReactorSession_t *) events[i].data.ptr;
+
+        if (!session->used)
+        {
+            continue;
+        }
+        if (!session->connecting && (events[i].events & EPOLLIN) == 0 && (events[i].events & (EPOLLHUP | EPOLLERR)) != 0)
+        {
+            // Level triggered, so stop watching a dead socket or it is reported on every wait. A failed connect is
+            // left to the pipe, which closes it and backs off.
+            LOG_W(APP_TAG, "Socket %d closed", session->fd);
+            phev_reactor_watch(reactor, session, -1, false);
+            phev_pipe_disconnectOutput(session->pipe);
+        }
+        else
+        {
+            phev_reactor_stepSession(reactor, session, true);
+        }
+        stepped++;
+    }
+
+    // Sessions whose timers are due, a session stepped above has already advanced its own
+    uint64_t now = phev_timer_now();
+
+    for (size_t i = 0; i < reactor->capacity; i++)
+    {
+        phevReactorSession_t *session = &reactor->sessions[i];
+
+        if (session->used && (phev_timer_nextDeadline(&session->pipe->timers) <= now || phev_reactor_needsStep(session->pipe)))
+        {
+            phev_reactor_stepSession(reactor, session, false);
+            stepped++;
+        }
+    }
+
+    return stepped;
+}
+void phev_reactor_run(phevReactor_t *reactor)
+{
+    LOG_V(APP_TAG, "START - run");
+
+    atomic_store(&reactor->running, true);
+
+    while (atomic_load(&reactor->running))
+    {
+        if (phev_reactor_step(reactor, PHEV_REACTOR_MAX_WAIT) < 0)
+        {
+            break;
+        }
+    }
+    atomic_store(&reactor->running, false);
+
+    LOG_V(APP_TAG, "END - run");
+}
+void phev_reactor_stop(phevReactor_t *reactor)
+{
+    uint64_t one = 1;
+
+    atomic_store(&reactor->running, false);
+
+    if (write(reactor->wakeFd, &one, sizeof(one)) < 0)
+    {
+        LOG_E(APP_TAG, "Cannot wake reactor errno %d", errno);
+    }
+}
+#endif
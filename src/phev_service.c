@@ -2,6 +2,8 @@
 #define _GNU_SOURCE 1
 #endif
 #include <stdint.h>
+#include <string.h>
+#include <ctype.h>
 #include "phev_pipe.h"
 #include "phev_service.h"
 #include "msg_utils.h"
@@ -56,17 +58,18 @@ phevServiceCtx_t *phev_service_create(phevServiceSettings_t settings)
     LOG_V(TAG, "START - create");
     phevServiceCtx_t *ctx = NULL;
 
-    if(settings.my18)
-    {
-        phev_core_my18 = true;
-    }
-
     ctx = phev_service_init(settings.in, settings.out,settings.registerDevice);
 
+    ctx->my18 = settings.my18;
     ctx->yieldHandler = settings.yieldHandler;
     ctx->exit = false;
     ctx->ctx = settings.ctx;
     ctx->registrationCompleteCallback = NULL;
+    ctx->socketHandler = settings.socketHandler;
+    ctx->pipe->socketHandler = settings.socketHandler;
+    ctx->connectHandler = settings.connectHandler;
+    ctx->pipe->connectHandler = settings.connectHandler;
+    phev_service_setOutputFormat(ctx, settings.outputFormat);
     if (settings.mac)
     {
         memcpy(ctx->mac, settings.mac, 6);
@@ -107,6 +110,8 @@ void phev_service_start(phevServiceCtx_t *ctx)
             ctx->yieldHandler(ctx);
         }
     }
+    // Nothing steps the pipe any more so drop a connect it still has in progress
+    phev_pipe_abortConnect(ctx->pipe);
     LOG_V(TAG, "END - start");
 }
 phevServiceCtx_t *phev_service_init(messagingClient_t *in, messagingClient_t *out, bool registerDevice)
@@ -118,18 +123,37 @@ phevServiceCtx_t *phev_service_init(messagingClient_t *in, messagingClient_t *ou
     LOG_D(TAG, "Creating model and pipe");
     ctx->model = phev_model_create();
     ctx->registerDevice = registerDevice;
+    ctx->my18 = false;
+    ctx->statusJson = NULL;
+    ctx->statusVersion = 0;
+    pthread_mutex_init(&ctx->statusLock, NULL);
+    ctx->outputFormat = PHEV_SERVICE_OUTPUT_JSON;
+    ctx->socketHandler = NULL;
+    ctx->connectHandler = NULL;
+    memset(ctx->frameFingerprints, 0, sizeof(ctx->frameFingerprints));
     ctx->pipe = phev_service_createPipe(ctx, in, out);
     ctx->pipe->ctx = ctx;
 
     LOG_V(TAG, "END - init");
     return ctx;
 }
+static phevMessage_t *phev_service_commandToPhevMessage(const cJSON *json);
+
+// Split commands are carried as the tag, the register and the value bytes, ready to queue on the pipe
+static message_t *phev_service_commandToMessage(const phevMessage_t *phevMessage)
+{
+    uint8_t data[PHEV_SERVICE_SPLIT_COMMAND_HEADER_SIZE + UINT8_MAX];
+
+    data[0] = PHEV_SERVICE_SPLIT_COMMAND_TAG;
+    data[1] = phevMessage->reg;
+    memcpy(&data[PHEV_SERVICE_SPLIT_COMMAND_HEADER_SIZE], phevMessage->data, phevMessage->length);
+
+    return msg_utils_createMsg(data, (size_t) phevMessage->length + PHEV_SERVICE_SPLIT_COMMAND_HEADER_SIZE);
+}
 messageBundle_t *phev_service_inputSplitter(void *ctx, message_t *message)
 {
     LOG_V(TAG, "START - inputSplitter");
 
-    messageBundle_t *messages = malloc(sizeof(messageBundle_t));
-    messages->numMessages = 0;
     cJSON *command = NULL;
 
     cJSON *json = cJSON_Parse((char *)message->data);
@@ -145,15 +169,37 @@ messageBundle_t *phev_service_inputSplitter(void *ctx, message_t *message)
     if (!requests)
     {
         LOG_W(TAG, "Not valid JSON requests");
+        cJSON_Delete(json);
         return NULL;
     }
 
+    messageBundle_t *messages = malloc(sizeof(messageBundle_t));
+    const size_t maxMessages = sizeof(messages->messages) / sizeof(messages->messages[0]);
+
+    messages->numMessages = 0;
+
     cJSON_ArrayForEach(command, requests)
     {
-        const char *out = cJSON_Print(command);
-        messages->messages[messages->numMessages++] = msg_utils_createMsg((uint8_t *)out, strlen(out) + 1);
+        if ((size_t) messages->numMessages >= maxMessages)
+        {
+            LOG_W(TAG, "Too many requests, only the first %zu are sent", maxMessages);
+            break;
+        }
+
+        phevMessage_t *phevMessage = phev_service_commandToPhevMessage(command);
+
+        if (phevMessage == NULL || phevMessage->length == 0)
+        {
+            LOG_W(TAG, "Invalid command in requests");
+            phev_core_destroyMessage(phevMessage);
+            continue;
+        }
+        messages->messages[messages->numMessages++] = phev_service_commandToMessage(phevMessage);
+        phev_core_destroyMessage(phevMessage);
     }
 
+    cJSON_Delete(json);
+
     LOG_V(TAG, "END - inputSplitter");
 
     return messages;
@@ -189,6 +235,25 @@ void phev_service_bufferDump(const uint8_t * buffer, const size_t length)
     }
     printf("\n");
 }
+static uint64_t phev_service_frameHash(const uint8_t *data, const size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+static void phev_service_sendFilteredEvent(phev_pipe_ctx_t *ctx)
+{
+    phevPipeEvent_t *event = malloc(sizeof(phevPipeEvent_t));
+    event->data = NULL;
+    event->event = PHEV_PIPE_FILTERED_MESSAGE;
+    event->length = 0;
+    phev_pipe_sendEventToHandlers(ctx, event);
+}
 bool phev_service_outputFilter(void *ctx, message_t *message)
 {
     LOG_V(TAG, "START - outputFilter");
@@ -197,58 +262,64 @@ bool phev_service_outputFilter(void *ctx, message_t *message)
     LOG_BUFFER_HEXDUMP(TAG,message->data,message->length,LOG_DEBUG);
 
     phevServiceCtx_t *serviceCtx = ((phev_pipe_ctx_t *)ctx)->ctx;
+    phevServiceFrameFingerprint_t *fingerprint = NULL;
+    uint64_t hash = 0;
+
+    if (message->length > 3)
+    {
+        fingerprint = &serviceCtx->frameFingerprints[message->data[3]];
+        hash = phev_service_frameHash(message->data, message->length);
+
+        if (fingerprint->version != 0 && fingerprint->hash == hash && fingerprint->version == phev_model_registerVersion(serviceCtx->model, fingerprint->reg))
+        {
+            LOG_D(TAG, "Repeated frame for Reg %02X", fingerprint->reg);
+            phev_service_sendFilteredEvent((phev_pipe_ctx_t *) ctx);
+            LOG_V(TAG, "END - outputFilter");
+            return false;
+        }
+    }
 
-    phevMessage_t phevMessage;
+    phevMessageView_t view;
+    phevMessage_t *phevMessage = phev_core_getDecodedMessage(message, &view);
 
-    phev_core_decodeMessage(message->data, message->length, &phevMessage);
+    if (phevMessage == NULL)
+    {
+        LOG_E(TAG, "Invalid message received");
+        return false;
+    }
 
-    if ((phevMessage.command == PING_RESP_CMD )|| (phevMessage.command == START_RESP))
+    if ((phevMessage->command == PING_RESP_CMD )|| (phevMessage->command == START_RESP))
     {
         LOG_D(TAG, "Not sending ping or start response");
-        free(phevMessage.data);
         return true;
     }
-    LOG_D(TAG, "Reg %d", phevMessage.reg);
+    LOG_D(TAG, "Reg %d", phevMessage->reg);
 
-    if (phevMessage.command == RESP_CMD && phevMessage.type == REQUEST_TYPE)
+    if (phevMessage->command == RESP_CMD && phevMessage->type == REQUEST_TYPE)
     {
-        phevRegister_t *reg = phev_model_getRegister(serviceCtx->model, phevMessage.reg);
+        int same = phev_model_compareRegisterData(serviceCtx->model, phevMessage->reg, phevMessage->data, phevMessage->length);
 
-        if (reg)
+        if (same != 0)
         {
-            LOG_D(TAG, "Register has previously been set Reg %02X",phevMessage.reg);
-            LOG_D(TAG,"Register Data len is %zu and data",reg->length);
-            LOG_BUFFER_HEXDUMP(TAG,reg->data,reg->length,LOG_DEBUG);
+            LOG_D(TAG, "Setting Reg %d", phevMessage->reg);
 
-            int same = phev_model_compareRegister(serviceCtx->model, phevMessage.reg, phevMessage.data);
-            if (same != 0)
-            {
-                LOG_D(TAG, "Setting Reg %d", phevMessage.reg);
-
-                phev_model_setRegister(serviceCtx->model, phevMessage.reg, phevMessage.data, phevMessage.length);
-
-                free(phevMessage.data);
-
-                return true;
-            }
-            LOG_D(TAG, "Is same %d", same);
-            free(phevMessage.data);
-            phevPipeEvent_t *event = malloc(sizeof(phevPipeEvent_t));
-            event->data = NULL;
-            event->event = PHEV_PIPE_FILTERED_MESSAGE;
-            event->length = 0;
-            phev_pipe_sendEventToHandlers((phev_pipe_ctx_t *) ctx, event);
-
-            return false;
+            phev_model_setRegister(serviceCtx->model, phevMessage->reg, phevMessage->data, phevMessage->length);
         }
-        else
+
+        if (fingerprint)
         {
-            LOG_D(TAG, "Setting Reg %d", phevMessage.reg);
+            fingerprint->hash = hash;
+            fingerprint->reg = phevMessage->reg;
+            fingerprint->version = phev_model_registerVersion(serviceCtx->model, phevMessage->reg);
+        }
 
-            phev_model_setRegister(serviceCtx->model, phevMessage.reg, phevMessage.data, phevMessage.length);
+        if (same == 0)
+        {
+            LOG_D(TAG, "Register %02X not changed", phevMessage->reg);
+            phev_service_sendFilteredEvent((phev_pipe_ctx_t *) ctx);
+            return false;
         }
     }
-    free(phevMessage.data);
 
     LOG_V(TAG, "END - outputFilter");
 
@@ -262,19 +333,21 @@ phev_pipe_ctx_t *phev_service_createPipe(phevServiceCtx_t *ctx, messagingClient_
         .ctx = ctx,
         .in = in,
         .out = out,
-        .inputInputTransformer = phev_service_jsonInputTransformer,
+        .inputInputTransformer = phev_service_commandInputTransformer,
         .inputOutputTransformer = NULL,
         .inputSplitter = phev_service_inputSplitter,
         .inputAggregator = NULL,
-        .outputAggregator = phev_service_jsonResponseAggregator,
+        .outputAggregator = (ctx->outputFormat == PHEV_SERVICE_OUTPUT_BINARY ? phev_service_binaryResponseAggregator : phev_service_jsonResponseAggregator),
         .outputSplitter = phev_pipe_outputSplitter,
         .outputFilter = phev_service_outputFilter,
         .inputResponder = NULL,
         .outputResponder = phev_pipe_commandResponder,
         .preConnectHook = NULL,
         .outputInputTransformer = phev_pipe_outputChainInputTransformer,
-        .outputOutputTransformer = phev_service_jsonOutputTransformer,
+        .outputOutputTransformer = (ctx->outputFormat == PHEV_SERVICE_OUTPUT_BINARY ? phev_service_binaryOutputTransformer : phev_service_jsonOutputTransformer),
         .registerDevice = ctx->registerDevice,
+        .socketHandler = ctx->socketHandler,
+        .connectHandler = ctx->connectHandler,
     };
 
     phev_pipe_ctx_t *pipe = phev_pipe_createPipe(settings);
@@ -356,15 +429,8 @@ bool phev_service_validateCheckOnOrOff(const char *str)
 
     return false;
 }
-bool phev_service_validateCommand(const char *command)
+static bool phev_service_validateCommandJson(const cJSON *json)
 {
-    cJSON *json = cJSON_Parse(command);
-
-    if (json == NULL)
-    {
-        return false;
-    }
-
     cJSON *update = cJSON_GetObjectItemCaseSensitive(json, PHEV_SERVICE_UPDATE_REGISTER_JSON);
 
     cJSON *operation = cJSON_GetObjectItemCaseSensitive(json, PHEV_SERVICE_OPERATION_JSON);
@@ -425,6 +491,21 @@ bool phev_service_validateCommand(const char *command)
 
     return false;
 }
+bool phev_service_validateCommand(const char *command)
+{
+    cJSON *json = cJSON_Parse(command);
+
+    if (json == NULL)
+    {
+        return false;
+    }
+
+    bool valid = phev_service_validateCommandJson(json);
+
+    cJSON_Delete(json);
+
+    return valid;
+}
 phevMessage_t *phev_service_updateRegisterHandler(cJSON *update)
 {
     if (update == NULL)
@@ -464,11 +545,16 @@ phevMessage_t *phev_service_updateRegisterHandler(cJSON *update)
             else
             {
                 LOG_W(TAG, "Update register has invalid value");
+                free(data);
                 return NULL;
             }
         }
 
-        return phev_core_commandMessage(reg->valueint, data, size);
+        phevMessage_t *message = phev_core_commandMessage(reg->valueint, data, size);
+
+        free(data);
+
+        return message;
     }
     else
     {
@@ -534,32 +620,55 @@ phevMessage_t *phev_service_operationHandler(cJSON *operation)
 
     return NULL;
 }
-phevMessage_t *phev_service_jsonCommandToPhevMessage(const char *command)
+static phevMessage_t *phev_service_commandToPhevMessage(const cJSON *json)
 {
-    if (phev_service_validateCommand(command))
+    if (!phev_service_validateCommandJson(json))
     {
-        cJSON *json = cJSON_Parse(command);
+        return NULL;
+    }
 
-        cJSON *update = cJSON_GetObjectItemCaseSensitive(json, PHEV_SERVICE_UPDATE_REGISTER_JSON);
+    cJSON *update = cJSON_GetObjectItemCaseSensitive(json, PHEV_SERVICE_UPDATE_REGISTER_JSON);
 
-        cJSON *operation = cJSON_GetObjectItemCaseSensitive(json, PHEV_SERVICE_OPERATION_JSON);
+    cJSON *operation = cJSON_GetObjectItemCaseSensitive(json, PHEV_SERVICE_OPERATION_JSON);
 
-        if (update)
-        {
-            return phev_service_updateRegisterHandler(update);
-        }
-        if (operation)
-        {
-            return phev_service_operationHandler(operation);
-        }
+    if (update)
+    {
+        return phev_service_updateRegisterHandler(update);
     }
-    else
+    if (operation)
     {
-        return NULL;
+        return phev_service_operationHandler(operation);
     }
     return NULL;
 }
+phevMessage_t *phev_service_jsonCommandToPhevMessage(const char *command)
+{
+    cJSON *json = cJSON_Parse(command);
 
+    if (json == NULL)
+    {
+        return NULL;
+    }
+
+    phevMessage_t *message = phev_service_commandToPhevMessage(json);
+
+    cJSON_Delete(json);
+
+    return message;
+}
+
+static void phev_service_sendCommand(phev_pipe_ctx_t *pipeCtx, const uint8_t reg, const uint8_t *data, const size_t length)
+{
+    LOG_I(TAG,"Phev command reg %02X length %02zX",reg,length);
+    if(length == 1)
+    {
+        phev_pipe_updateRegister(pipeCtx,reg,data[0]);
+    }
+    else
+    {
+        phev_pipe_updateComplexRegister(pipeCtx,reg,data,length);
+    }
+}
 message_t *phev_service_jsonInputTransformer(void *ctx, message_t *message)
 {
     phev_pipe_ctx_t * pipeCtx = (phev_pipe_ctx_t *) ctx;
@@ -572,236 +681,213 @@ message_t *phev_service_jsonInputTransformer(void *ctx, message_t *message)
             return NULL;
         }
         phevMessage_t *phevMessage = phev_service_jsonCommandToPhevMessage((char *)message->data);
-        if (phevMessage)
-        {
-            //message_t *out = phev_core_convertToMessage(phevMessage);
-            //message_t *encoded = phev_core_XOROutboundMessage(out,pipeCtx->commandXOR);
-            //if (encoded)
-            //{
 
-            LOG_I(TAG,"Phev message command %02X reg %02X type %02X length %02X",phevMessage->command,phevMessage->reg,phevMessage->type,phevMessage->length);
-            if(phevMessage->length == 1)
-            {
-                phev_pipe_updateRegister(pipeCtx,phevMessage->reg,phevMessage->data[0]);
-            }
-            else
-            {
-                phev_pipe_updateComplexRegister(pipeCtx,phevMessage->reg,phevMessage->data,phevMessage->length);
-            }
-            return NULL;//encoded;
-        //    }
+        if (phevMessage && phevMessage->length > 0)
+        {
+            phev_service_sendCommand(pipeCtx,phevMessage->reg,phevMessage->data,phevMessage->length);
         }
+        phev_core_destroyMessage(phevMessage);
     }
     return NULL;
 }
-
-cJSON *phev_service_updatedRegister(cJSON *json, phevMessage_t *phevMessage)
+message_t *phev_service_commandInputTransformer(void *ctx, message_t *message)
 {
-    cJSON *updatedRegister = cJSON_CreateObject();
-    if (updatedRegister == NULL)
-    {
-        return NULL;
-    }
-
-    cJSON_AddItemToObject(json, PHEV_SERVICE_UPDATED_REGISTER_JSON, updatedRegister);
+    phev_pipe_ctx_t * pipeCtx = (phev_pipe_ctx_t *) ctx;
 
-    cJSON *reg = cJSON_CreateNumber(phevMessage->reg);
-    if (reg == NULL)
+    // The splitter has already validated and converted the command to a register and its value
+    if (message == NULL || message->length <= PHEV_SERVICE_SPLIT_COMMAND_HEADER_SIZE || message->data[0] != PHEV_SERVICE_SPLIT_COMMAND_TAG)
     {
+        LOG_W(TAG,"Not a split command, dropped");
         return NULL;
     }
-
-    cJSON_AddItemToObject(updatedRegister, "register", reg);
-
-    cJSON *length = cJSON_CreateNumber(phevMessage->length);
-    if (length == NULL)
+    if(!pipeCtx->connected)
     {
+        LOG_W(TAG,"Not sending command as not connected");
         return NULL;
     }
+    phev_service_sendCommand(pipeCtx,message->data[1],&message->data[PHEV_SERVICE_SPLIT_COMMAND_HEADER_SIZE],message->length - PHEV_SERVICE_SPLIT_COMMAND_HEADER_SIZE);
 
-    cJSON_AddItemToObject(updatedRegister, "length", length);
+    return NULL;
+}
 
-    cJSON *data = cJSON_CreateArray();
-    if (data == NULL)
-    {
-        return NULL;
-    }
-    cJSON_AddItemToObject(updatedRegister, "data", data);
+// Writes the compact json for a register frame straight into a buffer, the frame length is a byte so the buffer
+// never needs to be bigger than PHEV_SERVICE_OUTPUT_BUFFER_SIZE
+typedef struct phevServiceJsonWriter_t
+{
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} phevServiceJsonWriter_t;
 
-    for (int i = 0; i < phevMessage->length; i++)
+static void phev_service_writeRaw(phevServiceJsonWriter_t *writer, const char *str, size_t length)
+{
+    if (writer->length + length > writer->size)
     {
-        cJSON *item = cJSON_CreateNumber(phevMessage->data[i]);
-        if (item == NULL)
-        {
-            return NULL;
-        }
-        cJSON_AddItemToArray(data, item);
+        writer->overflow = true;
+        return;
     }
-    cJSON *xor = cJSON_CreateNumber(phevMessage->XOR);
-    if (xor == NULL)
+    // Without a buffer the writer only measures
+    if (writer->buffer)
     {
-        return NULL;
+        memcpy(writer->buffer + writer->length, str, length);
     }
-
-    cJSON_AddItemToObject(updatedRegister, "xor", xor);
-
-
-    return json;
+    writer->length += length;
 }
-cJSON *phev_service_updateRegisterAck(cJSON *json, phevMessage_t *phevMessage)
+static void phev_service_writeString(phevServiceJsonWriter_t *writer, const char *str)
 {
-    cJSON *updatedRegisterAck = cJSON_CreateObject();
-    if (updatedRegisterAck == NULL)
-    {
-        return NULL;
-    }
-
-    cJSON_AddItemToObject(json, PHEV_SERVICE_UPDATED_REGISTER_ACK_JSON, updatedRegisterAck);
-
-    cJSON *reg = cJSON_CreateNumber(phevMessage->reg);
-    if (reg == NULL)
-    {
-        return NULL;
-    }
-
-    cJSON_AddItemToObject(updatedRegisterAck, "register", reg);
-
-    cJSON *xor = cJSON_CreateNumber(phevMessage->XOR);
-    if (xor == NULL)
-    {
-        return NULL;
-    }
-
-    cJSON_AddItemToObject(updatedRegisterAck, "xor", xor);
-
-    return json;
+    phev_service_writeRaw(writer, str, strlen(str));
 }
-cJSON * phev_service_sendStart(cJSON *json, phevMessage_t *phevMessage)
+static void phev_service_writeNumber(phevServiceJsonWriter_t *writer, uint32_t num)
 {
-    cJSON *startMessage = cJSON_CreateObject();
-    if (startMessage == NULL)
-    {
-        return NULL;
-    }
-
-    cJSON_AddItemToObject(json, PHEV_SERVICE_START_MESSAGE_JSON, startMessage);
+    char digits[10];
+    size_t i = sizeof(digits);
 
-    cJSON *length = cJSON_CreateNumber(phevMessage->length);
-    if (length == NULL)
+    do
     {
-        return NULL;
-    }
-    cJSON_AddItemToObject(startMessage, "length", length);
-
-    cJSON *data = cJSON_CreateArray();
-    if (data == NULL)
-    {
-        return NULL;
-    }
-    cJSON_AddItemToObject(startMessage, "data", data);
+        digits[--i] = (char) ('0' + (num % 10));
+        num /= 10;
+    } while (num > 0);
 
+    phev_service_writeRaw(writer, &digits[i], sizeof(digits) - i);
+}
+static void phev_service_writeKey(phevServiceJsonWriter_t *writer, const char *key)
+{
+    phev_service_writeRaw(writer, "\"", 1);
+    phev_service_writeString(writer, key);
+    phev_service_writeRaw(writer, "\":", 2);
+}
+static void phev_service_writeData(phevServiceJsonWriter_t *writer, const phevMessage_t *phevMessage)
+{
+    phev_service_writeKey(writer, "length");
+    phev_service_writeNumber(writer, phevMessage->length);
+    phev_service_writeRaw(writer, ",", 1);
+    phev_service_writeKey(writer, "data");
+    phev_service_writeRaw(writer, "[", 1);
     for (int i = 0; i < phevMessage->length; i++)
     {
-        cJSON *item = cJSON_CreateNumber(phevMessage->data[i]);
-        if (item == NULL)
+        if (i > 0)
         {
-            return NULL;
+            phev_service_writeRaw(writer, ",", 1);
         }
-        cJSON_AddItemToArray(data, item);
+        phev_service_writeNumber(writer, phevMessage->data[i]);
     }
-
-    return json;
+    phev_service_writeRaw(writer, "]", 1);
 }
-message_t *phev_service_jsonOutputTransformer(void *ctx, message_t *message)
+static bool phev_service_writeMessage(phevServiceJsonWriter_t *writer, const phevMessage_t *phevMessage, const char *time)
 {
-    LOG_V(TAG, "START - jsonOutputTransformer");
-
-    phevServiceCtx_t *serviceCtx = NULL;
-
-    if (ctx != NULL)
-    {
-        serviceCtx = ((phev_pipe_ctx_t *)ctx)->ctx;
-
-        message_t * ret = phev_pipe_outputEventTransformer(ctx, message);
-        msg_utils_destroyMsg(ret);
-    }
-    phevMessage_t *phevMessage = malloc(sizeof(phevMessage_t));
-
-    phev_core_decodeMessage(message->data, message->length, phevMessage);
-    char *output;
-    cJSON *out = NULL;
-
-    //msg_utils_destroyMsg(message);
-    cJSON *response = cJSON_CreateObject();
-
-    if (response == NULL)
-    {
-        phev_core_destroyMessage(phevMessage);
-        return NULL;
-    }
+    phev_service_writeRaw(writer, "{", 1);
 
-    switch(phevMessage->command)
+    switch (phevMessage->command)
     {
     case 0x4e:
     case 0x5e:
     {
-        out = phev_service_sendStart(response, phevMessage);
+        phev_service_writeKey(writer, PHEV_SERVICE_START_MESSAGE_JSON);
+        phev_service_writeRaw(writer, "{", 1);
+        phev_service_writeData(writer, phevMessage);
         break;
     }
     case 0x6f:
     {
         if (phevMessage->type == REQUEST_TYPE)
         {
-            out = phev_service_updatedRegister(response, phevMessage);
+            phev_service_writeKey(writer, PHEV_SERVICE_UPDATED_REGISTER_JSON);
+            phev_service_writeRaw(writer, "{", 1);
+            phev_service_writeKey(writer, "register");
+            phev_service_writeNumber(writer, phevMessage->reg);
+            phev_service_writeRaw(writer, ",", 1);
+            phev_service_writeData(writer, phevMessage);
         }
         else
         {
-            out = phev_service_updateRegisterAck(response, phevMessage);
+            phev_service_writeKey(writer, PHEV_SERVICE_UPDATED_REGISTER_ACK_JSON);
+            phev_service_writeRaw(writer, "{", 1);
+            phev_service_writeKey(writer, "register");
+            phev_service_writeNumber(writer, phevMessage->reg);
         }
+        phev_service_writeRaw(writer, ",", 1);
+        phev_service_writeKey(writer, "xor");
+        phev_service_writeNumber(writer, phevMessage->XOR);
         break;
     }
     default:
     {
-        cJSON_Delete(response);
-        phev_core_destroyMessage(phevMessage);
-        return NULL;
+        return false;
     }
     }
 
-    if (!out)
+    phev_service_writeRaw(writer, "},", 2);
+    phev_service_writeKey(writer, "time");
+    phev_service_writeRaw(writer, "\"", 1);
+    phev_service_writeString(writer, time);
+    phev_service_writeRaw(writer, "\"}", 2);
+
+    return !writer->overflow;
+}
+message_t *phev_service_jsonOutputTransformer(void *ctx, message_t *message)
+{
+    LOG_V(TAG, "START - jsonOutputTransformer");
+
+    phevServiceCtx_t *serviceCtx = NULL;
+    char localBuffer[PHEV_SERVICE_OUTPUT_BUFFER_SIZE];
+
+    if (ctx != NULL)
     {
-        cJSON_Delete(response);
-        phev_core_destroyMessage(phevMessage);
+        serviceCtx = ((phev_pipe_ctx_t *)ctx)->ctx;
+
+        message_t * ret = phev_pipe_outputEventTransformer(ctx, message);
+        msg_utils_destroyMsg(ret);
+    }
+    phevMessageView_t view;
+    phevMessage_t *phevMessage = phev_core_getDecodedMessage(message, &view);
+
+    if (phevMessage == NULL)
+    {
+        LOG_E(TAG, "Invalid message received");
         return NULL;
     }
 
     time_t now;
-    struct tm *timeinfo;
     time(&now);
 
     char buf[21];
     strftime(buf, sizeof buf, "%FT%TZ", gmtime(&now));
 
-    cJSON * time = cJSON_CreateString(buf);
-
-    cJSON_AddItemToObject(out, "time", time);
+    phevServiceJsonWriter_t writer = {
+        .buffer = (serviceCtx ? serviceCtx->outputBuffer : localBuffer),
+        .size = PHEV_SERVICE_OUTPUT_BUFFER_SIZE,
+        .length = 0,
+        .overflow = false,
+    };
 
-    output = cJSON_Print(out);
+    if (!phev_service_writeMessage(&writer, phevMessage, buf))
+    {
+        if (writer.overflow)
+        {
+            LOG_E(TAG, "Output buffer too small for register %d", phevMessage->reg);
+        }
+        LOG_V(TAG, "END - jsonOutputTransformer");
+        return NULL;
+    }
 
-    message_t *outputMessage = msg_utils_createMsg((uint8_t *)output, strlen(output) );
+    message_t *outputMessage = msg_utils_createMsg((uint8_t *)writer.buffer, writer.length);
     LOG_BUFFER_HEXDUMP(TAG, outputMessage->data, outputMessage->length, LOG_DEBUG);
-    cJSON_Delete(response);
-    phev_core_destroyMessage(phevMessage);
-    free(output);
     LOG_V(TAG, "END - jsonOutputTransformer");
 
     return outputMessage;
 }
+// The getters are called from other threads than the pipe loop, so they work on a copy of the register
+static const phevRegister_t *phev_service_readRegister(const phevServiceCtx_t *ctx, uint8_t reg, phevRegister_t *copy)
+{
+    return (phev_model_readRegister(ctx->model, reg, copy) && copy->length > 0 ? copy : NULL);
+}
 int phev_service_getBatteryLevel(phevServiceCtx_t *ctx)
 {
     LOG_V(TAG, "START - getBatteryLevel");
 
-    phevRegister_t *reg = phev_model_getRegister(ctx->model, KO_WF_BATT_LEVEL_INFO_REP_EVR);
+    phevRegister_t copy;
+    const phevRegister_t *reg = phev_service_readRegister(ctx, KO_WF_BATT_LEVEL_INFO_REP_EVR, &copy);
 
     LOG_V(TAG, "END - getBatteryLevel");
     return (reg ? (int )reg->data[0] : -1);
@@ -811,7 +897,8 @@ int phev_service_getBatteryWarning(phevServiceCtx_t *ctx)
 {
     LOG_V(TAG, "START - getBatteryWarning");
 
-    phevRegister_t *reg = phev_model_getRegister(ctx->model, KO_WF_CHG_GUN_STATUS_EVR);
+    phevRegister_t copy;
+    const phevRegister_t *reg = phev_service_readRegister(ctx, KO_WF_CHG_GUN_STATUS_EVR, &copy);
 
     LOG_V(TAG, "END - getBatteryWarning");
     return (reg ? (int )reg->data[2] : -1);
@@ -821,7 +908,8 @@ int phev_service_getACError(phevServiceCtx_t *ctx)
 {
     LOG_V(TAG, "START - getAccWarning");
 
-    phevRegister_t *reg = phev_model_getRegister(ctx->model, 16);
+    phevRegister_t copy;
+    const phevRegister_t *reg = phev_service_readRegister(ctx, 16, &copy);
 
     LOG_V(TAG, "END - getAccWarning");
     return (reg ? (int )reg->data[0] : -1);
@@ -831,27 +919,47 @@ int phev_service_doorIsLocked(phevServiceCtx_t *ctx)
 {
     LOG_V(TAG, "START - doorIsLocked");
 
-    phevRegister_t *reg = phev_model_getRegister(ctx->model, KO_WF_DOOR_STATUS_INFO_REP_EVR);
+    phevRegister_t copy;
+    const phevRegister_t *reg = phev_service_readRegister(ctx, KO_WF_DOOR_STATUS_INFO_REP_EVR, &copy);
 
     LOG_V(TAG, "END - doorIsLocked");
     return (reg ? (int )reg->data[0] : -1);
 }
-char *phev_service_statusAsJson(phevServiceCtx_t *ctx)
+static const uint8_t phev_service_statusRegisters[] = {
+    KO_WF_BATT_LEVEL_INFO_REP_EVR,
+    KO_WF_DATE_INFO_SYNC_EVR,
+    KO_WF_OBCHG_OK_ON_INFO_REP_EVR,
+    KO_AC_MANUAL_SW_EVR,
+    KO_WF_TM_AC_STAT_INFO_REP_EVR,
+};
+
+uint32_t phev_service_statusVersion(const phevServiceCtx_t *ctx)
 {
+    uint32_t version = 0;
 
-    LOG_V(TAG, "START - statusAsJson");
+    for (size_t i = 0; i < sizeof(phev_service_statusRegisters); i++)
+    {
+        uint32_t regVersion = phev_model_registerVersion(ctx->model, phev_service_statusRegisters[i]);
+
+        if (regVersion > version)
+        {
+            version = regVersion;
+        }
+    }
+    return version;
+}
+static char *phev_service_renderStatus(phevServiceCtx_t *ctx)
+{
+    LOG_V(TAG, "START - renderStatus");
     cJSON *json = cJSON_CreateObject();
     cJSON *status = cJSON_CreateObject();
     cJSON *battery = cJSON_CreateObject();
-    cJSON *date = cJSON_CreateObject();
 
     if (json && status && battery)
     {
-        LOG_I(TAG, "Battery Request");
-
         int battLevel = phev_service_getBatteryLevel(ctx);
 
-        LOG_I(TAG, "Battery level %d", battLevel);
+        LOG_D(TAG, "Battery level %d", battLevel);
 
         if (battLevel >= 0)
         {
@@ -865,16 +973,15 @@ char *phev_service_statusAsJson(phevServiceCtx_t *ctx)
 
         if(dateStr)
         {
-            date->valuestring = dateStr;
             cJSON_AddStringToObject(status, PHEV_SERVICE_DATE_SYNC_JSON, dateStr);
+            free(dateStr);
         }
 
         if(phev_service_getChargingStatus(ctx))
         {
             cJSON * chargingRemain = cJSON_CreateNumber((double) phev_service_getRemainingChargeTime(ctx));
-            cJSON * charging = phev_service_getChargingStatus(ctx) ? cJSON_CreateTrue() : cJSON_CreateFalse();
             cJSON_AddItemToObject(battery,PHEV_SERVICE_CHARGE_REMAIN_JSON, chargingRemain);
-            cJSON_AddItemToObject(battery,PHEV_SERVICE_CHARGING_STATUS_JSON,charging);
+            cJSON_AddItemToObject(battery,PHEV_SERVICE_CHARGING_STATUS_JSON,cJSON_CreateTrue());
         }
 
         phevServiceHVAC_t * hvac = phev_service_getHVACStatus(ctx);
@@ -888,25 +995,81 @@ char *phev_service_statusAsJson(phevServiceCtx_t *ctx)
             cJSON_AddItemToObject(hvacStatus, PHEV_SERVICE_HVAC_MODE_JSON, mode);
             cJSON_AddItemToObject(hvacStatus, PHEV_SERVICE_HVAC_TIME_JSON, time);
             cJSON_AddItemToObject(status,PHEV_SERVICE_HVAC_STATUS_JSON,hvacStatus);
-
+            free(hvac);
         }
 
         char *out = cJSON_Print(json);
 
         cJSON_Delete(json);
-        //LOG_I(TAG, "Return json %s", out);
-        LOG_V(TAG, "END - statusAsJson");
+        LOG_V(TAG, "END - renderStatus");
 
         return out;
     }
     else
     {
         LOG_E(TAG, "Error creating status json obejcts");
-        LOG_V(TAG, "END - statusAsJson");
+        cJSON_Delete(json);
+        cJSON_Delete(status);
+        cJSON_Delete(battery);
+        LOG_V(TAG, "END - renderStatus");
 
         return NULL;
     }
 }
+// Caller holds the status lock. The registers are read one at a time while the pipe loop carries on updating them, any
+// change bumps the highest version so the render is only kept if the version did not move while it was built.
+static const char *phev_service_refreshStatus(phevServiceCtx_t *ctx)
+{
+    uint32_t current = phev_service_statusVersion(ctx);
+
+    while (ctx->statusJson == NULL || ctx->statusVersion != current)
+    {
+        char *out = phev_service_renderStatus(ctx);
+
+        if (out == NULL)
+        {
+            return NULL;
+        }
+        free(ctx->statusJson);
+        ctx->statusJson = out;
+        ctx->statusVersion = current;
+        current = phev_service_statusVersion(ctx);
+    }
+    return ctx->statusJson;
+}
+const char *phev_service_statusJson(phevServiceCtx_t *ctx, uint32_t *version)
+{
+    LOG_V(TAG, "START - statusJson");
+
+    pthread_mutex_lock(&ctx->statusLock);
+
+    const char *json = phev_service_refreshStatus(ctx);
+
+    if (version)
+    {
+        *version = ctx->statusVersion;
+    }
+    pthread_mutex_unlock(&ctx->statusLock);
+
+    LOG_V(TAG, "END - statusJson");
+
+    return json;
+}
+char *phev_service_statusAsJson(phevServiceCtx_t *ctx)
+{
+    LOG_V(TAG, "START - statusAsJson");
+
+    pthread_mutex_lock(&ctx->statusLock);
+
+    const char *json = phev_service_refreshStatus(ctx);
+    char *out = (json ? strdup(json) : NULL);
+
+    pthread_mutex_unlock(&ctx->statusLock);
+
+    LOG_V(TAG, "END - statusAsJson");
+
+    return out;
+}
 
 void phev_service_loop(phevServiceCtx_t *ctx)
 {
@@ -917,33 +1080,346 @@ void phev_service_loop(phevServiceCtx_t *ctx)
     //LOG_V(TAG, "END - loop");
 }
 
-message_t *phev_service_jsonResponseAggregator(void *ctx, messageBundle_t *bundle)
+message_t *phev_service_binaryOutputTransformer(void *ctx, message_t *message)
+{
+    LOG_V(TAG, "START - binaryOutputTransformer");
+
+    phevServiceCtx_t *serviceCtx = NULL;
+    char localBuffer[PHEV_SERVICE_OUTPUT_BUFFER_SIZE];
+
+    if (ctx != NULL)
+    {
+        serviceCtx = ((phev_pipe_ctx_t *)ctx)->ctx;
+
+        message_t * ret = phev_pipe_outputEventTransformer(ctx, message);
+        msg_utils_destroyMsg(ret);
+    }
+    phevMessageView_t view;
+    phevMessage_t *phevMessage = phev_core_getDecodedMessage(message, &view);
+
+    if (phevMessage == NULL)
+    {
+        LOG_E(TAG, "Invalid message received");
+        return NULL;
+    }
+
+    uint8_t type;
+
+    switch (phevMessage->command)
+    {
+    case 0x4e:
+    case 0x5e:
+    {
+        type = PHEV_SERVICE_BINARY_START_MESSAGE;
+        break;
+    }
+    case 0x6f:
+    {
+        type = (phevMessage->type == REQUEST_TYPE ? PHEV_SERVICE_BINARY_UPDATED_REGISTER : PHEV_SERVICE_BINARY_UPDATED_REGISTER_ACK);
+        break;
+    }
+    default:
+    {
+        LOG_V(TAG, "END - binaryOutputTransformer");
+        return NULL;
+    }
+    }
+
+    uint8_t *out = (uint8_t *) (serviceCtx ? serviceCtx->outputBuffer : localBuffer);
+    uint8_t length = (type == PHEV_SERVICE_BINARY_UPDATED_REGISTER_ACK ? 0 : phevMessage->length);
+    uint32_t now = (uint32_t) time(NULL);
+
+    out[0] = type;
+    out[1] = phevMessage->reg;
+    out[2] = length;
+    memcpy(&out[PHEV_SERVICE_BINARY_HEADER_SIZE], phevMessage->data, length);
+
+    uint8_t *trailer = &out[PHEV_SERVICE_BINARY_HEADER_SIZE + length];
+
+    trailer[0] = phevMessage->XOR;
+    trailer[1] = (uint8_t) (now >> 24);
+    trailer[2] = (uint8_t) (now >> 16);
+    trailer[3] = (uint8_t) (now >> 8);
+    trailer[4] = (uint8_t) now;
+
+    message_t *outputMessage = msg_utils_createMsg(out, PHEV_SERVICE_BINARY_HEADER_SIZE + length + PHEV_SERVICE_BINARY_TRAILER_SIZE);
+    LOG_BUFFER_HEXDUMP(TAG, outputMessage->data, outputMessage->length, LOG_DEBUG);
+    LOG_V(TAG, "END - binaryOutputTransformer");
+
+    return outputMessage;
+}
+static void phev_service_writeTabs(phevServiceJsonWriter_t *writer, int depth)
+{
+    for (int i = 0; i < depth; i++)
+    {
+        phev_service_writeRaw(writer, "\t", 1);
+    }
+}
+static const char *phev_service_skipSpace(const char *json, const char *end)
 {
-    cJSON *out = cJSON_CreateObject();
+    while (json < end && (*json == ' ' || *json == '\t' || *json == '\n' || *json == '\r'))
+    {
+        json++;
+    }
+    return json;
+}
+// Copies one json value into the writer laid out the way cJSON_Print lays out a value at that depth, so already
+// serialized fragments can be spliced into a bundle without parsing them into a tree. Returns NULL if the value is
+// not valid json.
+static const char *phev_service_spliceValue(phevServiceJsonWriter_t *writer, const char *json, const char *end, int depth)
+{
+    if (depth > PHEV_SERVICE_JSON_MAX_DEPTH)
+    {
+        return NULL;
+    }
 
-    cJSON *responses = cJSON_CreateArray();
+    json = phev_service_skipSpace(json, end);
 
-    cJSON_AddItemToObject(out, "responses", responses);
+    if (json >= end)
+    {
+        return NULL;
+    }
+
+    switch (*json)
+    {
+    case '{':
+    {
+        phev_service_writeRaw(writer, "{\n", 2);
+        json = phev_service_skipSpace(json + 1, end);
+        if (json < end && *json == '}')
+        {
+            phev_service_writeTabs(writer, depth);
+            phev_service_writeRaw(writer, "}", 1);
+            return json + 1;
+        }
+        while (json < end)
+        {
+            if (*json != '"')
+            {
+                return NULL;
+            }
+            phev_service_writeTabs(writer, depth + 1);
+            json = phev_service_spliceValue(writer, json, end, depth + 1);
+            if (json == NULL)
+            {
+                return NULL;
+            }
+            json = phev_service_skipSpace(json, end);
+            if (json >= end || *json != ':')
+            {
+                return NULL;
+            }
+            phev_service_writeRaw(writer, ":\t", 2);
+            json = phev_service_spliceValue(writer, json + 1, end, depth + 1);
+            if (json == NULL)
+            {
+                return NULL;
+            }
+            json = phev_service_skipSpace(json, end);
+            if (json < end && *json == ',')
+            {
+                phev_service_writeRaw(writer, ",\n", 2);
+                json = phev_service_skipSpace(json + 1, end);
+                continue;
+            }
+            if (json < end && *json == '}')
+            {
+                phev_service_writeRaw(writer, "\n", 1);
+                phev_service_writeTabs(writer, depth);
+                phev_service_writeRaw(writer, "}", 1);
+                return json + 1;
+            }
+            return NULL;
+        }
+        return NULL;
+    }
+    case '[':
+    {
+        phev_service_writeRaw(writer, "[", 1);
+        json = phev_service_skipSpace(json + 1, end);
+        if (json < end && *json == ']')
+        {
+            phev_service_writeRaw(writer, "]", 1);
+            return json + 1;
+        }
+        while (json < end)
+        {
+            json = phev_service_spliceValue(writer, json, end, depth + 1);
+            if (json == NULL)
+            {
+                return NULL;
+            }
+            json = phev_service_skipSpace(json, end);
+            if (json < end && *json == ',')
+            {
+                phev_service_writeRaw(writer, ", ", 2);
+                json++;
+                continue;
+            }
+            if (json < end && *json == ']')
+            {
+                phev_service_writeRaw(writer, "]", 1);
+                return json + 1;
+            }
+            return NULL;
+        }
+        return NULL;
+    }
+    case '"':
+    {
+        const char *str = json++;
+
+        while (json < end && *json != '"')
+        {
+            json += (*json == '\\' ? 2 : 1);
+        }
+        if (json >= end)
+        {
+            return NULL;
+        }
+        phev_service_writeRaw(writer, str, (size_t) (json - str) + 1);
+        return json + 1;
+    }
+    default:
+    {
+        // Numbers and literals, the fragments only ever hold integers so they print the same as cJSON would
+        const char *token = json;
+
+        while (json < end && (isalnum((unsigned char) *json) || *json == '-' || *json == '+' || *json == '.'))
+        {
+            json++;
+        }
+        if (json == token)
+        {
+            return NULL;
+        }
+        phev_service_writeRaw(writer, token, (size_t) (json - token));
+        return json;
+    }
+    }
+}
+static void phev_service_writeResponses(phevServiceJsonWriter_t *writer, messageBundle_t *bundle)
+{
+    bool first = true;
+
+    phev_service_writeString(writer, "{\n\t\"responses\":\t[");
 
     for (int i = 0; i < bundle->numMessages; i++)
     {
-        cJSON *next = cJSON_Parse((char *)bundle->messages[i]->data);
+        const char *json = (const char *) bundle->messages[i]->data;
+        const char *end = json + bundle->messages[i]->length;
+        size_t mark = writer->length;
+
+        if (!first)
+        {
+            phev_service_writeRaw(writer, ", ", 2);
+        }
 
-        cJSON_AddItemToArray(responses, next);
+        const char *next = phev_service_spliceValue(writer, json, end, 2);
+
+        if (next == NULL || phev_service_skipSpace(next, end) != end)
+        {
+            LOG_W(TAG, "Dropping invalid response %d", i);
+            writer->length = mark;
+            continue;
+        }
+        first = false;
     }
 
-    char *str = cJSON_Print(out);
+    phev_service_writeRaw(writer, "]\n}", 3);
+}
+message_t *phev_service_jsonResponseAggregator(void *ctx, messageBundle_t *bundle)
+{
+    LOG_V(TAG, "START - jsonResponseAggregator");
+
+    // Measure first so the bundle is written once into a buffer of the right size
+    phevServiceJsonWriter_t writer = {
+        .buffer = NULL,
+        .size = SIZE_MAX,
+        .length = 0,
+        .overflow = false,
+    };
 
-    cJSON_Delete(out);
-    if(str)
+    phev_service_writeResponses(&writer, bundle);
+
+    writer.buffer = malloc(writer.length);
+    writer.size = writer.length;
+    writer.length = 0;
+
+    if (writer.buffer == NULL)
     {
-        message_t *message = msg_utils_createMsg((uint8_t *)str, strlen(str) );
-        return message;
+        LOG_E(TAG, "Cannot allocate %zu bytes for responses", writer.size);
+        return NULL;
     }
-    else
+
+    phev_service_writeResponses(&writer, bundle);
+
+    message_t *message = msg_utils_createMsg((uint8_t *)writer.buffer, writer.length);
+
+    free(writer.buffer);
+    LOG_V(TAG, "END - jsonResponseAggregator");
+
+    return message;
+}
+
+message_t *phev_service_binaryResponseAggregator(void *ctx, messageBundle_t *bundle)
+{
+    (void) ctx;
+
+    LOG_V(TAG, "START - binaryResponseAggregator");
+
+    size_t length = 0;
+
+    for (int i = 0; i < bundle->numMessages; i++)
     {
+        length += bundle->messages[i]->length;
+    }
+
+    if (length == 0)
+    {
+        LOG_V(TAG, "END - binaryResponseAggregator");
+        return NULL;
+    }
+
+    uint8_t *data = malloc(length);
+
+    if (data == NULL)
+    {
+        LOG_E(TAG, "Cannot allocate %zu bytes for responses", length);
         return NULL;
     }
+
+    size_t offset = 0;
+
+    for (int i = 0; i < bundle->numMessages; i++)
+    {
+        memcpy(data + offset, bundle->messages[i]->data, bundle->messages[i]->length);
+        offset += bundle->messages[i]->length;
+    }
+
+    message_t *message = msg_utils_createMsg(data, length);
+
+    free(data);
+    LOG_V(TAG, "END - binaryResponseAggregator");
+
+    return message;
+}
+// Swaps the out chain's transformer and aggregator in place, msg_pipe_loop reads them without any locking
+void phev_service_setOutputFormat(phevServiceCtx_t *ctx, phevServiceOutputFormat_t format)
+{
+    LOG_V(TAG, "START - setOutputFormat");
+
+    ctx->outputFormat = format;
+
+    if (ctx->pipe && ctx->pipe->pipe && ctx->pipe->pipe->out_chain)
+    {
+        msg_pipe_chain_t *chain = ctx->pipe->pipe->out_chain;
+
+        chain->outputTransformer = (format == PHEV_SERVICE_OUTPUT_BINARY ? phev_service_binaryOutputTransformer : phev_service_jsonOutputTransformer);
+        chain->aggregator = (format == PHEV_SERVICE_OUTPUT_BINARY ? phev_service_binaryResponseAggregator : phev_service_jsonResponseAggregator);
+    }
+
+    LOG_V(TAG, "END - setOutputFormat");
 }
 
 void phev_service_errorHandler(phevError_t *error)
@@ -1040,7 +1516,8 @@ void phev_service_setRegister(const phevServiceCtx_t *ctx, const uint8_t reg, co
 char * phev_service_getDateSync(const phevServiceCtx_t * ctx)
 {
     LOG_V(TAG,"START - getDateSync");
-    phevRegister_t * reg = phev_model_getRegister(ctx->model,KO_WF_DATE_INFO_SYNC_EVR);
+    phevRegister_t copy;
+    const phevRegister_t * reg = phev_service_readRegister(ctx,KO_WF_DATE_INFO_SYNC_EVR,&copy);
     if(reg)
     {
         char * date;
@@ -1052,7 +1529,8 @@ char * phev_service_getDateSync(const phevServiceCtx_t * ctx)
 bool phev_service_getChargingStatus(const phevServiceCtx_t * ctx)
 {
     LOG_V(TAG,"START - getChargingStatus");
-    phevRegister_t * reg = phev_model_getRegister(ctx->model,KO_WF_OBCHG_OK_ON_INFO_REP_EVR);
+    phevRegister_t copy;
+    const phevRegister_t * reg = phev_service_readRegister(ctx,KO_WF_OBCHG_OK_ON_INFO_REP_EVR,&copy);
     if(reg)
     {
         LOG_V(TAG,"END- getChargingStatus");
@@ -1066,7 +1544,8 @@ bool phev_service_getChargingStatus(const phevServiceCtx_t * ctx)
 int phev_service_getRemainingChargeTime(const phevServiceCtx_t * ctx)
 {
     LOG_V(TAG,"START - getRemainingChargingTime");
-    phevRegister_t * reg = phev_model_getRegister(ctx->model, KO_WF_OBCHG_OK_ON_INFO_REP_EVR);
+    phevRegister_t copy;
+    const phevRegister_t * reg = phev_service_readRegister(ctx, KO_WF_OBCHG_OK_ON_INFO_REP_EVR, &copy);
     if(reg && reg->data[2] != 255)
     {
         uint8_t high = reg->data[1];
@@ -1080,9 +1559,15 @@ int phev_service_getRemainingChargeTime(const phevServiceCtx_t * ctx)
 
 phevServiceHVAC_t * phev_service_getHVACStatus(const phevServiceCtx_t * ctx)
 {
-    phevRegister_t * acOperatingReg = phev_model_getRegister(ctx->model, KO_AC_MANUAL_SW_EVR);
+    // Both registers from the same instant
+    const uint8_t regs[] = { KO_AC_MANUAL_SW_EVR, KO_WF_TM_AC_STAT_INFO_REP_EVR };
+    phevRegister_t copies[2];
+
+    phev_model_snapshotRegisters(ctx->model, regs, 2, copies);
+
+    const phevRegister_t * acOperatingReg = (copies[0].length > 0 ? &copies[0] : NULL);
 
-    phevRegister_t * acModeReg = phev_model_getRegister(ctx->model, KO_WF_TM_AC_STAT_INFO_REP_EVR);
+    const phevRegister_t * acModeReg = (copies[1].length > 0 ? &copies[1] : NULL);
 
     if(acOperatingReg || acModeReg)
     {
@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "phev_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define PHEV_SIMD_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PHEV_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#define PHEV_SIMD_MIN_LENGTH 16
+
+typedef struct phevSimdKernels_t
+{
+    void (*xor)(uint8_t *, const uint8_t *, const size_t, const uint8_t);
+    uint8_t (*xorSum)(const uint8_t *, const size_t, const uint8_t);
+    const char *name;
+} phevSimdKernels_t;
+
+static void phev_simd_scalarXor(uint8_t *dest, const uint8_t *src, const size_t len, const uint8_t xor)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        dest[i] = src[i] ^ xor;
+    }
+}
+static uint8_t phev_simd_scalarXorSum(const uint8_t *data, const size_t len, const uint8_t xor)
+{
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        sum = (uint8_t)(sum + (data[i] ^ xor));
+    }
+    return sum;
+}
+
+// Byte lanes are summed with wrapping adds, the checksum is mod 256 so nothing is lost before the final reduction
+
+#ifdef PHEV_SIMD_X86
+static void phev_simd_sse2Xor(uint8_t *dest, const uint8_t *src, const size_t len, const uint8_t xor)
+{
+    const __m128i key = _mm_set1_epi8((char) xor);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_xor_si128(v, key));
+    }
+    phev_simd_scalarXor(dest + i, src + i, len - i, xor);
+}
+static uint8_t phev_simd_sse2XorSum(const uint8_t *data, const size_t len, const uint8_t xor)
+{
+    const __m128i key = _mm_set1_epi8((char) xor);
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        acc = _mm_add_epi8(acc, _mm_xor_si128(v, key));
+    }
+
+    __m128i sad = _mm_sad_epu8(acc, _mm_setzero_si128());
+    uint8_t sum = (uint8_t)(_mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+
+    return (uint8_t)(sum + phev_simd_scalarXorSum(data + i, len - i, xor));
+}
+__attribute__((target("avx2"))) static void phev_simd_avx2Xor(uint8_t *dest, const uint8_t *src, const size_t len, const uint8_t xor)
+{
+    const __m256i key = _mm256_set1_epi8((char) xor);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_xor_si256(v, key));
+    }
+    _mm256_zeroupper();
+    phev_simd_sse2Xor(dest + i, src + i, len - i, xor);
+}
+__attribute__((target("avx2"))) static uint8_t phev_simd_avx2XorSum(const uint8_t *data, const size_t len, const uint8_t xor)
+{
+    const __m256i key = _mm256_set1_epi8((char) xor);
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        acc = _mm256_add_epi8(acc, _mm256_xor_si256(v, key));
+    }
+
+    __m256i sad = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    uint64_t lanes[4];
+
+    _mm256_storeu_si256((__m256i *) lanes, sad);
+
+    uint8_t sum = (uint8_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+
+    // Clear the upper halves before the legacy SSE tail to avoid the transition penalty
+    _mm256_zeroupper();
+
+    return (uint8_t)(sum + phev_simd_sse2XorSum(data + i, len - i, xor));
+}
+#endif
+
+#ifdef PHEV_SIMD_NEON
+static void phev_simd_neonXor(uint8_t *dest, const uint8_t *src, const size_t len, const uint8_t xor)
+{
+    const uint8x16_t key = vdupq_n_u8(xor);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        vst1q_u8(dest + i, veorq_u8(vld1q_u8(src + i), key));
+    }
+    phev_simd_scalarXor(dest + i, src + i, len - i, xor);
+}
+static uint8_t phev_simd_neonXorSum(const uint8_t *data, const size_t len, const uint8_t xor)
+{
+    const uint8x16_t key = vdupq_n_u8(xor);
+    uint8x16_t acc = vdupq_n_u8(0);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        acc = vaddq_u8(acc, veorq_u8(vld1q_u8(data + i), key));
+    }
+
+    uint8_t lanes[16];
+    uint8_t sum = 0;
+
+    vst1q_u8(lanes, acc);
+    for (int j = 0; j < 16; j++)
+    {
+        sum = (uint8_t)(sum + lanes[j]);
+    }
+
+    return (uint8_t)(sum + phev_simd_scalarXorSum(data + i, len - i, xor));
+}
+#endif
+
+static const phevSimdKernels_t phev_simd_scalarKernels = {phev_simd_scalarXor, phev_simd_scalarXorSum, "scalar"};
+#ifdef PHEV_SIMD_X86
+static const phevSimdKernels_t phev_simd_sse2Kernels = {phev_simd_sse2Xor, phev_simd_sse2XorSum, "sse2"};
+static const phevSimdKernels_t phev_simd_avx2Kernels = {phev_simd_avx2Xor, phev_simd_avx2XorSum, "avx2"};
+#endif
+#ifdef PHEV_SIMD_NEON
+static const phevSimdKernels_t phev_simd_neonKernels = {phev_simd_neonXor, phev_simd_neonXorSum, "neon"};
+#endif
+
+// Shared by every thread, detection gives the same answer each time so racing first callers are harmless
+static _Atomic(const phevSimdKernels_t *) phev_simd_kernels = NULL;
+
+static const phevSimdKernels_t *phev_simd_detect(void)
+{
+#if defined(PHEV_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return &phev_simd_avx2Kernels;
+    }
+    return &phev_simd_sse2Kernels;
+#elif defined(PHEV_SIMD_NEON)
+    return &phev_simd_neonKernels;
+#else
+    return &phev_simd_scalarKernels;
+#endif
+}
+static inline const phevSimdKernels_t *phev_simd_getKernels(void)
+{
+    const phevSimdKernels_t *kernels = atomic_load_explicit(&phev_simd_kernels, memory_order_acquire);
+
+    if (kernels == NULL)
+    {
+        const phevSimdKernels_t *expected = NULL;
+
+        kernels = phev_simd_detect();
+        // Keep whatever setEnabled may have stored in the meantime
+        if (!atomic_compare_exchange_strong_explicit(&phev_simd_kernels, &expected, kernels, memory_order_acq_rel, memory_order_acquire))
+        {
+            kernels = expected;
+        }
+    }
+    return kernels;
+}
+void phev_simd_setEnabled(const bool enabled)
+{
+    atomic_store_explicit(&phev_simd_kernels, (enabled ? phev_simd_detect() : &phev_simd_scalarKernels), memory_order_release);
+}
+const char *phev_simd_implementation(void)
+{
+    return phev_simd_getKernels()->name;
+}
+void phev_simd_xor(uint8_t *dest, const uint8_t *src, const size_t len, const uint8_t xor)
+{
+    if (len < PHEV_SIMD_MIN_LENGTH)
+    {
+        phev_simd_scalarXor(dest, src, len, xor);
+        return;
+    }
+    phev_simd_getKernels()->xor(dest, src, len, xor);
+}
+uint8_t phev_simd_xorSum(const uint8_t *data, const size_t len, const uint8_t xor)
+{
+    if (len < PHEV_SIMD_MIN_LENGTH)
+    {
+        return phev_simd_scalarXorSum(data, len, xor);
+    }
+    return phev_simd_getKernels()->xorSum(data, len, xor);
+}
+uint8_t phev_simd_sum(const uint8_t *data, const size_t len)
+{
+    return phev_simd_xorSum(data, len, 0);
+}
+size_t phev_simd_checksumFrames(const uint8_t *data, const size_t len, uint8_t *checksums, const size_t maxFrames)
+{
+    size_t offset = 0;
+    size_t frames = 0;
+
+    while (frames < maxFrames && offset + 2 <= len)
+    {
+        size_t frameLength = data[offset + 1] + 2;
+
+        if (offset + frameLength > len)
+        {
+            break;
+        }
+        // Most frames are short enough that the scalar fallback wins
+        checksums[frames++] = phev_simd_xorSum(data + offset, frameLength - 1, 0);
+        offset += frameLength;
+    }
+
+    return frames;
+}
@@ -11,6 +11,8 @@
 #include <netinet/in.h>
 #include <sys/stat.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <errno.h>
 #endif
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -32,11 +34,13 @@
 #define TCP_WRITE lwip_write
 #define TCP_CONNECT lwip_connect
 #define TCP_SOCKET lwip_socket
+#define TCP_FCNTL lwip_fcntl
 #define TCP_HTONS PP_HTONS
 
 #endif
 #include "phev_tcpip.h"
 #include "phev_core.h"
+#include "phev_timer.h"
 #include "msg_utils.h"
 #include "logger.h"
 #ifdef _WIN32
@@ -52,6 +56,7 @@
 #define TCP_WRITE write
 #define TCP_CONNECT connect
 #define TCP_SOCKET socket
+#define TCP_FCNTL fcntl
 #define TCP_HTONS htons
 #define TCP_READ_TIMEOUT 1000
 
@@ -61,22 +66,18 @@ const static char *APP_TAG = "PHEV_TCPIP";
 
 const static int loglvl = LOG_DEBUG;
 
-static uint8_t decoded[1024];
+#define TCP_DECODE_BUFFER_SIZE 256
 
-uint8_t *xorDataWithValue(const uint8_t *data, uint8_t xor)
+// Decodes into the caller's buffer so sessions on other threads never share one
+static uint8_t *xorDataWithValue(const uint8_t *data, size_t len, uint8_t xor, uint8_t *decoded)
 {
-
-    uint8_t length = (data[1] ^ xor) + 2;
-
-    //  TODO: FIXME: if(length > 1023) return NULL;
-
-    for (int i = 0; i < length; i++)
+    for (size_t i = 0; i < len; i++)
     {
         decoded[i] = data[i] ^ xor;
     }
-    return (uint8_t *) decoded;
+    return decoded;
 }
-static uint8_t *decode(const uint8_t *message)
+static uint8_t *decode(const uint8_t *message, size_t len, uint8_t *decoded)
 {
     uint8_t *data = NULL;
     uint8_t xor = message[2];
@@ -94,12 +95,12 @@ static uint8_t *decode(const uint8_t *message)
             {
                 xor ^= mask;
             }
-            data = xorDataWithValue(message, xor);
+            data = xorDataWithValue(message, len, xor, decoded);
         }
         else
         {
             xor = (message[2] & 0xfe) ^ ((message[0] & 0x01) ^ 1);
-            data = xorDataWithValue(message, xor);
+            data = xorDataWithValue(message, len, xor, decoded);
         }
     }
     return data;
@@ -175,8 +176,25 @@ static int tcp_read(int soc, uint8_t *buffer, int len, int timeout_ms)
     
     return read_len;
 }
+void phev_tcpClientConnectInit(phevTcpConnect_t *pending)
+{
+    pending->soc = -1;
+    pending->flags = 0;
+    pending->started = 0;
+}
 #ifdef _WIN32
 
+// Windows connects blocking, so there is never a connect left in progress
+int phev_tcpClientConnect(phevTcpConnect_t *pending, const char *host, uint16_t port)
+{
+    (void) pending;
+
+    return phev_tcpClientConnectSocket(host, port);
+}
+void phev_tcpClientConnectAbort(phevTcpConnect_t *pending)
+{
+    pending->soc = -1;
+}
 int phev_tcpClientConnectSocket(const char *host, uint16_t port)
 {
     LOG_V(APP_TAG, "START - connectSocket");
@@ -254,45 +272,160 @@ int phev_tcpClientConnectSocket(const char *host, uint16_t port)
     return ConnectSocket;
 }
 #else
-int phev_tcpClientConnectSocket(const char *host, uint16_t port)
+static int tcp_waitWritable(int soc, int timeout_ms)
 {
-    LOG_V(APP_TAG, "START - connectSocket");
-    LOG_D(APP_TAG, "Host %s, Port %d", host, port);
+    fd_set writeset;
+    FD_ZERO(&writeset);
+    FD_SET(soc, &writeset);
+    struct timeval timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
 
-    if (host == NULL)
+    return select(soc + 1, NULL, &writeset, NULL, &timeout);
+}
+// 1 once connected, 0 while still in progress and -1 if it failed, never waits
+static int tcp_checkConnect(int soc)
+{
+    int ret = tcp_waitWritable(soc, 0);
+
+    if (ret <= 0)
     {
-        LOG_E(APP_TAG, "Host not set");
+        return (ret == 0 ? 0 : -1);
+    }
+
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+
+    if (getsockopt(soc, SOL_SOCKET, SO_ERROR, &error, &errorLen) < 0 || error != 0)
+    {
+        errno = error;
         return -1;
     }
-    struct sockaddr_in addr;
-    /* set up address to connect to */
-    memset(&addr, 0, sizeof(addr));
-    //addr.sin_len = sizeof(addr);
-    addr.sin_family = AF_INET;
-    addr.sin_port = TCP_HTONS(port);
-    addr.sin_addr.s_addr = inet_addr(host);
+    return 1;
+}
+// Reads already wait with select so the socket goes back to blocking once it is connected
+static int tcp_connected(phevTcpConnect_t *pending)
+{
+    int soc = pending->soc;
 
-    LOG_I(APP_TAG, "Host %s Port %d", host, port);
+    TCP_FCNTL(soc, F_SETFL, pending->flags);
+    pending->soc = -1;
 
+    return soc;
+}
+// Returns the socket if it connected straight away, otherwise pending->soc is left set while it is in progress
+static int tcp_startConnect(phevTcpConnect_t *pending, const struct sockaddr_in *addr)
+{
     int sock = TCP_SOCKET(AF_INET, SOCK_STREAM, 0);
 
     if (sock == -1)
     {
         LOG_E(APP_TAG, "Failed to open socket");
+        return -1;
+    }
 
+    int flags = TCP_FCNTL(sock, F_GETFL, 0);
+
+    if (flags < 0 || TCP_FCNTL(sock, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        LOG_E(APP_TAG, "Cannot make socket non blocking errno %d", errno);
+        close(sock);
         return -1;
     }
-    int ret = TCP_CONNECT(sock, (struct sockaddr *)(&addr), sizeof(addr));
-    if (ret == -1)
+
+    pending->soc = sock;
+    pending->flags = flags;
+    pending->started = phev_timer_now();
+
+    if (TCP_CONNECT(sock, (const struct sockaddr *) addr, sizeof(*addr)) == 0)
     {
-        LOG_E(APP_TAG, "Failed to connect");
+        return tcp_connected(pending);
+    }
+    if (errno != EINPROGRESS)
+    {
+        LOG_E(APP_TAG, "Failed to connect errno %d", errno);
+        phev_tcpClientConnectAbort(pending);
+    }
+    return -1;
+}
+int phev_tcpClientConnect(phevTcpConnect_t *pending, const char *host, uint16_t port)
+{
+    LOG_V(APP_TAG, "START - connect");
 
+    if (host == NULL)
+    {
+        LOG_E(APP_TAG, "Host not set");
         return -1;
     }
 
-    LOG_I(APP_TAG, "Connected to host %s port %d", host, port);
+    int sock = -1;
+
+    if (pending->soc < 0)
+    {
+        struct sockaddr_in addr;
+        /* set up address to connect to */
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = TCP_HTONS(port);
+        addr.sin_addr.s_addr = inet_addr(host);
+
+        LOG_I(APP_TAG, "Host %s Port %d", host, port);
+
+        sock = tcp_startConnect(pending, &addr);
+    }
+    else
+    {
+        int status = tcp_checkConnect(pending->soc);
+
+        if (status > 0)
+        {
+            sock = tcp_connected(pending);
+        }
+        else if (status < 0 || phev_timer_now() - pending->started >= PHEV_TCP_CONNECT_TIMEOUT)
+        {
+            LOG_W(APP_TAG, "Connect to host %s port %d failed errno %d", host, port, (status < 0 ? errno : ETIMEDOUT));
+            phev_tcpClientConnectAbort(pending);
+        }
+    }
+
+    if (sock == -1)
+    {
+        LOG_I(APP_TAG, "Not connected to host %s port %d yet", host, port);
+    }
+    else
+    {
+        LOG_I(APP_TAG, "Connected to host %s port %d", host, port);
+    }
+
+    LOG_V(APP_TAG, "END - connect");
+
+    return sock;
+}
+void phev_tcpClientConnectAbort(phevTcpConnect_t *pending)
+{
+    if (pending->soc >= 0)
+    {
+        close(pending->soc);
+        pending->soc = -1;
+    }
+}
+int phev_tcpClientConnectSocket(const char *host, uint16_t port)
+{
+    LOG_V(APP_TAG, "START - connectSocket");
+    LOG_D(APP_TAG, "Host %s, Port %d", host, port);
+
+    phevTcpConnect_t pending;
+
+    phev_tcpClientConnectInit(&pending);
+
+    int sock = phev_tcpClientConnect(&pending, host, port);
+
+    while (sock < 0 && pending.soc >= 0)
+    {
+        uint64_t elapsed = phev_timer_now() - pending.started;
+
+        tcp_waitWritable(pending.soc, (elapsed < PHEV_TCP_CONNECT_TIMEOUT ? (int) (PHEV_TCP_CONNECT_TIMEOUT - elapsed) : 0));
+        sock = phev_tcpClientConnect(&pending, host, port);
+    }
 
-    //global_sock = sock;
     LOG_V(APP_TAG, "END - connectSocket");
 
     return sock;
@@ -313,7 +446,8 @@ int phev_tcpClientRead(int soc, uint8_t *buf, size_t len)
     {
         LOG_BUFFER_HEXDUMP("READ",buf,num,loglvl);
         //phexdump("<< ", buf, num, LOG_INFO);
-        uint8_t * decoded = decode(buf);
+        uint8_t buffer[TCP_DECODE_BUFFER_SIZE];
+        uint8_t * decoded = decode(buf, num, buffer);
         if (decoded)
         {
             //phexdump("<< DECODED3 ", decoded, num, LOG_INFO)
@@ -339,7 +473,8 @@ int phev_tcpClientWrite(int soc, uint8_t *buf, size_t len)
     if (num > 2 && num < 256)
     {
         LOG_BUFFER_HEXDUMP("WRITE",buf,num,loglvl);
-        uint8_t * decoded = decode(buf);
+        uint8_t buffer[TCP_DECODE_BUFFER_SIZE];
+        uint8_t * decoded = decode(buf, num, buffer);
         if (decoded)
         {
             LOG_BUFFER_HEXDUMP("WRITE DECODED",decoded,num,loglvl);
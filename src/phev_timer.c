@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <time.h>
+#include "phev_timer.h"
+#include "logger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__XTENSA__)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+const static char *APP_TAG = "PHEV_TIMER";
+
+#define PHEV_TIMER_SLOT_MASK (PHEV_TIMER_SLOTS - 1)
+#define PHEV_TIMER_LEVEL_SHIFT(level) (PHEV_TIMER_SLOT_BITS * (level))
+#define PHEV_TIMER_MAX_TICKS ((uint64_t) 1 << PHEV_TIMER_LEVEL_SHIFT(PHEV_TIMER_LEVELS))
+
+uint64_t phev_timer_now(void)
+{
+#if defined(_WIN32)
+    return (uint64_t) GetTickCount64();
+#elif defined(__XTENSA__)
+    return (uint64_t) xTaskGetTickCount() * portTICK_PERIOD_MS;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+#endif
+}
+static int phev_timer_firstSet(const uint64_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int bit = 0;
+
+    while (((bits >> bit) & 1) == 0)
+    {
+        bit++;
+    }
+    return bit;
+#endif
+}
+static uint64_t phev_timer_toTick(const uint64_t expires)
+{
+    if (expires > PHEV_TIMER_NEVER - PHEV_TIMER_RESOLUTION)
+    {
+        return PHEV_TIMER_NEVER / PHEV_TIMER_RESOLUTION;
+    }
+    // Round up so a timer never fires early
+    return (expires + PHEV_TIMER_RESOLUTION - 1) / PHEV_TIMER_RESOLUTION;
+}
+// Cascaded timers may land on the current tick as its slot is processed straight after the cascade
+static void phev_timer_link(phevTimerWheel_t *wheel, phevTimer_t *timer, const bool cascading)
+{
+    const uint64_t earliest = wheel->tick + (cascading ? 0 : 1);
+    uint64_t expiresTick = phev_timer_toTick(timer->expires);
+
+    if (expiresTick < earliest)
+    {
+        expiresTick = earliest;
+    }
+
+    uint64_t delta = expiresTick - wheel->tick;
+
+    if (delta >= PHEV_TIMER_MAX_TICKS)
+    {
+        // Parked in the top level and re-placed when it cascades down
+        expiresTick = wheel->tick + PHEV_TIMER_MAX_TICKS - 1;
+        delta = PHEV_TIMER_MAX_TICKS - 1;
+    }
+
+    int level = 0;
+
+    while (level < PHEV_TIMER_LEVELS - 1 && delta >= ((uint64_t) 1 << PHEV_TIMER_LEVEL_SHIFT(level + 1)))
+    {
+        level++;
+    }
+
+    int slot = (int) ((expiresTick >> PHEV_TIMER_LEVEL_SHIFT(level)) & PHEV_TIMER_SLOT_MASK);
+
+    timer->level = (uint8_t) level;
+    timer->slot = (uint8_t) slot;
+    timer->prev = NULL;
+    timer->next = wheel->slots[level][slot];
+
+    if (timer->next != NULL)
+    {
+        timer->next->prev = timer;
+    }
+    wheel->slots[level][slot] = timer;
+    wheel->occupied[level] |= ((uint64_t) 1 << slot);
+}
+static void phev_timer_unlink(phevTimerWheel_t *wheel, phevTimer_t *timer)
+{
+    if (timer->prev != NULL)
+    {
+        timer->prev->next = timer->next;
+    }
+    else
+    {
+        wheel->slots[timer->level][timer->slot] = timer->next;
+    }
+    if (timer->next != NULL)
+    {
+        timer->next->prev = timer->prev;
+    }
+    if (wheel->slots[timer->level][timer->slot] == NULL)
+    {
+        wheel->occupied[timer->level] &= ~((uint64_t) 1 << timer->slot);
+    }
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+static void phev_timer_cascade(phevTimerWheel_t *wheel, const int level, const int slot)
+{
+    phevTimer_t *timer = wheel->slots[level][slot];
+
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+
+    while (timer != NULL)
+    {
+        phevTimer_t *next = timer->next;
+
+        phev_timer_link(wheel, timer, true);
+        timer = next;
+    }
+}
+static int phev_timer_nextSlot(const phevTimerWheel_t *wheel, const int level, uint64_t *tick)
+{
+    uint64_t bits = wheel->occupied[level];
+
+    if (bits == 0)
+    {
+        return -1;
+    }
+
+    uint64_t base = wheel->tick >> PHEV_TIMER_LEVEL_SHIFT(level);
+    int start = (int) ((base + 1) & PHEV_TIMER_SLOT_MASK);
+    uint64_t rotated = (bits >> start) | (bits << ((PHEV_TIMER_SLOTS - start) & PHEV_TIMER_SLOT_MASK));
+    int offset = phev_timer_firstSet(rotated);
+
+    *tick = (base + 1 + offset) << PHEV_TIMER_LEVEL_SHIFT(level);
+
+    return (start + offset) & PHEV_TIMER_SLOT_MASK;
+}
+// Tick of the next expiry or cascade, whichever comes first
+static uint64_t phev_timer_nextTick(const phevTimerWheel_t *wheel)
+{
+    uint64_t next = PHEV_TIMER_NEVER;
+
+    if (wheel->active == 0)
+    {
+        return next;
+    }
+
+    for (int level = 0; level < PHEV_TIMER_LEVELS; level++)
+    {
+        uint64_t tick;
+
+        if (phev_timer_nextSlot(wheel, level, &tick) >= 0 && tick < next)
+        {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+void phev_timer_initWheel(phevTimerWheel_t *wheel, const uint64_t now)
+{
+    for (int level = 0; level < PHEV_TIMER_LEVELS; level++)
+    {
+        for (int slot = 0; slot < PHEV_TIMER_SLOTS; slot++)
+        {
+            wheel->slots[level][slot] = NULL;
+        }
+        wheel->occupied[level] = 0;
+    }
+    wheel->tick = now / PHEV_TIMER_RESOLUTION;
+    wheel->active = 0;
+}
+void phev_timer_init(phevTimer_t *timer, phevTimerCallback_t callback, void *ctx)
+{
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->level = 0;
+    timer->slot = 0;
+    timer->active = false;
+    timer->callback = callback;
+    timer->ctx = ctx;
+}
+void phev_timer_startAt(phevTimerWheel_t *wheel, phevTimer_t *timer, const uint64_t expires)
+{
+    if (timer->active)
+    {
+        phev_timer_unlink(wheel, timer);
+        wheel->active--;
+    }
+
+    timer->expires = expires;
+    timer->active = true;
+    phev_timer_link(wheel, timer, false);
+    wheel->active++;
+}
+void phev_timer_start(phevTimerWheel_t *wheel, phevTimer_t *timer, const uint64_t delay)
+{
+    phev_timer_startAt(wheel, timer, phev_timer_time(wheel) + delay);
+}
+void phev_timer_stop(phevTimerWheel_t *wheel, phevTimer_t *timer)
+{
+    if (!timer->active)
+    {
+        return;
+    }
+
+    phev_timer_unlink(wheel, timer);
+    timer->active = false;
+    wheel->active--;
+}
+bool phev_timer_active(const phevTimer_t *timer)
+{
+    return timer->active;
+}
+size_t phev_timer_advance(phevTimerWheel_t *wheel, const uint64_t now)
+{
+    const uint64_t target = now / PHEV_TIMER_RESOLUTION;
+    size_t fired = 0;
+
+    while (wheel->tick < target)
+    {
+        uint64_t next = phev_timer_nextTick(wheel);
+
+        if (next > target)
+        {
+            wheel->tick = target;
+            break;
+        }
+
+        // Nothing happens on the ticks in between so skip straight to the next one that matters
+        wheel->tick = next;
+
+        for (int level = 1; level < PHEV_TIMER_LEVELS; level++)
+        {
+            if ((wheel->tick & (((uint64_t) 1 << PHEV_TIMER_LEVEL_SHIFT(level)) - 1)) != 0)
+            {
+                break;
+            }
+            phev_timer_cascade(wheel, level, (int) ((wheel->tick >> PHEV_TIMER_LEVEL_SHIFT(level)) & PHEV_TIMER_SLOT_MASK));
+        }
+
+        const int slot = (int) (wheel->tick & PHEV_TIMER_SLOT_MASK);
+
+        while (wheel->slots[0][slot] != NULL)
+        {
+            phevTimer_t *timer = wheel->slots[0][slot];
+
+            phev_timer_unlink(wheel, timer);
+            timer->active = false;
+            wheel->active--;
+            fired++;
+
+            LOG_D(APP_TAG, "Timer %p expired", (void *) timer);
+
+            if (timer->callback != NULL)
+            {
+                timer->callback(timer, timer->ctx);
+            }
+        }
+    }
+
+    return fired;
+}
+uint64_t phev_timer_time(const phevTimerWheel_t *wheel)
+{
+    return wheel->tick * PHEV_TIMER_RESOLUTION;
+}
+// Never later than the earliest expiry, may be earlier when a cascade has to happen first
+uint64_t phev_timer_nextDeadline(const phevTimerWheel_t *wheel)
+{
+    uint64_t next = PHEV_TIMER_NEVER;
+
+    if (wheel->active == 0)
+    {
+        return next;
+    }
+
+    for (int level = 0; level < PHEV_TIMER_LEVELS; level++)
+    {
+        uint64_t tick;
+        int slot = phev_timer_nextSlot(wheel, level, &tick);
+
+        if (slot < 0)
+        {
+            continue;
+        }
+
+        // Upper level slots are ordered by expiry, so the earliest timer in the first occupied slot is the earliest for the level
+        if (level > 0)
+        {
+            uint64_t earliest = PHEV_TIMER_NEVER;
+
+            for (const phevTimer_t *timer = wheel->slots[level][slot]; timer != NULL; timer = timer->next)
+            {
+                uint64_t expires = phev_timer_toTick(timer->expires);
+
+                if (expires < earliest)
+                {
+                    earliest = expires;
+                }
+            }
+            // Parked timers beyond the wheel range are re-placed at the cascade, so wake for that instead
+            if (earliest < tick + ((uint64_t) 1 << PHEV_TIMER_LEVEL_SHIFT(level)))
+            {
+                tick = earliest;
+            }
+        }
+        if (tick < next)
+        {
+            next = tick;
+        }
+    }
+
+    return (next == PHEV_TIMER_NEVER ? PHEV_TIMER_NEVER : next * PHEV_TIMER_RESOLUTION);
+}
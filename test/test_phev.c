@@ -221,6 +221,26 @@ void test_phev_registrationEndToEnd(void)
 
 }
 
+void test_phev_enableRegisterHistory_on_loop(void)
+{
+    phevRegisterHistoryEntry_t entries[2];
+    phevSettings_t settings = {
+        .host = "localhost",
+        .handler = test_phev_handler,
+    };
+    phevCtx_t * handle = phev_init(settings);
+    phevModel_t * model = handle->serviceCtx->model;
+
+    TEST_ASSERT_EQUAL(0,phev_enableRegisterHistory(handle,0x1d,PHEV_MODEL_HISTORY_SIZE + 1));
+    TEST_ASSERT_EQUAL(1,phev_enableRegisterHistory(handle,0x1d,2));
+    TEST_ASSERT_NULL(model->histories[0x1d]);
+
+    TEST_ASSERT_EQUAL(1,phev_pipe_drainCommands(handle->serviceCtx->pipe));
+    phev_model_setRegister(model,0x1d,(const uint8_t []) {50},1);
+
+    TEST_ASSERT_EQUAL(1,phev_registerHistoryLatest(handle,0x1d,entries,2));
+    TEST_ASSERT_EQUAL(50,entries[0].data[0]);
+}
 void test_phev_statusAsJson(void)
 {
     const uint8_t data[] = {50};
@@ -0,0 +1,151 @@
+#include "unity.h"
+#include "phev.h"
+#include "phev_command.h"
+
+typedef struct test_phev_command_session_t
+{
+    phevCtx_t phev;
+    phevServiceCtx_t service;
+} test_phev_command_session_t;
+
+static int test_phev_command_callbacks = 0;
+static phevCommandStatus_t test_phev_command_lastStatus = PHEV_COMMAND_PENDING;
+
+static void test_phev_command_outgoingHandler(messagingClient_t *client, message_t *message)
+{
+    return;
+}
+static message_t * test_phev_command_noIncoming(messagingClient_t *client)
+{
+    return NULL;
+}
+static void test_phev_command_callback(phevCommand_t * command, void * userCtx)
+{
+    test_phev_command_callbacks++;
+    test_phev_command_lastStatus = phev_command_status(command);
+}
+static void test_phev_command_initSession(test_phev_command_session_t * session)
+{
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_command_noIncoming,
+        .outgoingHandler = test_phev_command_outgoingHandler,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_command_noIncoming,
+        .outgoingHandler = test_phev_command_outgoingHandler,
+    };
+
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    in->connected = 1;
+    out->connected = 1;
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = NULL,
+        .preConnectHook = NULL,
+    };
+
+    session->service.pipe = phev_pipe_createPipe(settings);
+    session->service.pipe->ctx = &session->service;
+    session->service.pipe->connected = true;
+    session->phev.serviceCtx = &session->service;
+
+    test_phev_command_callbacks = 0;
+    test_phev_command_lastStatus = PHEV_COMMAND_PENDING;
+}
+static void test_phev_command_ack(phev_pipe_ctx_t * pipe, const uint8_t reg)
+{
+    const uint8_t data[] = {0x00};
+    phevMessage_t * message = phev_core_createMessage(0x6f, RESPONSE_TYPE, reg, data, sizeof(data));
+    phevPipeEvent_t * event = phev_pipe_createRegisterEvent(pipe, message);
+
+    phev_pipe_updateRegisterEventHandler(pipe, event);
+}
+void test_phev_command_success(void)
+{
+    test_phev_command_session_t session;
+
+    test_phev_command_initSession(&session);
+
+    phevCommand_t * command = phev_headLightsAsync(&session.phev, true, test_phev_command_callback, NULL);
+
+    TEST_ASSERT_NOT_NULL(command);
+    TEST_ASSERT_EQUAL(PHEV_COMMAND_PENDING, phev_command_status(command));
+    TEST_ASSERT_EQUAL(PHEV_COMMAND_PENDING, phev_command_wait(command, 10));
+    TEST_ASSERT_EQUAL(0, phev_command_latency(command));
+
+    phev_pipe_drainCommands(session.service.pipe);
+    test_phev_command_ack(session.service.pipe, KO_WF_H_LAMP_CONT_SP);
+
+    TEST_ASSERT_EQUAL(1, test_phev_command_callbacks);
+    TEST_ASSERT_EQUAL(PHEV_COMMAND_SUCCESS, test_phev_command_lastStatus);
+    TEST_ASSERT_EQUAL(PHEV_COMMAND_SUCCESS, phev_command_wait(command, -1));
+    TEST_ASSERT_FALSE(phev_command_cancel(command));
+
+    phev_command_release(command);
+}
+void test_phev_command_disconnected(void)
+{
+    test_phev_command_session_t session;
+
+    test_phev_command_initSession(&session);
+
+    phevCommand_t * command = phev_airConModeAsync(&session.phev, COOL, T20MIN, test_phev_command_callback, NULL);
+
+    phev_pipe_drainCommands(session.service.pipe);
+    TEST_ASSERT_EQUAL(1, session.service.pipe->updateRegisterCallbacks->numberOfCallbacks);
+
+    phev_pipe_disconnectOutput(session.service.pipe);
+
+    TEST_ASSERT_EQUAL(0, session.service.pipe->updateRegisterCallbacks->numberOfCallbacks);
+    TEST_ASSERT_EQUAL(1, test_phev_command_callbacks);
+    TEST_ASSERT_EQUAL(PHEV_COMMAND_DISCONNECTED, phev_command_status(command));
+
+    phev_command_release(command);
+}
+void test_phev_command_cancel(void)
+{
+    test_phev_command_session_t session;
+
+    test_phev_command_initSession(&session);
+
+    phevCommand_t * command = phev_parkingLightsAsync(&session.phev, false, test_phev_command_callback, NULL);
+
+    TEST_ASSERT_TRUE(phev_command_cancel(command));
+    TEST_ASSERT_EQUAL(PHEV_COMMAND_CANCELLED, phev_command_wait(command, 10));
+
+    phev_command_release(command);
+
+    phev_pipe_drainCommands(session.service.pipe);
+    test_phev_command_ack(session.service.pipe, KO_WF_P_LAMP_CONT_SP);
+
+    TEST_ASSERT_EQUAL(0, test_phev_command_callbacks);
+    TEST_ASSERT_EQUAL(0, session.service.pipe->updateRegisterCallbacks->numberOfCallbacks);
+}
+void test_phev_command_rejected_when_queue_full(void)
+{
+    test_phev_command_session_t session;
+    phevCommand_t * command = NULL;
+
+    test_phev_command_initSession(&session);
+
+    for (int i = 0; i < PHEV_PIPE_COMMAND_QUEUE_SIZE; i++)
+    {
+        command = phev_updateAllAsync(&session.phev, NULL, NULL);
+        TEST_ASSERT_EQUAL(PHEV_COMMAND_PENDING, phev_command_status(command));
+        phev_command_release(command);
+    }
+
+    command = phev_updateAllAsync(&session.phev, test_phev_command_callback, NULL);
+
+    TEST_ASSERT_EQUAL(PHEV_COMMAND_REJECTED, phev_command_status(command));
+    TEST_ASSERT_EQUAL(0, test_phev_command_callbacks);
+
+    phev_command_release(command);
+}
@@ -451,6 +451,229 @@ void test_phev_core_my18_xor_decodeMessage_4e(void)
     TEST_ASSERT_EQUAL(0, msg.type);
     
 }
+void test_phev_core_decodeMessageView(void)
+{
+    const uint8_t my18_msg[] = {0x4f,0x26,0x20,0x23,0x21,0x31,0x43,0xcd};
+    const uint8_t expected[] = {0x01,0x11,0x63};
+    phevMessageView_t view;
+
+    size_t ret = phev_core_decodeMessageView(my18_msg, sizeof(my18_msg), &view);
+
+    TEST_ASSERT_EQUAL(sizeof(my18_msg), ret);
+    TEST_ASSERT_EQUAL(0x6f, view.message.command);
+    TEST_ASSERT_EQUAL(3, view.message.length);
+    TEST_ASSERT_EQUAL(0, view.message.type);
+    TEST_ASSERT_EQUAL(0x03, view.message.reg);
+    TEST_ASSERT_EQUAL(0x20, view.message.XOR);
+    TEST_ASSERT_EQUAL_PTR(view.frame + 4, view.message.data);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, view.message.data, sizeof(expected));
+}
+void test_phev_core_decodeMessageView_double(void)
+{
+    const uint8_t messages[] = {0x6f, 0x0a, 0x00, 0x12, 0x00, 0x06, 0x06, 0x13, 0x05, 0x13, 0x01, 0xc3, 0x6f, 0x0a, 0x00, 0x13, 0x00, 0x06, 0x06, 0x13, 0x05, 0x13, 0x01, 0xc4};
+    phevMessageView_t view;
+
+    size_t ret = phev_core_decodeMessageView(messages, sizeof(messages), &view);
+
+    TEST_ASSERT_EQUAL(12, ret);
+    TEST_ASSERT_EQUAL(0x12, view.message.reg);
+
+    ret = phev_core_decodeMessageView(messages + ret, sizeof(messages) - ret, &view);
+
+    TEST_ASSERT_EQUAL(12, ret);
+    TEST_ASSERT_EQUAL(0x13, view.message.reg);
+}
+void test_phev_core_decodeMessageView_truncated(void)
+{
+    phevMessageView_t view;
+
+    size_t ret = phev_core_decodeMessageView(singleMessage, sizeof(singleMessage) - 1, &view);
+
+    TEST_ASSERT_EQUAL(0, ret);
+}
+void test_phev_core_attachDecodedMessage(void)
+{
+    const uint8_t input[] = {0xAD,0xCB,0xC2,0xE0,0xC2,0xC2,0x3D,0xBD,0x3D,0xC3,0xDA};
+    phevDecodedMessage_t decoded;
+
+    message_t * message = phev_core_createMsgXOR(input, sizeof(input), 0xc2);
+
+    TEST_ASSERT_TRUE(phev_core_attachDecodedMessage(message, &decoded));
+
+    phevMessage_t * phevMessage = phev_core_getDecodedMessage(message, NULL);
+
+    TEST_ASSERT_EQUAL_PTR(&decoded.view.message, phevMessage);
+    TEST_ASSERT_EQUAL(0x6f, phevMessage->command);
+    TEST_ASSERT_EQUAL(0x22, phevMessage->reg);
+    TEST_ASSERT_EQUAL(6, phevMessage->length);
+    TEST_ASSERT_EQUAL(0xc2, phev_core_getMessageXOR(message));
+    TEST_ASSERT_TRUE(phev_core_messageEncoded(message));
+}
+void test_phev_core_getDecodedMessage_not_attached(void)
+{
+    phevMessageView_t view;
+
+    message_t * message = msg_utils_createMsg(singleMessage, sizeof(singleMessage));
+
+    phevMessage_t * phevMessage = phev_core_getDecodedMessage(message, &view);
+
+    TEST_ASSERT_EQUAL_PTR(&view.message, phevMessage);
+    TEST_ASSERT_EQUAL(0x6f, phevMessage->command);
+    TEST_ASSERT_EQUAL(0x12, phevMessage->reg);
+    TEST_ASSERT_FALSE(phev_core_messageEncoded(message));
+}
+void test_phev_core_streamParser_partial_frame(void)
+{
+    const uint8_t input[] = {0xFD,0xC6,0xC3,0xD9,0xC2,0x9D,0xAD,0xCB,0xC2,0xE0,0xC2,0xC2,0x3D,0xBD,0x3D,0xC3,0xDA};
+    phevStreamParser_t parser;
+
+    phev_core_streamParserInit(&parser);
+    phev_core_streamParserWrite(&parser, input, 9);
+
+    message_t * first = phev_core_streamParserNextMessage(&parser, NULL);
+
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_EQUAL(6, first->length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(input, first->data, 6);
+    TEST_ASSERT_EQUAL(0xc2, phev_core_getMessageXOR(first));
+    TEST_ASSERT_NULL(phev_core_streamParserNextMessage(&parser, NULL));
+    TEST_ASSERT_EQUAL(3, phev_core_streamParserPending(&parser));
+
+    phev_core_streamParserWrite(&parser, input + 9, sizeof(input) - 9);
+
+    message_t * second = phev_core_streamParserNextMessage(&parser, NULL);
+
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_EQUAL(11, second->length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(input + 6, second->data, 11);
+    TEST_ASSERT_EQUAL(0, phev_core_streamParserPending(&parser));
+}
+void test_phev_core_streamParser_resync_after_garbage(void)
+{
+    const uint8_t input[] = {0x55,0x66,0x3F,0x04,0x01,0x02,0x00,0x46};
+    phevStreamParser_t parser;
+
+    phev_core_streamParserInit(&parser);
+    phev_core_streamParserWrite(&parser, input, sizeof(input));
+
+    message_t * message = phev_core_streamParserNextMessage(&parser, NULL);
+
+    TEST_ASSERT_NOT_NULL(message);
+    TEST_ASSERT_EQUAL(6, message->length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(input + 2, message->data, 6);
+    TEST_ASSERT_EQUAL(0, phev_core_streamParserPending(&parser));
+}
+void test_phev_core_streamParser_wraps_buffer(void)
+{
+    const uint8_t input[] = {0x3F,0x04,0x01,0x02,0x00,0x46};
+    phevStreamParser_t parser;
+
+    phev_core_streamParserInit(&parser);
+    parser.head = parser.tail = PHEV_CORE_STREAM_BUFFER_SIZE - 2;
+    phev_core_streamParserWrite(&parser, input, sizeof(input));
+
+    message_t * message = phev_core_streamParserNextMessage(&parser, NULL);
+
+    TEST_ASSERT_NOT_NULL(message);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(input, message->data, sizeof(input));
+}
+void test_phev_core_predictIncomingFrame_hit(void)
+{
+    const uint8_t input[] = {0xFD,0xC6,0xC3,0xD9,0xC2,0x9D};
+    phevXORPredictor_t predictor;
+    uint8_t xor = 0;
+
+    phev_core_initXORPredictor(&predictor);
+    phev_core_seedXORPredictor(&predictor, 0xc2, 0xc2, 0xc2);
+
+    phevFrameStatus_t status = phev_core_predictIncomingFrame(input, sizeof(input), &predictor, &xor);
+
+    TEST_ASSERT_EQUAL(PHEV_CORE_FRAME_COMPLETE, status);
+    TEST_ASSERT_EQUAL(0xc2, xor);
+    TEST_ASSERT_EQUAL(1, predictor.hits);
+    TEST_ASSERT_EQUAL(0, predictor.misses);
+}
+void test_phev_core_predictIncomingFrame_miss_learns_key(void)
+{
+    const uint8_t input[] = {0xFD,0xC6,0xC3,0xD9,0xC2,0x9D};
+    phevXORPredictor_t predictor;
+    uint8_t xor = 0;
+
+    phev_core_initXORPredictor(&predictor);
+    phev_core_seedXORPredictor(&predictor, 0x10, 0x10, 0x20);
+
+    phevFrameStatus_t status = phev_core_predictIncomingFrame(input, sizeof(input), &predictor, &xor);
+
+    TEST_ASSERT_EQUAL(PHEV_CORE_FRAME_COMPLETE, status);
+    TEST_ASSERT_EQUAL(0xc2, xor);
+    TEST_ASSERT_EQUAL(0, predictor.hits);
+    TEST_ASSERT_EQUAL(1, predictor.misses);
+    TEST_ASSERT_EQUAL(0xc2, predictor.keys[PHEV_CORE_XOR_PREDICT_LAST]);
+
+    status = phev_core_predictIncomingFrame(input, sizeof(input), &predictor, &xor);
+
+    TEST_ASSERT_EQUAL(PHEV_CORE_FRAME_COMPLETE, status);
+    TEST_ASSERT_EQUAL(1, predictor.hits);
+}
+void test_phev_core_frameTemplate_matches_encoded_ping(void)
+{
+    const uint8_t data = 0;
+    phevFrameTemplate_t frameTemplate;
+
+    phev_core_initFrameTemplate(&frameTemplate, PING_SEND_CMD_MY18, REQUEST_TYPE, 1, 0x30);
+
+    for (int reg = 0; reg < 0x30; reg++)
+    {
+        message_t * expected = phev_core_XOROutboundMessage(phev_core_convertToMessage(phev_core_pingMessage(reg)), 0x30);
+
+        size_t length = phev_core_patchFrameTemplate(&frameTemplate, reg, &data);
+
+        TEST_ASSERT_EQUAL(expected->length, length);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->data, frameTemplate.frame, length);
+    }
+}
+void test_phev_core_frameTemplate_time_sync(void)
+{
+    const uint8_t data[] = {20, 1, 2, 3, 4, 5, 1};
+    phevFrameTemplate_t frameTemplate;
+
+    phev_core_initFrameTemplate(&frameTemplate, SEND_CMD, REQUEST_TYPE, sizeof(data), 0x65);
+
+    message_t * expected = phev_core_XOROutboundMessage(phev_core_convertToMessage(phev_core_commandMessage(KO_WF_DATE_INFO_SYNC_SP, data, sizeof(data))), 0x65);
+
+    size_t length = phev_core_patchFrameTemplate(&frameTemplate, KO_WF_DATE_INFO_SYNC_SP, data);
+
+    TEST_ASSERT_EQUAL(expected->length, length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->data, frameTemplate.frame, length);
+    TEST_ASSERT_TRUE(phev_core_frameTemplateMatches(&frameTemplate, SEND_CMD, REQUEST_TYPE, sizeof(data), 0x65));
+    TEST_ASSERT_FALSE(phev_core_frameTemplateMatches(&frameTemplate, SEND_CMD, REQUEST_TYPE, sizeof(data), 0x64));
+}
+void test_phev_core_commandInfo(void)
+{
+    const phevCommandInfo_t * info = phev_core_commandInfo(0x6f);
+
+    TEST_ASSERT_TRUE(info->flags & PHEV_CORE_CMD_INCOMING);
+    TEST_ASSERT_FALSE(info->flags & PHEV_CORE_CMD_OUTGOING);
+    TEST_ASSERT_EQUAL(PHEV_CORE_XOR_KEY, info->xorRule);
+    TEST_ASSERT_EQUAL(0xf6, info->ack);
+
+    info = phev_core_commandInfo(0x9f);
+
+    TEST_ASSERT_EQUAL(PHEV_CORE_MODEL_PRE_MY18, info->modelYear);
+    TEST_ASSERT_EQUAL(0, phev_core_commandInfo(0x00)->flags);
+}
+void test_phev_core_commandInfo_ack_is_nibble_swap(void)
+{
+    for (int command = 0; command < 256; command++)
+    {
+        const phevCommandInfo_t * info = phev_core_commandInfo(command);
+
+        if (info->flags)
+        {
+            TEST_ASSERT_EQUAL_HEX8(((command & 0xf) << 4) | ((command & 0xf0) >> 4), info->ack);
+        }
+    }
+}
 //phev_core_responseHandler
 void test_response_handler_4e(void)
 {
@@ -0,0 +1,252 @@
+#include "unity.h"
+#include "phev_fleet.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_PHEV_FLEET_SESSIONS 4
+
+typedef struct test_phev_fleet_session_t
+{
+    phevCtx_t phev;
+    phevServiceCtx_t service;
+    phevTimer_t timer;
+    atomic_int fired;
+} test_phev_fleet_session_t;
+
+static int test_phev_fleet_socket = -1;
+static atomic_int test_phev_fleet_reads;
+static atomic_int test_phev_fleet_peer;
+static atomic_int test_phev_fleet_connects;
+
+static void test_phev_fleet_outgoingHandler(messagingClient_t *client, message_t *message)
+{
+    return;
+}
+static message_t * test_phev_fleet_noIncoming(messagingClient_t *client)
+{
+    return NULL;
+}
+static message_t * test_phev_fleet_readIncoming(messagingClient_t *client)
+{
+    uint8_t buffer[64];
+
+    if (test_phev_fleet_socket >= 0 && read(test_phev_fleet_socket, buffer, sizeof(buffer)) > 0)
+    {
+        atomic_fetch_add(&test_phev_fleet_reads, 1);
+    }
+    return NULL;
+}
+// A closed connection drops the client, as the tcpip client does when its read fails
+static message_t * test_phev_fleet_readOrDrop(messagingClient_t *client)
+{
+    uint8_t buffer[64];
+    ssize_t length = read(test_phev_fleet_socket, buffer, sizeof(buffer));
+
+    if (length > 0)
+    {
+        atomic_fetch_add(&test_phev_fleet_reads, 1);
+    }
+    else if (length == 0)
+    {
+        close(test_phev_fleet_socket);
+        test_phev_fleet_socket = -1;
+        client->connected = 0;
+    }
+    return NULL;
+}
+// Every connect is a new socket, as when the car comes back
+static int test_phev_fleet_connect(messagingClient_t *client)
+{
+    int sockets[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+    {
+        return -1;
+    }
+    test_phev_fleet_socket = sockets[0];
+    atomic_store(&test_phev_fleet_peer, sockets[1]);
+    atomic_fetch_add(&test_phev_fleet_connects, 1);
+
+    return 0;
+}
+static int test_phev_fleet_socketHandler(messagingClient_t *client)
+{
+    return test_phev_fleet_socket;
+}
+static void test_phev_fleet_timerCallback(phevTimer_t *timer, void *ctx)
+{
+    test_phev_fleet_session_t * session = (test_phev_fleet_session_t *) ctx;
+
+    atomic_fetch_add(&session->fired, 1);
+    phev_timer_start(&session->service.pipe->timers, timer, 10);
+}
+static void test_phev_fleet_initSession(test_phev_fleet_session_t * session)
+{
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_fleet_noIncoming,
+        .outgoingHandler = test_phev_fleet_outgoingHandler,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_fleet_readIncoming,
+        .outgoingHandler = test_phev_fleet_outgoingHandler,
+    };
+
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    in->connected = 1;
+    out->connected = 1;
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = NULL,
+        .preConnectHook = NULL,
+    };
+
+    session->service.pipe = phev_pipe_createPipe(settings);
+    session->service.pipe->ctx = &session->service;
+    session->phev.serviceCtx = &session->service;
+    atomic_init(&session->fired, 0);
+}
+void test_phev_fleet_runs_session_timers(void)
+{
+    test_phev_fleet_session_t sessions[TEST_PHEV_FLEET_SESSIONS];
+    phevFleet_t * fleet = phev_fleet_create(TEST_PHEV_FLEET_SESSIONS, 2);
+
+    TEST_ASSERT_NOT_NULL(fleet);
+
+    test_phev_fleet_socket = -1;
+
+    for (int i = 0; i < TEST_PHEV_FLEET_SESSIONS; i++)
+    {
+        test_phev_fleet_initSession(&sessions[i]);
+        phev_timer_init(&sessions[i].timer, test_phev_fleet_timerCallback, &sessions[i]);
+        phev_timer_start(&sessions[i].service.pipe->timers, &sessions[i].timer, 10);
+        TEST_ASSERT_EQUAL(0, phev_fleet_add(fleet, &sessions[i].phev, -1));
+    }
+    TEST_ASSERT_EQUAL(-1, phev_fleet_add(fleet, &sessions[0].phev, -1));
+
+    TEST_ASSERT_EQUAL(0, phev_fleet_start(fleet));
+
+    uint64_t start = phev_timer_now();
+    bool allFired = false;
+
+    while (!allFired && phev_timer_now() - start < 2000)
+    {
+        SLEEP(10);
+        allFired = true;
+        for (int i = 0; i < TEST_PHEV_FLEET_SESSIONS; i++)
+        {
+            allFired = allFired && atomic_load(&sessions[i].fired) >= 3;
+        }
+    }
+
+    phev_fleet_stop(fleet);
+
+    TEST_ASSERT_TRUE(allFired);
+
+    for (int i = 0; i < TEST_PHEV_FLEET_SESSIONS; i++)
+    {
+        phevFleetSessionStats_t stats;
+
+        TEST_ASSERT_EQUAL(0, phev_fleet_sessionStats(fleet, &sessions[i].phev, &stats));
+        TEST_ASSERT_TRUE(stats.steps >= 3);
+        TEST_ASSERT_EQUAL(0, phev_fleet_remove(fleet, &sessions[i].phev));
+    }
+    TEST_ASSERT_EQUAL(0, fleet->numberOfSessions);
+
+    phev_fleet_destroy(fleet);
+}
+void test_phev_fleet_steps_readable_session(void)
+{
+    int sockets[2];
+    test_phev_fleet_session_t session;
+
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    test_phev_fleet_socket = sockets[0];
+    atomic_init(&test_phev_fleet_reads, 0);
+
+    phevFleet_t * fleet = phev_fleet_create(1, 1);
+
+    test_phev_fleet_initSession(&session);
+    TEST_ASSERT_EQUAL(0, phev_fleet_add(fleet, &session.phev, sockets[0]));
+    TEST_ASSERT_EQUAL(0, phev_fleet_start(fleet));
+
+    uint8_t data[] = {0xf2, 0x04, 0x00, 0x06, 0x00, 0xfc};
+    uint64_t start = phev_timer_now();
+
+    for (int i = 0; i < 2; i++)
+    {
+        TEST_ASSERT_EQUAL(sizeof(data), write(sockets[1], data, sizeof(data)));
+        while (atomic_load(&test_phev_fleet_reads) <= i && phev_timer_now() - start < 2000)
+        {
+            SLEEP(1);
+        }
+    }
+
+    phev_fleet_destroy(fleet);
+    test_phev_fleet_socket = -1;
+    close(sockets[0]);
+    close(sockets[1]);
+
+    TEST_ASSERT_EQUAL(2, atomic_load(&test_phev_fleet_reads));
+}
+void test_phev_fleet_follows_reconnect(void)
+{
+    test_phev_fleet_session_t session;
+    uint8_t data[] = {0xf2, 0x04, 0x00, 0x06, 0x00, 0xfc};
+
+    atomic_init(&test_phev_fleet_reads, 0);
+    atomic_init(&test_phev_fleet_connects, 0);
+
+    phevFleet_t * fleet = phev_fleet_create(1, 1);
+
+    test_phev_fleet_initSession(&session);
+
+    messagingClient_t * out = session.service.pipe->pipe->out;
+
+    out->incomingHandler = test_phev_fleet_readOrDrop;
+    out->connect = test_phev_fleet_connect;
+    session.service.pipe->socketHandler = test_phev_fleet_socketHandler;
+
+    TEST_ASSERT_EQUAL(0, test_phev_fleet_connect(out));
+    TEST_ASSERT_EQUAL(0, phev_fleet_add(fleet, &session.phev, test_phev_fleet_socket));
+    TEST_ASSERT_EQUAL(0, phev_fleet_start(fleet));
+
+    uint64_t start = phev_timer_now();
+
+    TEST_ASSERT_EQUAL(sizeof(data), write(atomic_load(&test_phev_fleet_peer), data, sizeof(data)));
+    while (atomic_load(&test_phev_fleet_reads) < 1 && phev_timer_now() - start < 2000)
+    {
+        SLEEP(1);
+    }
+
+    // The worker sees the connection close, drops it and reconnects on a later step
+    close(atomic_load(&test_phev_fleet_peer));
+    while (atomic_load(&test_phev_fleet_connects) < 2 && phev_timer_now() - start < 2000)
+    {
+        SLEEP(1);
+    }
+    TEST_ASSERT_EQUAL(2, atomic_load(&test_phev_fleet_connects));
+
+    TEST_ASSERT_EQUAL(sizeof(data), write(atomic_load(&test_phev_fleet_peer), data, sizeof(data)));
+    while (atomic_load(&test_phev_fleet_reads) < 2 && phev_timer_now() - start < 2000)
+    {
+        SLEEP(1);
+    }
+
+    phev_fleet_destroy(fleet);
+    close(test_phev_fleet_socket);
+    close(atomic_load(&test_phev_fleet_peer));
+    test_phev_fleet_socket = -1;
+
+    TEST_ASSERT_EQUAL(2, atomic_load(&test_phev_fleet_reads));
+}
+#endif
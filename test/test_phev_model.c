@@ -1,7 +1,12 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include "unity.h"
 #include "phev_model.h"
 #include "logger.h"
 
+#define TEST_PHEV_MODEL_WRITES 20000
+
 void test_phev_model_create_model(void)
 {
     phevModel_t * model = phev_model_create();
@@ -109,4 +114,317 @@ void test_phev_model_compare_not_set(void)
 
     TEST_ASSERT_NOT_EQUAL(0,ret);
 
-}
\ No newline at end of file
+}
+void test_phev_model_register_version(void)
+{
+    const uint8_t data[] = {1,2,3,4};
+    const uint8_t newData[] = {1,2,4,4};
+
+    phevModel_t * model = phev_model_create();
+
+    TEST_ASSERT_EQUAL(0,phev_model_registerVersion(model,0x11));
+
+    phev_model_setRegister(model,0x11,data,4);
+
+    uint32_t version = phev_model_registerVersion(model,0x11);
+
+    TEST_ASSERT_NOT_EQUAL(0,version);
+
+    phev_model_setRegister(model,0x11,data,4);
+
+    TEST_ASSERT_EQUAL(version,phev_model_registerVersion(model,0x11));
+
+    phev_model_setRegister(model,0x12,data,4);
+    phev_model_setRegister(model,0x11,newData,4);
+
+    TEST_ASSERT_TRUE(phev_model_registerVersion(model,0x11) > phev_model_registerVersion(model,0x12));
+
+    const phevRegister_t * reg = phev_model_peekRegister(model,0x11);
+
+    TEST_ASSERT_NOT_NULL(reg);
+    TEST_ASSERT_EQUAL_MEMORY(newData,reg->data,4);
+    TEST_ASSERT_NULL(phev_model_peekRegister(model,0x13));
+}
+void test_phev_model_compare_register_data_length(void)
+{
+    const uint8_t data[] = {1,2,3,4};
+
+    phevModel_t * model = phev_model_create();
+
+    phev_model_setRegister(model,0x11,data,3);
+
+    TEST_ASSERT_EQUAL(0,phev_model_compareRegisterData(model,0x11,data,3));
+    TEST_ASSERT_NOT_EQUAL(0,phev_model_compareRegisterData(model,0x11,data,4));
+    TEST_ASSERT_NOT_EQUAL(0,phev_model_compareRegisterData(model,0x12,data,3));
+}
+void test_phev_model_register_in_place(void)
+{
+    const uint8_t data[] = {1,2,3,4};
+    const uint8_t shorter[] = {5,6};
+    uint8_t tooBig[PHEV_MODEL_REGISTER_SIZE + 1];
+
+    memset(tooBig,0,sizeof(tooBig));
+
+    phevModel_t * model = phev_model_create();
+
+    phev_model_setRegister(model,0x11,data,sizeof(data));
+
+    const phevRegister_t * reg = phev_model_peekRegister(model,0x11);
+
+    TEST_ASSERT_EQUAL_PTR(&model->registers[0x11],reg);
+
+    phev_model_setRegister(model,0x11,shorter,sizeof(shorter));
+
+    TEST_ASSERT_EQUAL_PTR(reg,phev_model_peekRegister(model,0x11));
+    TEST_ASSERT_EQUAL(sizeof(shorter),reg->length);
+    TEST_ASSERT_EQUAL_MEMORY(shorter,reg->data,sizeof(shorter));
+
+    uint32_t version = phev_model_registerVersion(model,0x11);
+
+    TEST_ASSERT_EQUAL(0,phev_model_setRegister(model,0x11,tooBig,sizeof(tooBig)));
+    TEST_ASSERT_EQUAL(version,phev_model_registerVersion(model,0x11));
+    TEST_ASSERT_EQUAL_MEMORY(shorter,reg->data,sizeof(shorter));
+}
+void test_phev_model_history_latest(void)
+{
+    phevRegisterHistoryEntry_t entries[4];
+    phevModel_t * model = phev_model_create();
+
+    TEST_ASSERT_EQUAL(0,phev_model_historyLatest(model,0x1d,entries,4));
+    TEST_ASSERT_EQUAL(1,phev_model_enableHistory(model,0x1d,3));
+
+    for(uint8_t i = 0; i < 5; i++)
+    {
+        phev_model_setRegisterAt(model,0x1d,&i,1,100 * i);
+    }
+    phev_model_setRegisterAt(model,0x1d,(const uint8_t []) {4},1,1000);
+
+    TEST_ASSERT_EQUAL(3,phev_model_historyLatest(model,0x1d,entries,4));
+    TEST_ASSERT_EQUAL(4,entries[0].data[0]);
+    TEST_ASSERT_EQUAL(400,entries[0].time);
+    TEST_ASSERT_EQUAL(3,entries[1].data[0]);
+    TEST_ASSERT_EQUAL(2,entries[2].data[0]);
+
+    TEST_ASSERT_EQUAL(1,phev_model_historyLatest(model,0x1d,entries,1));
+    TEST_ASSERT_EQUAL(4,entries[0].data[0]);
+}
+void test_phev_model_history_range(void)
+{
+    phevRegisterHistoryEntry_t entries[8];
+    phevModel_t * model = phev_model_create();
+
+    phev_model_enableHistory(model,0x1d,8);
+
+    for(uint8_t i = 0; i < 12; i++)
+    {
+        phev_model_setRegisterAt(model,0x1d,&i,1,100 * i);
+    }
+
+    TEST_ASSERT_EQUAL(3,phev_model_historyRange(model,0x1d,550,800,entries,8));
+    TEST_ASSERT_EQUAL(6,entries[0].data[0]);
+    TEST_ASSERT_EQUAL(8,entries[2].data[0]);
+
+    TEST_ASSERT_EQUAL(2,phev_model_historyRange(model,0x1d,0,2000,entries,2));
+    TEST_ASSERT_EQUAL(4,entries[0].data[0]);
+    TEST_ASSERT_EQUAL(5,entries[1].data[0]);
+
+    TEST_ASSERT_EQUAL(0,phev_model_historyRange(model,0x1d,1200,2000,entries,8));
+}
+void test_phev_model_history_capacity(void)
+{
+    phevRegisterHistoryEntry_t entries[4];
+    phevModel_t * model = phev_model_create();
+
+    TEST_ASSERT_EQUAL(0,phev_model_enableHistory(model,0x1d,PHEV_MODEL_HISTORY_SIZE + 1));
+    TEST_ASSERT_EQUAL(1,phev_model_enableHistory(model,0x1d,0));
+    TEST_ASSERT_NULL(model->histories[0x1d]);
+
+    phev_model_enableHistory(model,0x1d,2);
+    phev_model_setRegisterAt(model,0x1d,(const uint8_t []) {1},1,100);
+
+    const phevRegisterHistory_t * ring = model->histories[0x1d];
+
+    TEST_ASSERT_EQUAL(1,phev_model_enableHistory(model,0x1d,0));
+    phev_model_setRegisterAt(model,0x1d,(const uint8_t []) {2},1,200);
+    TEST_ASSERT_EQUAL(0,phev_model_historyLatest(model,0x1d,entries,4));
+
+    // The ring is kept for the next time
+    phev_model_enableHistory(model,0x1d,4);
+    TEST_ASSERT_EQUAL_PTR(ring,model->histories[0x1d]);
+    TEST_ASSERT_EQUAL(0,phev_model_historyLatest(model,0x1d,entries,4));
+    phev_model_setRegisterAt(model,0x1d,(const uint8_t []) {3},1,300);
+    TEST_ASSERT_EQUAL(1,phev_model_historyLatest(model,0x1d,entries,4));
+    TEST_ASSERT_EQUAL(3,entries[0].data[0]);
+}
+void test_phev_model_read_register(void)
+{
+    phevRegister_t out[3];
+    phevModel_t * model = phev_model_create();
+
+    TEST_ASSERT_EQUAL(0,phev_model_readRegister(model,0x10,&out[0]));
+    TEST_ASSERT_EQUAL(0,out[0].length);
+
+    phev_model_setRegister(model,0x10,(const uint8_t []) {1,2,3},3);
+    phev_model_setRegister(model,0x11,(const uint8_t []) {4},1);
+
+    TEST_ASSERT_EQUAL(1,phev_model_readRegister(model,0x10,&out[0]));
+    TEST_ASSERT_EQUAL(3,out[0].length);
+    TEST_ASSERT_EQUAL_MEMORY(((const uint8_t []) {1,2,3}),out[0].data,3);
+
+    const uint8_t regs[] = {0x10,0x12,0x11};
+
+    TEST_ASSERT_EQUAL(phev_model_registerVersion(model,0x11),phev_model_snapshotRegisters(model,regs,3,out));
+    TEST_ASSERT_EQUAL(3,out[0].length);
+    TEST_ASSERT_EQUAL(0,out[1].length);
+    TEST_ASSERT_EQUAL(1,out[2].length);
+    TEST_ASSERT_EQUAL(4,out[2].data[0]);
+}
+// Sets the first register then the second to the same value, both filled with the low byte of the write count
+static void * test_phev_model_writer(void * ctx)
+{
+    phevModel_t * model = (phevModel_t *) ctx;
+    uint8_t data[PHEV_MODEL_REGISTER_SIZE];
+
+    for(int i = 1; i <= TEST_PHEV_MODEL_WRITES; i++)
+    {
+        memset(data,(uint8_t) i,sizeof(data));
+        phev_model_setRegister(model,0x01,data,sizeof(data));
+        phev_model_setRegister(model,0x02,data,sizeof(data));
+    }
+    return NULL;
+}
+static atomic_bool test_phev_model_reading;
+
+// Every entry is one byte and the ring is kept in time order, whatever capacity it had when it was read
+static void * test_phev_model_historyReader(void * ctx)
+{
+    phevModel_t * model = (phevModel_t *) ctx;
+    phevRegisterHistoryEntry_t entries[PHEV_MODEL_HISTORY_SIZE];
+    bool * consistent = malloc(sizeof(bool));
+
+    *consistent = true;
+    while(*consistent && atomic_load(&test_phev_model_reading))
+    {
+        size_t n = phev_model_historyLatest(model,0x1d,entries,PHEV_MODEL_HISTORY_SIZE);
+
+        for(size_t i = 0; i < n; i++)
+        {
+            *consistent = *consistent && entries[i].length == 1 && (i == 0 || entries[i].time <= entries[i - 1].time);
+        }
+        n = phev_model_historyRange(model,0x1d,0,UINT64_MAX,entries,PHEV_MODEL_HISTORY_SIZE);
+        for(size_t i = 0; i < n; i++)
+        {
+            *consistent = *consistent && entries[i].length == 1 && (i == 0 || entries[i].time >= entries[i - 1].time);
+        }
+    }
+    return consistent;
+}
+void test_phev_model_history_enable_while_reading(void)
+{
+    pthread_t reader;
+    phevModel_t * model = phev_model_create();
+    const size_t capacities[] = {PHEV_MODEL_HISTORY_SIZE,0,3,1,0,8};
+    uint64_t time = 0;
+    bool * consistent;
+
+    atomic_store(&test_phev_model_reading, true);
+    TEST_ASSERT_EQUAL(0,pthread_create(&reader,NULL,test_phev_model_historyReader,model));
+
+    for(int i = 0; i < TEST_PHEV_MODEL_WRITES; i++)
+    {
+        uint8_t value = (uint8_t) i;
+
+        if(i % 16 == 0)
+        {
+            phev_model_enableHistory(model,0x1d,capacities[(i / 16) % (sizeof(capacities) / sizeof(capacities[0]))]);
+        }
+        phev_model_setRegisterAt(model,0x1d,&value,1,time++);
+    }
+    atomic_store(&test_phev_model_reading, false);
+    pthread_join(reader,(void **) &consistent);
+
+    TEST_ASSERT_TRUE(*consistent);
+    free(consistent);
+}
+static atomic_int test_phev_model_writersDone;
+
+// Two of these run at once, one writes even bytes and the other odd ones so every set is a change
+static void * test_phev_model_oddEvenWriter(void * ctx)
+{
+    phevModel_t * model = ((phevModel_t **) ctx)[0];
+    const uint8_t odd = (((phevModel_t **) ctx)[1] != NULL);
+    uint8_t data[PHEV_MODEL_REGISTER_SIZE];
+
+    for(int i = 0; i < TEST_PHEV_MODEL_WRITES; i++)
+    {
+        memset(data,(uint8_t) (2 * i + odd),sizeof(data));
+        phev_model_setRegister(model,0x01,data,sizeof(data));
+        phev_model_setRegister(model,0x02,data,sizeof(data));
+    }
+    atomic_fetch_add(&test_phev_model_writersDone, 1);
+    return NULL;
+}
+void test_phev_model_two_writers(void)
+{
+    pthread_t writers[2];
+    phevModel_t * model = phev_model_create();
+    phevModel_t * args[2][2] = {{model,NULL},{model,model}};
+    const uint8_t regs[] = {0x01,0x02};
+    bool consistent = true;
+
+    atomic_store(&test_phev_model_writersDone, 0);
+    for(int i = 0; i < 2; i++)
+    {
+        TEST_ASSERT_EQUAL(0,pthread_create(&writers[i],NULL,test_phev_model_oddEvenWriter,args[i]));
+    }
+    while(atomic_load(&test_phev_model_writersDone) < 2)
+    {
+        phevRegister_t out[2];
+
+        phev_model_snapshotRegisters(model,regs,2,out);
+        for(size_t reg = 0; reg < 2; reg++)
+        {
+            for(size_t i = 0; i < out[reg].length; i++)
+            {
+                consistent = consistent && out[reg].data[i] == out[reg].data[0];
+            }
+        }
+    }
+    for(int i = 0; i < 2; i++)
+    {
+        pthread_join(writers[i],NULL);
+    }
+
+    TEST_ASSERT_TRUE(consistent);
+    TEST_ASSERT_EQUAL(4 * TEST_PHEV_MODEL_WRITES,model->version);
+    TEST_ASSERT_EQUAL(0,atomic_load(&model->sequence) & 1);
+}
+void test_phev_model_snapshot_while_writing(void)
+{
+    pthread_t writer;
+    phevModel_t * model = phev_model_create();
+    const uint8_t regs[] = {0x01,0x02};
+    bool consistent = true;
+
+    TEST_ASSERT_EQUAL(0,pthread_create(&writer,NULL,test_phev_model_writer,model));
+
+    while(consistent && phev_model_registerVersion(model,0x02) < 2 * TEST_PHEV_MODEL_WRITES)
+    {
+        phevRegister_t out[2];
+
+        if(phev_model_snapshotRegisters(model,regs,2,out) == 0)
+        {
+            continue;
+        }
+        for(size_t i = 0; i < out[0].length; i++)
+        {
+            consistent = consistent && out[0].data[i] == out[0].data[0] && out[1].data[i] == out[1].data[0];
+        }
+        // Never a second register newer than the first one, or one written half way through
+        consistent = consistent && out[0].length == PHEV_MODEL_REGISTER_SIZE;
+        consistent = consistent && (out[1].length == 0 || out[0].data[0] == out[1].data[0] || out[0].data[0] == (uint8_t) (out[1].data[0] + 1));
+    }
+    pthread_join(writer,NULL);
+
+    TEST_ASSERT_TRUE(consistent);
+}
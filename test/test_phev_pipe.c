@@ -492,6 +492,83 @@ void test_phev_pipe_ping_odd_xor(void)
     TEST_ASSERT_NOT_NULL(test_pipe_global_message[0]);
     TEST_ASSERT_EQUAL_MEMORY(expected,test_pipe_global_message[0]->data,sizeof(expected));
 } 
+static phev_pipe_ctx_t * test_phev_pipe_createPingPipe(void)
+{
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerOut,
+        .outgoingHandler = test_phev_pipe_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = NULL,
+        .preConnectHook = NULL,
+    };
+    return phev_pipe_createPipe(settings);
+}
+void test_phev_pipe_pingReceived_rtt(void)
+{
+    phev_pipe_ctx_t * ctx = test_phev_pipe_createPingPipe();
+
+    ctx->ping.sentAt[5] = 1000;
+    ctx->ping.lastSequence = 5;
+
+    phev_pipe_pingReceived(ctx, 5, 1040);
+
+    TEST_ASSERT_EQUAL(1, ctx->ping.samples);
+    TEST_ASSERT_EQUAL(40, ctx->ping.lastRtt);
+    TEST_ASSERT_EQUAL(40, phev_pipe_pingRtt(ctx));
+    TEST_ASSERT_EQUAL(1, ctx->ping.histogram[6]);
+    TEST_ASSERT_EQUAL(0, ctx->ping.sentAt[5]);
+    TEST_ASSERT_EQUAL(PHEV_PIPE_PING_INTERVAL * 2, ctx->ping.interval);
+
+    phev_pipe_pingReceived(ctx, 5, 1080);
+
+    TEST_ASSERT_EQUAL(1, ctx->ping.samples);
+
+    ctx->ping.sentAt[6] = 2000;
+
+    phev_pipe_pingReceived(ctx, 6, 2000 + PHEV_PIPE_PING_HEALTHY_RTT + 1);
+
+    TEST_ASSERT_EQUAL(2, ctx->ping.samples);
+    TEST_ASSERT_EQUAL(40, ctx->ping.minRtt);
+    TEST_ASSERT_EQUAL(PHEV_PIPE_PING_HEALTHY_RTT + 1, ctx->ping.maxRtt);
+    TEST_ASSERT_EQUAL((((40 << 3) + PHEV_PIPE_PING_HEALTHY_RTT + 1 - 40) + 4) >> 3, phev_pipe_pingRtt(ctx));
+    TEST_ASSERT_EQUAL(PHEV_PIPE_PING_INTERVAL, ctx->ping.interval);
+}
+void test_phev_pipe_ping_lost(void)
+{
+    test_pipe_global_message_idx = 0;
+    test_pipe_global_message[0] = NULL;
+    test_pipe_global_in_message = NULL;
+
+    phev_pipe_ctx_t * ctx = test_phev_pipe_createPingPipe();
+
+    phev_pipe_ping(ctx);
+
+    TEST_ASSERT_NOT_NULL(test_pipe_global_message[0]);
+    TEST_ASSERT_EQUAL(1, ctx->ping.lastSequence);
+    TEST_ASSERT_NOT_EQUAL(0, ctx->ping.sentAt[1]);
+
+    ctx->ping.interval = PHEV_PIPE_PING_MAX_INTERVAL;
+
+    phev_timer_advance(&ctx->timers, phev_timer_time(&ctx->timers) + PHEV_PIPE_PING_INTERVAL);
+
+    TEST_ASSERT_EQUAL(1, ctx->ping.lost);
+    TEST_ASSERT_EQUAL(PHEV_PIPE_PING_INTERVAL, ctx->ping.interval);
+    TEST_ASSERT_EQUAL(2, ctx->ping.lastSequence);
+}
 void test_phev_pipe_commandResponder_should_only_respond_to_commands(void)
 {
     const uint8_t reg[] = {0x9f,0x04,0x01,0x10,0x06,0xba};
@@ -977,6 +1054,100 @@ void test_phev_pipe_splitter_two_encoded_messages(void)
 
 }
 
+void test_phev_pipe_splitter_message_split_across_reads(void)
+{
+    uint8_t msg_data[] = {0xFD,0xC6,0xC3,0xD9,0xC2,0x9D,0xAD,0xCB,0xC2,0xE0,0xC2,0xC2,0x3D,0xBD,0x3D,0xC3,0xDA};
+    const uint8_t msg2_data[] = {0xAD,0xCB,0xC2,0xE0,0xC2,0xC2,0x3D,0xBD,0x3D,0xC3,0xDA};
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerOut,
+        .outgoingHandler = test_phev_pipe_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = (msg_pipe_responder_t) phev_pipe_commandResponder,
+        .outputOutputTransformer = (msg_pipe_transformer_t) phev_pipe_outputEventTransformer,
+        .preConnectHook = NULL,
+        .outputInputTransformer = (msg_pipe_transformer_t) phev_pipe_outputChainInputTransformer,
+    };
+
+    phev_pipe_ctx_t * ctx =  phev_pipe_createPipe(settings);
+
+    message_t * first = msg_utils_createMsg(msg_data, 10);
+    message_t * second = msg_utils_createMsg(msg_data + 10, sizeof(msg_data) - 10);
+
+    messageBundle_t * messages = phev_pipe_outputSplitter(ctx, first);
+
+    TEST_ASSERT_NOT_NULL(messages);
+    TEST_ASSERT_EQUAL(1, messages->numMessages);
+    TEST_ASSERT_EQUAL_MEMORY(msg_data, messages->messages[0]->data, 6);
+
+    messages = phev_pipe_outputSplitter(ctx, second);
+
+    TEST_ASSERT_NOT_NULL(messages);
+    TEST_ASSERT_EQUAL(1, messages->numMessages);
+    TEST_ASSERT_EQUAL(sizeof(msg2_data), messages->messages[0]->length);
+    TEST_ASSERT_EQUAL_MEMORY(msg2_data, messages->messages[0]->data, sizeof(msg2_data));
+    TEST_ASSERT_EQUAL(0xc2, phev_core_getMessageXOR(messages->messages[0]));
+}
+void test_phev_pipe_splitter_attaches_decoded_message(void)
+{
+    const uint8_t msg_data[] = {0xFD,0xC6,0xC3,0xD9,0xC2,0x9D,0xAD,0xCB,0xC2,0xE0,0xC2,0xC2,0x3D,0xBD,0x3D,0xC3,0xDA};
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerOut,
+        .outgoingHandler = test_phev_pipe_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = (msg_pipe_responder_t) phev_pipe_commandResponder,
+        .outputOutputTransformer = (msg_pipe_transformer_t) phev_pipe_outputEventTransformer,
+        .preConnectHook = NULL,
+        .outputInputTransformer = (msg_pipe_transformer_t) phev_pipe_outputChainInputTransformer,
+    };
+
+    phev_pipe_ctx_t * ctx =  phev_pipe_createPipe(settings);
+
+    message_t * message = msg_utils_createMsg(msg_data, sizeof(msg_data));
+
+    messageBundle_t * messages = phev_pipe_outputSplitter(ctx, message);
+
+    TEST_ASSERT_NOT_NULL(messages);
+    TEST_ASSERT_EQUAL(2, messages->numMessages);
+
+    phevMessage_t * ping = phev_core_getDecodedMessage(messages->messages[0], NULL);
+    phevMessage_t * update = phev_core_getDecodedMessage(messages->messages[1], NULL);
+
+    TEST_ASSERT_NOT_NULL(ping);
+    TEST_ASSERT_NOT_NULL(update);
+    TEST_ASSERT_EQUAL(0x3f, ping->command);
+    TEST_ASSERT_EQUAL(0x6f, update->command);
+    TEST_ASSERT_EQUAL(0x22, update->reg);
+    TEST_ASSERT_EQUAL(0xc2, phev_core_getMessageXOR(messages->messages[1]));
+}
+
 void test_phev_pipe_no_input_connection(void)
 {
     test_pipe_global_message_idx = 0;
@@ -1095,6 +1266,104 @@ void test_phev_pipe_waitForConnection(void)
 
     TEST_ASSERT_TRUE(ctx->connected);
 }
+void test_phev_pipe_connectBackoff(void)
+{
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerOut,
+        .outgoingHandler = test_phev_pipe_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = NULL,
+        .preConnectHook = NULL,
+    };
+    phev_pipe_ctx_t * ctx =  phev_pipe_createPipe(settings);
+
+    ctx->connectAttempts = 0;
+    TEST_ASSERT_TRUE(phev_pipe_connectBackoff(ctx) > 0);
+
+    ctx->connectAttempts = 20;
+
+    uint64_t first = phev_pipe_connectBackoff(ctx);
+    bool jittered = false;
+
+    for (int i = 0; i < 32; i++)
+    {
+        uint64_t delay = phev_pipe_connectBackoff(ctx);
+
+        TEST_ASSERT_TRUE(delay >= PHEV_CONNECT_MAX_BACKOFF / 2);
+        TEST_ASSERT_TRUE(delay <= PHEV_CONNECT_MAX_BACKOFF);
+        jittered = jittered || delay != first;
+    }
+    TEST_ASSERT_TRUE(jittered);
+}
+void test_phev_pipe_start_deferred_until_connected(void)
+{
+    test_pipe_global_message_idx = 0;
+    test_pipe_global_message[0] = NULL;
+    test_pipe_global_in_message = NULL;
+
+    const uint8_t expected[] = {0xf2,0x0a,0x00,0x01,0x24,0x0d,0xc2,0xc2,0x91,0x85,0x00,0xc8};
+
+    uint8_t mac[] = {0x24,0x0d,0xc2,0xc2,0x91,0x85};
+
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerOut,
+        .outgoingHandler = test_phev_pipe_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = NULL,
+        .preConnectHook = NULL,
+    };
+    phev_pipe_ctx_t * ctx =  phev_pipe_createPipe(settings);
+
+    in->connected = 0;
+    out->connected = 0;
+
+    phev_pipe_start(ctx, mac);
+
+    TEST_ASSERT_FALSE(ctx->connected);
+    TEST_ASSERT_TRUE(ctx->startPending);
+    TEST_ASSERT_EQUAL(1, ctx->connectAttempts);
+    TEST_ASSERT_TRUE(phev_timer_active(&ctx->reconnectTimer));
+    TEST_ASSERT_NULL(test_pipe_global_message[0]);
+
+    in->connected = 1;
+    out->connected = 1;
+
+    phev_pipe_step(ctx, false);
+
+    TEST_ASSERT_TRUE(ctx->connected);
+    TEST_ASSERT_FALSE(ctx->startPending);
+    TEST_ASSERT_EQUAL(0, ctx->connectAttempts);
+    TEST_ASSERT_NOT_NULL(test_pipe_global_message[0]);
+    TEST_ASSERT_EQUAL_MEMORY(expected,test_pipe_global_message[0]->data,sizeof(expected));
+}
 void test_phev_pipe_updateRegister(void)
 {
     test_pipe_global_message_idx = 0;
@@ -1241,11 +1510,243 @@ void test_phev_pipe_updateRegisterWithCallback_encoded(void)
     TEST_ASSERT_EQUAL(0x0a,test_phev_pipe_update_register_callback_expected_reg);
     
     
+}
+static int test_phev_pipe_update_timeout_called = 0;
+
+void test_phev_pipe_update_timeout_callback(phev_pipe_ctx_t * ctx, uint8_t reg, void * customCtx)
+{
+    test_phev_pipe_update_timeout_called++;
+}
+void test_phev_pipe_updateRegister_more_than_ten_pending(void)
+{
+    test_pipe_global_message_idx = 0;
+    test_pipe_global_message[0] = NULL;
+    test_pipe_global_in_message = NULL;
+    test_phev_pipe_update_register_callback_called = 0;
+
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = (msg_pipe_responder_t) phev_pipe_commandResponder,
+        .outputOutputTransformer = (msg_pipe_transformer_t) phev_pipe_outputEventTransformer,
+        .preConnectHook = NULL,
+        .outputInputTransformer = (msg_pipe_transformer_t) phev_pipe_outputChainInputTransformer,
+    };
+    phev_pipe_ctx_t * ctx =  phev_pipe_createPipe(settings);
+
+    for (int i = 0; i < 40; i++)
+    {
+        phev_pipe_updateRegisterWithCallback(ctx, 0x10 + (i % 20), 1, (phev_pipe_updateRegisterCallback_t) test_phev_pipe_update_register_callback, NULL);
+    }
+
+    TEST_ASSERT_EQUAL(40, ctx->updateRegisterCallbacks->numberOfCallbacks);
+    TEST_ASSERT_EQUAL(1, ctx->eventHandlers);
+
+    phevMessage_t * ack = phev_core_responseMessage(RESP_CMD, 0x12, NULL, 0);
+    phevPipeEvent_t * event = phev_pipe_createRegisterEvent(ctx, ack);
+
+    phev_pipe_sendEventToHandlers(ctx, event);
+
+    TEST_ASSERT_EQUAL(2, test_phev_pipe_update_register_callback_called);
+    TEST_ASSERT_EQUAL(0x12, test_phev_pipe_update_register_callback_expected_reg);
+    TEST_ASSERT_EQUAL(38, ctx->updateRegisterCallbacks->numberOfCallbacks);
+}
+void test_phev_pipe_updateRegister_retries_then_times_out(void)
+{
+    test_pipe_global_message_idx = 0;
+    test_pipe_global_message[0] = NULL;
+    test_pipe_global_in_message = NULL;
+    test_phev_pipe_update_register_callback_called = 0;
+    test_phev_pipe_update_timeout_called = 0;
+
+    const uint8_t expected[] = {0xf6,0x04,0x00,0x10,0x01,0x0b};
+
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerOut,
+        .outgoingHandler = test_phev_pipe_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = (msg_pipe_responder_t) phev_pipe_commandResponder,
+        .outputOutputTransformer = (msg_pipe_transformer_t) phev_pipe_outputEventTransformer,
+        .preConnectHook = NULL,
+        .outputInputTransformer = (msg_pipe_transformer_t) phev_pipe_outputChainInputTransformer,
+    };
+    phev_pipe_ctx_t * ctx =  phev_pipe_createPipe(settings);
+
+    uint64_t now = phev_timer_now();
+
+    phev_pipe_updateComplexRegisterWithTimeout(ctx, 0x10, expected + 4, 1, (phev_pipe_updateRegisterCallback_t) test_phev_pipe_update_register_callback, test_phev_pipe_update_timeout_callback, NULL);
+
+    phev_pipe_checkPendingUpdates(ctx, now);
+
+    TEST_ASSERT_EQUAL(1, test_pipe_global_message_idx);
+
+    for (int i = 1; i <= PHEV_PIPE_UPDATE_MAX_RETRIES; i++)
+    {
+        phev_pipe_checkPendingUpdates(ctx, now + i * 100000);
+
+        TEST_ASSERT_EQUAL(i + 1, test_pipe_global_message_idx);
+        TEST_ASSERT_EQUAL_MEMORY(expected, test_pipe_global_message[i]->data, sizeof(expected));
+    }
+
+    TEST_ASSERT_EQUAL(0, test_phev_pipe_update_timeout_called);
+
+    phev_pipe_checkPendingUpdates(ctx, now + 1000000);
+
+    TEST_ASSERT_EQUAL(1, test_phev_pipe_update_timeout_called);
+    TEST_ASSERT_EQUAL(0, test_phev_pipe_update_register_callback_called);
+    TEST_ASSERT_EQUAL(0, ctx->updateRegisterCallbacks->numberOfCallbacks);
 }
 int test_phev_pipe_event_handler(phev_pipe_ctx_t * ctx, phevPipeEvent_t * event)
 {
 
 }
+static int test_phev_pipe_submitted_count = 0;
+
+static void test_phev_pipe_outHandlerCount(messagingClient_t *client, message_t *message)
+{
+    test_phev_pipe_submitted_count++;
+}
+static phev_pipe_ctx_t * test_phev_pipe_createCountingPipe(void)
+{
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_pipe_inHandlerIn,
+        .outgoingHandler = test_phev_pipe_outHandlerCount,
+    };
+
+    phev_pipe_settings_t settings = {
+        .in = msg_core_createMessagingClient(inSettings),
+        .out = msg_core_createMessagingClient(outSettings),
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = (msg_pipe_responder_t) phev_pipe_commandResponder,
+        .outputOutputTransformer = (msg_pipe_transformer_t) phev_pipe_outputEventTransformer,
+        .preConnectHook = NULL,
+        .outputInputTransformer = (msg_pipe_transformer_t) phev_pipe_outputChainInputTransformer,
+    };
+
+    test_phev_pipe_submitted_count = 0;
+
+    return phev_pipe_createPipe(settings);
+}
+void test_phev_pipe_submitUpdate_sent_when_drained(void)
+{
+    phev_pipe_ctx_t * ctx = test_phev_pipe_createCountingPipe();
+    const uint8_t data[] = {1, 2, 3};
+
+    TEST_ASSERT_TRUE(phev_pipe_submitUpdate(ctx, 0x10, data, sizeof(data), NULL, NULL, NULL));
+    TEST_ASSERT_TRUE(phev_pipe_commandsPending(ctx));
+    TEST_ASSERT_EQUAL(0, test_phev_pipe_submitted_count);
+    TEST_ASSERT_EQUAL(0, ctx->updateRegisterCallbacks->numberOfCallbacks);
+
+    TEST_ASSERT_EQUAL(1, phev_pipe_drainCommands(ctx));
+
+    TEST_ASSERT_FALSE(phev_pipe_commandsPending(ctx));
+    TEST_ASSERT_EQUAL(1, test_phev_pipe_submitted_count);
+    TEST_ASSERT_EQUAL(1, ctx->updateRegisterCallbacks->numberOfCallbacks);
+    TEST_ASSERT_EQUAL(0x10, ctx->updateRegisterCallbacks->updates[0].reg);
+    TEST_ASSERT_EQUAL_MEMORY(data, ctx->updateRegisterCallbacks->updates[0].value, sizeof(data));
+}
+void test_phev_pipe_submitUpdate_full(void)
+{
+    phev_pipe_ctx_t * ctx = test_phev_pipe_createCountingPipe();
+    const uint8_t value = 1;
+    uint8_t tooLong[PHEV_PIPE_COMMAND_MAX_DATA + 1] = {0};
+
+    TEST_ASSERT_FALSE(phev_pipe_submitUpdate(ctx, 0x10, tooLong, sizeof(tooLong), NULL, NULL, NULL));
+
+    for (int i = 0; i < PHEV_PIPE_COMMAND_QUEUE_SIZE; i++)
+    {
+        TEST_ASSERT_TRUE(phev_pipe_submitUpdate(ctx, 0x10, &value, 1, NULL, NULL, NULL));
+    }
+    TEST_ASSERT_FALSE(phev_pipe_submitUpdate(ctx, 0x10, &value, 1, NULL, NULL, NULL));
+
+    TEST_ASSERT_EQUAL(PHEV_PIPE_COMMAND_QUEUE_SIZE, phev_pipe_drainCommands(ctx));
+    TEST_ASSERT_TRUE(phev_pipe_submitUpdate(ctx, 0x10, &value, 1, NULL, NULL, NULL));
+    TEST_ASSERT_EQUAL(1, phev_pipe_drainCommands(ctx));
+    TEST_ASSERT_EQUAL(PHEV_PIPE_COMMAND_QUEUE_SIZE + 1, test_phev_pipe_submitted_count);
+}
+#if defined(__linux__)
+#include <pthread.h>
+
+#define TEST_PHEV_PIPE_PRODUCERS 4
+#define TEST_PHEV_PIPE_PRODUCER_COMMANDS 200
+
+static void * test_phev_pipe_producer(void * arg)
+{
+    phev_pipe_ctx_t * ctx = (phev_pipe_ctx_t *) arg;
+
+    for (int i = 0; i < TEST_PHEV_PIPE_PRODUCER_COMMANDS; i++)
+    {
+        const uint8_t value = (uint8_t) i;
+
+        while (!phev_pipe_submitUpdate(ctx, 0x10 + (i % 8), &value, 1, NULL, NULL, NULL))
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+void test_phev_pipe_submitUpdate_concurrent_producers(void)
+{
+    phev_pipe_ctx_t * ctx = test_phev_pipe_createCountingPipe();
+    pthread_t producers[TEST_PHEV_PIPE_PRODUCERS];
+    const int expected = TEST_PHEV_PIPE_PRODUCERS * TEST_PHEV_PIPE_PRODUCER_COMMANDS;
+
+    for (int i = 0; i < TEST_PHEV_PIPE_PRODUCERS; i++)
+    {
+        pthread_create(&producers[i], NULL, test_phev_pipe_producer, ctx);
+    }
+
+    uint64_t start = phev_timer_now();
+
+    while (test_phev_pipe_submitted_count < expected && phev_timer_now() - start < 5000)
+    {
+        phev_pipe_drainCommands(ctx);
+    }
+
+    for (int i = 0; i < TEST_PHEV_PIPE_PRODUCERS; i++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+
+    TEST_ASSERT_EQUAL(expected, test_phev_pipe_submitted_count);
+    TEST_ASSERT_FALSE(phev_pipe_commandsPending(ctx));
+}
+#endif
 void test_phev_pipe_registerEventHandler(void)
 {
     test_pipe_global_message_idx = 0;
@@ -0,0 +1,269 @@
+#include "unity.h"
+#include "phev_reactor.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <pthread.h>
+
+static int test_phev_reactor_socket = -1;
+static int test_phev_reactor_reads = 0;
+static int test_phev_reactor_timers = 0;
+static int test_phev_reactor_peer = -1;
+static uint16_t test_phev_reactor_port = 0;
+
+static void test_phev_reactor_outgoingHandler(messagingClient_t *client, message_t *message)
+{
+    return;
+}
+static message_t * test_phev_reactor_noIncoming(messagingClient_t *client)
+{
+    return NULL;
+}
+static message_t * test_phev_reactor_readIncoming(messagingClient_t *client)
+{
+    uint8_t buffer[64];
+
+    if (read(test_phev_reactor_socket, buffer, sizeof(buffer)) > 0)
+    {
+        test_phev_reactor_reads++;
+    }
+    return NULL;
+}
+static int test_phev_reactor_socketHandler(messagingClient_t *client)
+{
+    return test_phev_reactor_socket;
+}
+// Every connect is a new socket, as when the car comes back
+static int test_phev_reactor_connect(messagingClient_t *client)
+{
+    int sockets[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+    {
+        return -1;
+    }
+    test_phev_reactor_socket = sockets[0];
+    test_phev_reactor_peer = sockets[1];
+
+    return 0;
+}
+// Connects to the test listener without waiting, as the library's tcpip client does
+static int test_phev_reactor_connectHandler(messagingClient_t *client, phevTcpConnect_t *connect)
+{
+    test_phev_reactor_socket = phev_tcpClientConnect(connect, "127.0.0.1", test_phev_reactor_port);
+
+    return (test_phev_reactor_socket < 0 ? -1 : 0);
+}
+static void * test_phev_reactor_run(void *ctx)
+{
+    phev_reactor_run((phevReactor_t *) ctx);
+
+    return NULL;
+}
+static void test_phev_reactor_timerCallback(phevTimer_t *timer, void *ctx)
+{
+    test_phev_reactor_timers++;
+}
+static phev_pipe_ctx_t * test_phev_reactor_createPipe(void)
+{
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_reactor_noIncoming,
+        .outgoingHandler = test_phev_reactor_outgoingHandler,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_reactor_readIncoming,
+        .outgoingHandler = test_phev_reactor_outgoingHandler,
+    };
+
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    in->connected = 1;
+    out->connected = 1;
+
+    phev_pipe_settings_t settings = {
+        .in = in,
+        .out = out,
+        .inputSplitter = NULL,
+        .outputSplitter = NULL,
+        .inputResponder = NULL,
+        .outputResponder = NULL,
+        .preConnectHook = NULL,
+    };
+
+    return phev_pipe_createPipe(settings);
+}
+void test_phev_reactor_steps_readable_pipe(void)
+{
+    int sockets[2];
+
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    test_phev_reactor_socket = sockets[0];
+    test_phev_reactor_reads = 0;
+
+    phevReactor_t * reactor = phev_reactor_create(4);
+    phev_pipe_ctx_t * idle = test_phev_reactor_createPipe();
+    phev_pipe_ctx_t * pipe = test_phev_reactor_createPipe();
+
+    TEST_ASSERT_NOT_NULL(reactor);
+    TEST_ASSERT_EQUAL(0, phev_reactor_add(reactor, idle, -1));
+    TEST_ASSERT_EQUAL(0, phev_reactor_add(reactor, pipe, sockets[0]));
+    TEST_ASSERT_EQUAL(-1, phev_reactor_add(reactor, pipe, sockets[0]));
+
+    uint8_t data[] = {0xf2, 0x04, 0x00, 0x06, 0x00, 0xfc};
+
+    TEST_ASSERT_EQUAL(sizeof(data), write(sockets[1], data, sizeof(data)));
+
+    TEST_ASSERT_EQUAL(1, phev_reactor_step(reactor, 100));
+    TEST_ASSERT_EQUAL(1, test_phev_reactor_reads);
+
+    TEST_ASSERT_EQUAL(0, phev_reactor_remove(reactor, pipe));
+    TEST_ASSERT_EQUAL(-1, phev_reactor_remove(reactor, pipe));
+    TEST_ASSERT_EQUAL(1, reactor->numberOfSessions);
+
+    phev_reactor_destroy(reactor);
+    close(sockets[0]);
+    close(sockets[1]);
+}
+void test_phev_reactor_wakes_for_timer(void)
+{
+    test_phev_reactor_timers = 0;
+
+    phevReactor_t * reactor = phev_reactor_create(1);
+    phev_pipe_ctx_t * pipe = test_phev_reactor_createPipe();
+    phevTimer_t timer;
+
+    TEST_ASSERT_EQUAL(0, phev_reactor_add(reactor, pipe, -1));
+
+    phev_timer_init(&timer, test_phev_reactor_timerCallback, NULL);
+    phev_timer_start(&pipe->timers, &timer, 20);
+
+    uint64_t start = phev_timer_now();
+
+    while (test_phev_reactor_timers == 0 && phev_timer_now() - start < 1000)
+    {
+        phev_reactor_step(reactor, -1);
+    }
+
+    TEST_ASSERT_EQUAL(1, test_phev_reactor_timers);
+    TEST_ASSERT_TRUE(phev_timer_now() - start < 500);
+
+    phev_reactor_destroy(reactor);
+}
+void test_phev_reactor_follows_reconnect(void)
+{
+    uint8_t data[] = {0xf2, 0x04, 0x00, 0x06, 0x00, 0xfc};
+
+    test_phev_reactor_reads = 0;
+
+    phevReactor_t * reactor = phev_reactor_create(1);
+    phev_pipe_ctx_t * pipe = test_phev_reactor_createPipe();
+
+    pipe->socketHandler = test_phev_reactor_socketHandler;
+    pipe->pipe->out->connect = test_phev_reactor_connect;
+
+    TEST_ASSERT_EQUAL(0, test_phev_reactor_connect(pipe->pipe->out));
+    TEST_ASSERT_EQUAL(0, phev_reactor_add(reactor, pipe, test_phev_reactor_socket));
+
+    TEST_ASSERT_EQUAL(sizeof(data), write(test_phev_reactor_peer, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(1, phev_reactor_step(reactor, 100));
+    TEST_ASSERT_EQUAL(1, test_phev_reactor_reads);
+
+    // Drop the connection, the next step reconnects with a new socket that may reuse the old number
+    phev_pipe_disconnectOutput(pipe);
+    close(test_phev_reactor_socket);
+    close(test_phev_reactor_peer);
+
+    TEST_ASSERT_EQUAL(1, phev_reactor_step(reactor, 100));
+    TEST_ASSERT_TRUE(pipe->pipe->out->connected);
+    TEST_ASSERT_EQUAL(test_phev_reactor_socket, reactor->sessions[0].fd);
+
+    TEST_ASSERT_EQUAL(sizeof(data), write(test_phev_reactor_peer, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(1, phev_reactor_step(reactor, 100));
+    TEST_ASSERT_EQUAL(2, test_phev_reactor_reads);
+
+    phev_reactor_destroy(reactor);
+    close(test_phev_reactor_socket);
+    close(test_phev_reactor_peer);
+}
+void test_phev_reactor_waits_for_connect(void)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    TEST_ASSERT_EQUAL(0, bind(listener, (struct sockaddr *) &addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, listen(listener, 1));
+    TEST_ASSERT_EQUAL(0, getsockname(listener, (struct sockaddr *) &addr, &len));
+
+    test_phev_reactor_port = ntohs(addr.sin_port);
+    test_phev_reactor_socket = -1;
+
+    phevReactor_t * reactor = phev_reactor_create(1);
+    phev_pipe_ctx_t * pipe = test_phev_reactor_createPipe();
+
+    pipe->socketHandler = test_phev_reactor_socketHandler;
+    pipe->connectHandler = test_phev_reactor_connectHandler;
+    pipe->pipe->out->connected = 0;
+
+    TEST_ASSERT_EQUAL(0, phev_reactor_add(reactor, pipe, -1));
+
+    // The connect finishes when its socket is writable, not on a retry after the backoff
+    uint64_t start = phev_timer_now();
+
+    while (!pipe->pipe->out->connected && phev_timer_now() - start < 1000)
+    {
+        phev_reactor_step(reactor, 100);
+    }
+
+    TEST_ASSERT_TRUE(pipe->pipe->out->connected);
+    TEST_ASSERT_TRUE(phev_timer_now() - start < 500);
+    TEST_ASSERT_EQUAL(0, pipe->connectAttempts);
+    TEST_ASSERT_EQUAL(-1, phev_pipe_connectingSocket(pipe));
+    TEST_ASSERT_EQUAL(test_phev_reactor_socket, reactor->sessions[0].fd);
+    TEST_ASSERT_FALSE(reactor->sessions[0].connecting);
+
+    phev_reactor_destroy(reactor);
+    close(test_phev_reactor_socket);
+    close(listener);
+}
+void test_phev_reactor_stop_wakes_run(void)
+{
+    pthread_t thread;
+    phevReactor_t * reactor = phev_reactor_create(1);
+
+    TEST_ASSERT_EQUAL(0, phev_reactor_add(reactor, test_phev_reactor_createPipe(), -1));
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, test_phev_reactor_run, reactor));
+
+    while (!atomic_load(&reactor->running))
+    {
+        SLEEP(1);
+    }
+
+    uint64_t start = phev_timer_now();
+
+    phev_reactor_stop(reactor);
+    pthread_join(thread, NULL);
+
+    TEST_ASSERT_TRUE(phev_timer_now() - start < PHEV_REACTOR_MAX_WAIT / 2);
+
+    phev_reactor_destroy(reactor);
+}
+void test_phev_reactor_full(void)
+{
+    phevReactor_t * reactor = phev_reactor_create(1);
+
+    TEST_ASSERT_EQUAL(0, phev_reactor_add(reactor, test_phev_reactor_createPipe(), -1));
+    TEST_ASSERT_EQUAL(-1, phev_reactor_add(reactor, test_phev_reactor_createPipe(), -1));
+
+    phev_reactor_destroy(reactor);
+}
+#endif
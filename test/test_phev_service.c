@@ -888,6 +888,32 @@ void test_phev_service_outputFilter_change(void)
 
     TEST_ASSERT_TRUE(outbool);
 }
+void test_phev_service_outputFilter_repeated_frame(void)
+{
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_service_inHandlerIn,
+        .outgoingHandler = test_phev_service_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_service_inHandlerOut,
+        .outgoingHandler = test_phev_service_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phevServiceCtx_t * ctx = phev_service_init(in,out,false);    
+    const uint8_t inData[] = {0x6f,0x04,0x00,0x0a,0x00,0x7d};
+    const uint8_t data[] = {1};
+
+    TEST_ASSERT_TRUE(phev_service_outputFilter(ctx->pipe, msg_utils_createMsg(inData, sizeof(inData))));
+    TEST_ASSERT_FALSE(phev_service_outputFilter(ctx->pipe, msg_utils_createMsg(inData, sizeof(inData))));
+
+    phev_model_setRegister(ctx->model,10,data,1);
+
+    TEST_ASSERT_TRUE(phev_service_outputFilter(ctx->pipe, msg_utils_createMsg(inData, sizeof(inData))));
+    TEST_ASSERT_FALSE(phev_service_outputFilter(ctx->pipe, msg_utils_createMsg(inData, sizeof(inData))));
+}
 void test_phev_service_inputSplitter_not_null(void)
 {
     const char * commands = "{ \"requests\" : [{ \"operation\" :  { \"airCon\" : \"on\" } }, {\"operation\" :  { \"airCon\" : \"off\" } } ] }";
@@ -911,34 +937,68 @@ void test_phev_service_inputSplitter_two_messages_first(void)
 
     messageBundle_t * messages = phev_service_inputSplitter(NULL, msg_utils_createMsg(commands, strlen(commands)));
     
+    const uint8_t expected[] = {PHEV_SERVICE_SPLIT_COMMAND_TAG,KO_WF_MANUAL_AC_ON_RQ_SP,2};
+
     TEST_ASSERT_NOT_NULL(messages);
     TEST_ASSERT_EQUAL(2,messages->numMessages);
-    
-    cJSON * msg = cJSON_Parse(messages->messages[0]->data);
-    
-    TEST_ASSERT_NOT_NULL(msg);
-    
-    cJSON * operation = cJSON_GetObjectItemCaseSensitive(msg,"operation");
-    
-    TEST_ASSERT_NOT_NULL(msg);
-    TEST_ASSERT_NOT_NULL(operation);
-    }
+    TEST_ASSERT_EQUAL(sizeof(expected),messages->messages[0]->length);
+    TEST_ASSERT_EQUAL_MEMORY(expected,messages->messages[0]->data,sizeof(expected));
+}
 void test_phev_service_inputSplitter_two_messages_second(void)
 {
     const char * commands = "{ \"requests\": [{ \"operation\" :  { \"airCon\" : \"on\" } }, {\"operation\" :  { \"airCon\" : \"off\" } } ] }";
 
     messageBundle_t * messages = phev_service_inputSplitter(NULL, msg_utils_createMsg(commands, strlen(commands)));
 
+    const uint8_t expected[] = {PHEV_SERVICE_SPLIT_COMMAND_TAG,KO_WF_MANUAL_AC_ON_RQ_SP,1};
+
     TEST_ASSERT_NOT_NULL(messages);
     TEST_ASSERT_EQUAL(2,messages->numMessages);
+    TEST_ASSERT_EQUAL(sizeof(expected),messages->messages[1]->length);
+    TEST_ASSERT_EQUAL_MEMORY(expected,messages->messages[1]->data,sizeof(expected));
+}
+void test_phev_service_inputSplitter_drops_invalid_commands(void)
+{
+    const char * commands = "{ \"requests\": [{ \"operation\" :  { \"airCon\" : \"maybe\" } }, { \"updateRegister\" : { \"register\" : 10, \"value\" : [1,2,3] } } ] }";
+    const uint8_t expected[] = {PHEV_SERVICE_SPLIT_COMMAND_TAG,10,1,2,3};
 
-    cJSON * msg = cJSON_Parse(messages->messages[1]->data);
+    messageBundle_t * messages = phev_service_inputSplitter(NULL, msg_utils_createMsg(commands, strlen(commands)));
 
-    TEST_ASSERT_NOT_NULL(msg);
-    cJSON * operation = cJSON_GetObjectItemCaseSensitive(msg,"operation");
-    
-    TEST_ASSERT_NOT_NULL(msg);
-    TEST_ASSERT_NOT_NULL(operation);
+    TEST_ASSERT_NOT_NULL(messages);
+    TEST_ASSERT_EQUAL(1,messages->numMessages);
+    TEST_ASSERT_EQUAL(sizeof(expected),messages->messages[0]->length);
+    TEST_ASSERT_EQUAL_MEMORY(expected,messages->messages[0]->data,sizeof(expected));
+}
+void test_phev_service_commandInputTransformer_drops_untagged(void)
+{
+    const char * command = "{ \"updateRegister\" : { \"register\" : 10, \"value\" : 1 } }";
+    const uint8_t tagged[] = {PHEV_SERVICE_SPLIT_COMMAND_TAG,10,1};
+    const uint8_t expected[] = {0xf6,0x04,0x00,0x0a,0x01};
+
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_service_inHandlerIn,
+        .outgoingHandler = test_phev_service_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_service_inHandlerOut,
+        .outgoingHandler = test_phev_service_outHandlerOut,
+    };
+
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phevServiceCtx_t * ctx = phev_service_init(in,out,false);
+    ctx->pipe->connected = true;
+    test_phev_service_global_out_out_message = NULL;
+
+    phev_service_commandInputTransformer(ctx->pipe, msg_utils_createMsg(command, strlen(command)));
+
+    TEST_ASSERT_NULL(test_phev_service_global_out_out_message);
+
+    phev_service_commandInputTransformer(ctx->pipe, msg_utils_createMsg(tagged, sizeof(tagged)));
+
+    TEST_ASSERT_NOT_NULL(test_phev_service_global_out_out_message);
+    TEST_ASSERT_EQUAL_MEMORY(expected, test_phev_service_global_out_out_message->data, sizeof(expected));
 }
 void test_phev_service_end_to_end_operations(void)
 {
@@ -1060,6 +1120,41 @@ void test_phev_service_end_to_end_multiple_updated_registers(void)
     TEST_ASSERT_EQUAL(2,i);
 
 }
+void test_phev_service_jsonOutputTransformer_compact(void)
+{
+    const uint8_t message[] = {0x6f,0x06,0x00,0x0a,0xff,0x00,0x55,0xd3};
+    const char * expected = "{\"updatedRegister\":{\"register\":10,\"length\":3,\"data\":[255,0,85],\"xor\":0},\"time\":\"";
+
+    message_t * out = phev_service_jsonOutputTransformer(NULL,msg_utils_createMsg(message, sizeof(message)));
+
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL_MEMORY(expected, out->data, strlen(expected));
+    TEST_ASSERT_EQUAL_MEMORY("\"}", out->data + out->length - 2, 2);
+}
+void test_phev_service_jsonOutputTransformer_ack_uses_session_buffer(void)
+{
+    const uint8_t message[] = {0x6f,0x04,0x01,0x0a,0x00,0x7e};
+    const char * expected = "{\"updateRegisterAck\":{\"register\":10,\"xor\":0},\"time\":\"";
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_service_inHandlerIn,
+        .outgoingHandler = test_phev_service_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_service_inHandlerOut,
+        .outgoingHandler = test_phev_service_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phevServiceCtx_t * ctx = phev_service_init(in,out,false);
+
+    message_t * outmsg = phev_service_jsonOutputTransformer(ctx->pipe,msg_utils_createMsg(message, sizeof(message)));
+
+    TEST_ASSERT_NOT_NULL(outmsg);
+    TEST_ASSERT_EQUAL_MEMORY(expected, outmsg->data, strlen(expected));
+    TEST_ASSERT_EQUAL_MEMORY(ctx->outputBuffer, outmsg->data, outmsg->length);
+}
 void test_phev_service_jsonResponseAggregator(void)
 {
     const char * msg1 = "{ \"updatedRegister\": {\"register\": 4, \"length\": 1,\"data\": [2] } }";
@@ -1097,6 +1192,112 @@ void test_phev_service_jsonResponseAggregator(void)
     TEST_ASSERT_EQUAL(2,i);
     
 }
+void test_phev_service_jsonResponseAggregator_matches_reprint(void)
+{
+    const uint8_t update[] = {0x6f,0x06,0x00,0x0a,0xff,0x00,0x55,0xd3};
+    const uint8_t ack[] = {0x6f,0x04,0x01,0x0a,0x00,0x7e};
+    const char * spaced = "{ \"updatedRegister\": {\"register\": 5, \"length\": 0,\"data\": [], \"empty\": {} } }";
+    const char * invalid = "{ \"updatedRegister\": ";
+
+    messageBundle_t * bundle = malloc(sizeof(messageBundle_t));
+
+    bundle->numMessages = 4;
+    bundle->messages[0] = phev_service_jsonOutputTransformer(NULL,msg_utils_createMsg(update, sizeof(update)));
+    bundle->messages[1] = msg_utils_createMsg(invalid, strlen(invalid));
+    bundle->messages[2] = msg_utils_createMsg(spaced, strlen(spaced));
+    bundle->messages[3] = phev_service_jsonOutputTransformer(NULL,msg_utils_createMsg(ack, sizeof(ack)));
+
+    cJSON * expectedJson = cJSON_CreateObject();
+    cJSON * responses = cJSON_CreateArray();
+
+    cJSON_AddItemToObject(expectedJson, "responses", responses);
+
+    for (int i = 0; i < bundle->numMessages; i++)
+    {
+        char * str = malloc(bundle->messages[i]->length + 1);
+
+        memcpy(str, bundle->messages[i]->data, bundle->messages[i]->length);
+        str[bundle->messages[i]->length] = 0;
+        cJSON_AddItemToArray(responses, cJSON_Parse(str));
+        free(str);
+    }
+
+    char * expected = cJSON_Print(expectedJson);
+
+    message_t * out = phev_service_jsonResponseAggregator(NULL,bundle);
+
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL(strlen(expected), out->length);
+    TEST_ASSERT_EQUAL_MEMORY(expected, out->data, out->length);
+
+    free(expected);
+    cJSON_Delete(expectedJson);
+}
+void test_phev_service_binaryOutputTransformer_updated_register(void)
+{
+    const uint8_t message[] = {0x6f,0x06,0x00,0x0a,0xff,0x00,0x55,0xd3};
+    const uint8_t expected[] = {PHEV_SERVICE_BINARY_UPDATED_REGISTER,0x0a,0x03,0xff,0x00,0x55,0x00};
+
+    uint32_t before = (uint32_t) time(NULL);
+    message_t * out = phev_service_binaryOutputTransformer(NULL,msg_utils_createMsg(message, sizeof(message)));
+
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL(sizeof(expected) + 4, out->length);
+    TEST_ASSERT_EQUAL_MEMORY(expected, out->data, sizeof(expected));
+
+    uint32_t timestamp = ((uint32_t) out->data[7] << 24) | ((uint32_t) out->data[8] << 16) | ((uint32_t) out->data[9] << 8) | out->data[10];
+
+    TEST_ASSERT_TRUE(timestamp >= before && timestamp <= (uint32_t) time(NULL));
+}
+void test_phev_service_binaryResponseAggregator(void)
+{
+    const uint8_t update[] = {0x6f,0x06,0x00,0x0a,0xff,0x00,0x55,0xd3};
+    const uint8_t ack[] = {0x6f,0x04,0x01,0x0a,0x00,0x7e};
+
+    messageBundle_t * bundle = malloc(sizeof(messageBundle_t));
+
+    bundle->numMessages = 2;
+    bundle->messages[0] = phev_service_binaryOutputTransformer(NULL,msg_utils_createMsg(update, sizeof(update)));
+    bundle->messages[1] = phev_service_binaryOutputTransformer(NULL,msg_utils_createMsg(ack, sizeof(ack)));
+
+    message_t * out = phev_service_binaryResponseAggregator(NULL,bundle);
+
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL(11 + 8, out->length);
+    TEST_ASSERT_EQUAL(PHEV_SERVICE_BINARY_UPDATED_REGISTER_ACK, out->data[11]);
+    TEST_ASSERT_EQUAL(0x0a, out->data[12]);
+    TEST_ASSERT_EQUAL(0, out->data[13]);
+}
+void test_phev_service_create_binary_output(void)
+{
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_service_inHandlerIn,
+        .outgoingHandler = test_phev_service_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_service_inHandlerOut,
+        .outgoingHandler = test_phev_service_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phevServiceSettings_t settings = {
+        .in = in,
+        .out = out,
+        .registerDevice = false,
+        .outputFormat = PHEV_SERVICE_OUTPUT_BINARY,
+    };
+ 
+    phevServiceCtx_t * ctx = phev_service_create(settings);
+
+    TEST_ASSERT_EQUAL(phev_service_binaryOutputTransformer, ctx->pipe->pipe->out_chain->outputTransformer);
+    TEST_ASSERT_EQUAL(phev_service_binaryResponseAggregator, ctx->pipe->pipe->out_chain->aggregator);
+
+    phev_service_resetPipeAfterRegistration(ctx);
+
+    TEST_ASSERT_EQUAL(phev_service_binaryOutputTransformer, ctx->pipe->pipe->out_chain->outputTransformer);
+}
 void test_phev_service_init_settings(void)
 {
     messagingSettings_t inSettings = {
@@ -1213,7 +1414,7 @@ void test_phev_service_register_complete_resets_transformers(void)
     TEST_ASSERT_NOT_NULL(ctx);
     TEST_ASSERT_EQUAL(1, test_phev_service_complete_callback_called);
     TEST_ASSERT_NOT_NULL(ctx->pipe->pipe->in_chain);
-    TEST_ASSERT_EQUAL(phev_service_jsonInputTransformer,ctx->pipe->pipe->in_chain->inputTransformer);
+    TEST_ASSERT_EQUAL(phev_service_commandInputTransformer,ctx->pipe->pipe->in_chain->inputTransformer);
     TEST_ASSERT_EQUAL(phev_service_jsonOutputTransformer, ctx->pipe->pipe->out_chain->outputTransformer);
 }
 void test_phev_service_create(void)
@@ -1294,6 +1495,40 @@ void test_phev_service_create_passes_context(void)
     TEST_ASSERT_NOT_NULL(ctx);
     TEST_ASSERT_EQUAL_STRING(customCtx,ctx->ctx);
 }
+void test_phev_service_create_my18_per_context(void)
+{
+    test_phev_service_global_in_in_message = NULL;
+    test_phev_service_global_out_in_message = NULL;
+
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_service_inHandlerIn,
+        .outgoingHandler = test_phev_service_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_service_inHandlerOut,
+        .outgoingHandler = test_phev_service_outHandlerOut,
+    };
+    uint8_t mac[] = {0x11,0x22,0x33,0x44,0x55,0x66};
+
+    phevServiceSettings_t my18Settings = {
+        .in = msg_core_createMessagingClient(inSettings),
+        .out = msg_core_createMessagingClient(outSettings),
+        .mac = mac,
+        .my18 = true,
+    };
+    phevServiceSettings_t settings = {
+        .in = msg_core_createMessagingClient(inSettings),
+        .out = msg_core_createMessagingClient(outSettings),
+        .mac = mac,
+        .my18 = false,
+    };
+
+    phevServiceCtx_t * my18Ctx = phev_service_create(my18Settings);
+    phevServiceCtx_t * ctx = phev_service_create(settings);
+
+    TEST_ASSERT_TRUE(my18Ctx->my18);
+    TEST_ASSERT_FALSE(ctx->my18);
+}
 
 void test_phev_service_getRegister(void)
 {
@@ -1325,9 +1560,7 @@ void test_phev_service_getRegister(void)
  
     phevServiceCtx_t * ctx = phev_service_create(settings);
 
-    ctx->model->registers[1] = malloc(sizeof(phevRegister_t) + sizeof(expectedData));
-    ctx->model->registers[1]->length = sizeof(expectedData);
-    memcpy(ctx->model->registers[1]->data,expectedData,sizeof(expectedData));
+    phev_model_setRegister(ctx->model,1,expectedData,sizeof(expectedData));
 
     TEST_ASSERT_NOT_NULL(ctx);
 
@@ -1367,9 +1600,7 @@ void test_phev_service_getAllRegisters(void)
  
     phevServiceCtx_t * ctx = phev_service_create(settings);
 
-    ctx->model->registers[1] = malloc(sizeof(phevRegister_t) + sizeof(expectedData));
-    ctx->model->registers[1]->length = sizeof(expectedData);
-    memcpy(ctx->model->registers[1]->data,expectedData,sizeof(expectedData));
+    phev_model_setRegister(ctx->model,1,expectedData,sizeof(expectedData));
 
     TEST_ASSERT_NOT_NULL(ctx);
 
@@ -1418,7 +1649,7 @@ void test_phev_service_setRegister(void)
 
     TEST_ASSERT_NOT_NULL(reg);
 
-    TEST_ASSERT_EQUAL_MEMORY(expectedData, ctx->model->registers[2]->data, sizeof(expectedData));
+    TEST_ASSERT_EQUAL_MEMORY(expectedData, ctx->model->registers[2].data, sizeof(expectedData));
     
 }
 void test_phev_service_getRegisterJson(void)
@@ -1452,9 +1683,7 @@ void test_phev_service_getRegisterJson(void)
  
     phevServiceCtx_t * ctx = phev_service_create(settings);
 
-    ctx->model->registers[1] = malloc(sizeof(phevRegister_t) + sizeof(data));
-    ctx->model->registers[1]->length = sizeof(data);
-    memcpy(ctx->model->registers[1]->data,data,sizeof(data));
+    phev_model_setRegister(ctx->model,1,data,sizeof(data));
 
     TEST_ASSERT_NOT_NULL(ctx);
 
@@ -1651,6 +1880,56 @@ void test_phev_service_status(void)
 
     TEST_ASSERT_EQUAL(time->valueint,1);
 }
+void test_phev_service_statusJson_cached(void)
+{
+    const uint8_t level[] = {50};
+    const uint8_t newLevel[] = {51};
+    const uint8_t door[] = {1};
+    messagingSettings_t inSettings = {
+        .incomingHandler = test_phev_service_inHandlerIn,
+        .outgoingHandler = test_phev_service_outHandlerIn,
+    };
+    messagingSettings_t outSettings = {
+        .incomingHandler = test_phev_service_inHandlerOut,
+        .outgoingHandler = test_phev_service_outHandlerOut,
+    };
+    
+    messagingClient_t * in = msg_core_createMessagingClient(inSettings);
+    messagingClient_t * out = msg_core_createMessagingClient(outSettings);
+
+    phevServiceCtx_t * ctx = phev_service_init(in,out,false);
+    phev_model_setRegister(ctx->model,KO_WF_BATT_LEVEL_INFO_REP_EVR,level,1);
+
+    uint32_t version = 0;
+    const char * str = phev_service_statusJson(ctx, &version);
+
+    TEST_ASSERT_NOT_NULL(str);
+    TEST_ASSERT_EQUAL(phev_service_statusVersion(ctx),version);
+
+    phev_model_setRegister(ctx->model,KO_WF_DOOR_STATUS_INFO_REP_EVR,door,1);
+    phev_model_setRegister(ctx->model,KO_WF_BATT_LEVEL_INFO_REP_EVR,level,1);
+
+    uint32_t cachedVersion = 0;
+
+    TEST_ASSERT_EQUAL_PTR(str,phev_service_statusJson(ctx, &cachedVersion));
+    TEST_ASSERT_EQUAL(version,cachedVersion);
+
+    phev_model_setRegister(ctx->model,KO_WF_BATT_LEVEL_INFO_REP_EVR,newLevel,1);
+
+    uint32_t newVersion = 0;
+    cJSON * json = cJSON_Parse(phev_service_statusJson(ctx, &newVersion));
+
+    TEST_ASSERT_TRUE(newVersion > version);
+
+    cJSON * status = cJSON_GetObjectItemCaseSensitive(json, "status");
+    cJSON * battery = cJSON_GetObjectItemCaseSensitive(status, "battery");
+    cJSON * soc = cJSON_GetObjectItemCaseSensitive(battery, "soc");
+
+    TEST_ASSERT_NOT_NULL(soc);
+    TEST_ASSERT_EQUAL(51,soc->valueint);
+
+    cJSON_Delete(json);
+}
 
 
 /*
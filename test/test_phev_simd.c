@@ -0,0 +1,77 @@
+#include <string.h>
+#include "unity.h"
+#include "phev_simd.h"
+
+static uint8_t test_phev_simd_referenceSum(const uint8_t *data, size_t len, uint8_t xor)
+{
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        sum = (uint8_t)(sum + (data[i] ^ xor));
+    }
+    return sum;
+}
+void test_phev_simd_xor_matches_scalar(void)
+{
+    uint8_t data[300];
+    uint8_t out[300];
+    uint8_t expected[300];
+
+    for (int i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 7 + 3);
+        expected[i] = data[i] ^ 0xa5;
+    }
+    for (size_t len = 0; len <= sizeof(data); len += 13)
+    {
+        memset(out, 0, sizeof(out));
+        phev_simd_xor(out, data, len, 0xa5);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, len);
+        if (len < sizeof(out))
+        {
+            TEST_ASSERT_EQUAL(0, out[len]);
+        }
+    }
+}
+void test_phev_simd_xorSum_matches_scalar(void)
+{
+    uint8_t data[300];
+
+    for (int i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 31 + 11);
+    }
+    for (size_t len = 0; len <= sizeof(data); len++)
+    {
+        TEST_ASSERT_EQUAL(test_phev_simd_referenceSum(data, len, 0), phev_simd_sum(data, len));
+        TEST_ASSERT_EQUAL(test_phev_simd_referenceSum(data, len, 0x3c), phev_simd_xorSum(data, len, 0x3c));
+    }
+}
+void test_phev_simd_scalar_fallback(void)
+{
+    uint8_t data[64];
+
+    for (int i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(0xff - i);
+    }
+
+    phev_simd_setEnabled(false);
+
+    TEST_ASSERT_EQUAL_STRING("scalar", phev_simd_implementation());
+    TEST_ASSERT_EQUAL(test_phev_simd_referenceSum(data, sizeof(data), 0x11), phev_simd_xorSum(data, sizeof(data), 0x11));
+
+    phev_simd_setEnabled(true);
+}
+void test_phev_simd_checksumFrames(void)
+{
+    const uint8_t frames[] = {0x6f, 0x0a, 0x00, 0x12, 0x00, 0x06, 0x06, 0x13, 0x05, 0x13, 0x01, 0xc3, 0x3f, 0x04, 0x01, 0x02, 0x00, 0x46, 0x6f, 0x0a};
+    uint8_t checksums[4];
+
+    size_t count = phev_simd_checksumFrames(frames, sizeof(frames), checksums, 4);
+
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL_HEX8(0xc3, checksums[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x46, checksums[1]);
+}
@@ -0,0 +1,134 @@
+#include "unity.h"
+#include "phev_tcpip.h"
+#include "phev_pipe.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static int test_phev_tcpip_listen(uint16_t *port)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int soc = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = 0;
+
+    TEST_ASSERT_EQUAL(0, bind(soc, (struct sockaddr *) &addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, listen(soc, 1));
+    TEST_ASSERT_EQUAL(0, getsockname(soc, (struct sockaddr *) &addr, &len));
+
+    *port = ntohs(addr.sin_port);
+
+    return soc;
+}
+// Keeps calling until the connect is made or has failed, checking that no call waits
+static int test_phev_tcpip_connect(phevTcpConnect_t *pending, uint16_t port)
+{
+    int soc = -1;
+
+    for (int i = 0; i < 100 && soc < 0; i++)
+    {
+        uint64_t start = phev_timer_now();
+
+        soc = phev_tcpClientConnect(pending, "127.0.0.1", port);
+
+        TEST_ASSERT_TRUE(phev_timer_now() - start < 50);
+        if (soc < 0 && pending->soc < 0)
+        {
+            break;
+        }
+        if (soc < 0)
+        {
+            SLEEP(1);
+        }
+    }
+    return soc;
+}
+void test_phev_tcpip_connect_does_not_wait(void)
+{
+    uint16_t port;
+    int listener = test_phev_tcpip_listen(&port);
+    phevTcpConnect_t pending;
+
+    phev_tcpClientConnectInit(&pending);
+
+    int soc = test_phev_tcpip_connect(&pending, port);
+
+    TEST_ASSERT_TRUE(soc >= 0);
+    TEST_ASSERT_EQUAL(-1, pending.soc);
+    TEST_ASSERT_EQUAL(0, fcntl(soc, F_GETFL, 0) & O_NONBLOCK);
+
+    int peer = accept(listener, NULL, NULL);
+    uint8_t data[] = {0xf2, 0x04, 0x00, 0x06, 0x00, 0xfc};
+    uint8_t buffer[16];
+
+    TEST_ASSERT_EQUAL(sizeof(data), write(peer, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(sizeof(data), phev_tcpClientRead(soc, buffer, sizeof(buffer)));
+
+    close(peer);
+    phev_tcpClientDisconnectSocket(soc);
+    close(listener);
+}
+void test_phev_tcpip_connect_refused(void)
+{
+    uint16_t port;
+    int listener = test_phev_tcpip_listen(&port);
+    phevTcpConnect_t pending;
+
+    close(listener);
+    phev_tcpClientConnectInit(&pending);
+
+    TEST_ASSERT_EQUAL(-1, test_phev_tcpip_connect(&pending, port));
+    TEST_ASSERT_EQUAL(-1, pending.soc);
+    TEST_ASSERT_EQUAL(-1, phev_tcpClientConnectSocket("127.0.0.1", port));
+}
+void test_phev_tcpip_connects_are_independent(void)
+{
+    uint16_t port;
+    int listener = test_phev_tcpip_listen(&port);
+    phevTcpConnect_t first;
+    phevTcpConnect_t second;
+
+    phev_tcpClientConnectInit(&first);
+    phev_tcpClientConnectInit(&second);
+
+    // Both in flight to the same address at once, neither takes over the other's socket
+    int firstSoc = phev_tcpClientConnect(&first, "127.0.0.1", port);
+    int secondSoc = phev_tcpClientConnect(&second, "127.0.0.1", port);
+
+    if (firstSoc < 0)
+    {
+        firstSoc = test_phev_tcpip_connect(&first, port);
+    }
+    if (secondSoc < 0)
+    {
+        secondSoc = test_phev_tcpip_connect(&second, port);
+    }
+
+    TEST_ASSERT_TRUE(firstSoc >= 0);
+    TEST_ASSERT_TRUE(secondSoc >= 0);
+    TEST_ASSERT_NOT_EQUAL(firstSoc, secondSoc);
+
+    phev_tcpClientDisconnectSocket(firstSoc);
+    phev_tcpClientDisconnectSocket(secondSoc);
+    close(listener);
+}
+void test_phev_tcpip_connect_socket_waits(void)
+{
+    uint16_t port;
+    int listener = test_phev_tcpip_listen(&port);
+    int soc = phev_tcpClientConnectSocket("127.0.0.1", port);
+
+    TEST_ASSERT_TRUE(soc >= 0);
+
+    phev_tcpClientDisconnectSocket(soc);
+    close(listener);
+}
+#endif
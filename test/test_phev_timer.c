@@ -0,0 +1,110 @@
+#include "unity.h"
+#include "phev_timer.h"
+
+static int test_phev_timer_fired = 0;
+static uint64_t test_phev_timer_firedAt = 0;
+
+static void test_phev_timer_callback(phevTimer_t *timer, void *ctx)
+{
+    phevTimerWheel_t *wheel = (phevTimerWheel_t *) ctx;
+
+    test_phev_timer_fired++;
+    test_phev_timer_firedAt = phev_timer_time(wheel);
+}
+static void test_phev_timer_restartCallback(phevTimer_t *timer, void *ctx)
+{
+    test_phev_timer_fired++;
+    phev_timer_start((phevTimerWheel_t *) ctx, timer, 1000);
+}
+void test_phev_timer_fires_after_delay(void)
+{
+    phevTimerWheel_t wheel;
+    phevTimer_t timer;
+
+    test_phev_timer_fired = 0;
+    phev_timer_initWheel(&wheel, 50000);
+    phev_timer_init(&timer, test_phev_timer_callback, &wheel);
+
+    phev_timer_start(&wheel, &timer, 1000);
+
+    TEST_ASSERT_TRUE(phev_timer_active(&timer));
+    TEST_ASSERT_EQUAL(0, phev_timer_advance(&wheel, 50990));
+    TEST_ASSERT_EQUAL(0, test_phev_timer_fired);
+    TEST_ASSERT_EQUAL(1, phev_timer_advance(&wheel, 51000));
+    TEST_ASSERT_EQUAL(1, test_phev_timer_fired);
+    TEST_ASSERT_EQUAL(51000, test_phev_timer_firedAt);
+    TEST_ASSERT_FALSE(phev_timer_active(&timer));
+}
+void test_phev_timer_stop_before_expiry(void)
+{
+    phevTimerWheel_t wheel;
+    phevTimer_t timer;
+
+    test_phev_timer_fired = 0;
+    phev_timer_initWheel(&wheel, 0);
+    phev_timer_init(&timer, test_phev_timer_callback, &wheel);
+
+    phev_timer_start(&wheel, &timer, 200);
+    phev_timer_stop(&wheel, &timer);
+
+    TEST_ASSERT_EQUAL(0, phev_timer_advance(&wheel, 10000));
+    TEST_ASSERT_EQUAL(0, test_phev_timer_fired);
+    TEST_ASSERT_EQUAL(PHEV_TIMER_NEVER, phev_timer_nextDeadline(&wheel));
+}
+void test_phev_timer_cascades_long_delay(void)
+{
+    phevTimerWheel_t wheel;
+    phevTimer_t timer;
+
+    test_phev_timer_fired = 0;
+    phev_timer_initWheel(&wheel, 1234);
+    phev_timer_init(&timer, test_phev_timer_callback, &wheel);
+
+    phev_timer_start(&wheel, &timer, 3600000);
+
+    for (uint64_t now = 1230; now < 1230 + 3600000; now += 60000)
+    {
+        phev_timer_advance(&wheel, now);
+    }
+    TEST_ASSERT_EQUAL(0, test_phev_timer_fired);
+
+    phev_timer_advance(&wheel, 1230 + 3600000);
+
+    TEST_ASSERT_EQUAL(1, test_phev_timer_fired);
+    TEST_ASSERT_EQUAL(1230 + 3600000, test_phev_timer_firedAt);
+}
+void test_phev_timer_nextDeadline(void)
+{
+    phevTimerWheel_t wheel;
+    phevTimer_t ping;
+    phevTimer_t sync;
+
+    phev_timer_initWheel(&wheel, 0);
+    phev_timer_init(&ping, test_phev_timer_callback, &wheel);
+    phev_timer_init(&sync, test_phev_timer_callback, &wheel);
+
+    phev_timer_start(&wheel, &sync, 30000);
+    phev_timer_start(&wheel, &ping, 1000);
+
+    TEST_ASSERT_EQUAL(1000, phev_timer_nextDeadline(&wheel));
+
+    phev_timer_stop(&wheel, &ping);
+
+    TEST_ASSERT_TRUE(phev_timer_nextDeadline(&wheel) <= 30000);
+}
+void test_phev_timer_restart_from_callback(void)
+{
+    phevTimerWheel_t wheel;
+    phevTimer_t timer;
+
+    test_phev_timer_fired = 0;
+    phev_timer_initWheel(&wheel, 0);
+    phev_timer_init(&timer, test_phev_timer_restartCallback, &wheel);
+
+    phev_timer_start(&wheel, &timer, 1000);
+
+    TEST_ASSERT_EQUAL(1, phev_timer_advance(&wheel, 1500));
+    TEST_ASSERT_EQUAL(1, phev_timer_advance(&wheel, 2500));
+    TEST_ASSERT_EQUAL(2, test_phev_timer_fired);
+    TEST_ASSERT_TRUE(phev_timer_active(&timer));
+}
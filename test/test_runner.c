@@ -6,8 +6,14 @@
 
 #include "unity.h"
 #include "test_phev_core.c"
+#include "test_phev_simd.c"
+#include "test_phev_timer.c"
 #include "test_phev_register.c"
 #include "test_phev_pipe.c"
+#include "test_phev_reactor.c"
+#include "test_phev_fleet.c"
+#include "test_phev_tcpip.c"
+#include "test_phev_command.c"
 #include "test_phev_service.c"
 #include "test_phev_model.c"
 #include "test_phev.c"
@@ -80,6 +86,35 @@ int main()
     RUN_TEST(test_core_phev_core_extractIncomingMessageAndXOR_2F_command);
     RUN_TEST(test_phev_core_getMessageXOR);
     RUN_TEST(test_core_phev_core_extractIncomingMessageValidFirstByteCommand);
+    RUN_TEST(test_phev_core_decodeMessageView);
+    RUN_TEST(test_phev_core_decodeMessageView_double);
+    RUN_TEST(test_phev_core_decodeMessageView_truncated);
+    RUN_TEST(test_phev_core_attachDecodedMessage);
+    RUN_TEST(test_phev_core_getDecodedMessage_not_attached);
+    RUN_TEST(test_phev_core_streamParser_partial_frame);
+    RUN_TEST(test_phev_core_streamParser_resync_after_garbage);
+    RUN_TEST(test_phev_core_streamParser_wraps_buffer);
+    RUN_TEST(test_phev_core_predictIncomingFrame_hit);
+    RUN_TEST(test_phev_core_predictIncomingFrame_miss_learns_key);
+    RUN_TEST(test_phev_core_frameTemplate_matches_encoded_ping);
+    RUN_TEST(test_phev_core_frameTemplate_time_sync);
+    RUN_TEST(test_phev_core_commandInfo);
+    RUN_TEST(test_phev_core_commandInfo_ack_is_nibble_swap);
+
+//  PHEV_SIMD
+
+    RUN_TEST(test_phev_simd_xor_matches_scalar);
+    RUN_TEST(test_phev_simd_xorSum_matches_scalar);
+    RUN_TEST(test_phev_simd_scalar_fallback);
+    RUN_TEST(test_phev_simd_checksumFrames);
+
+//  PHEV_TIMER
+
+    RUN_TEST(test_phev_timer_fires_after_delay);
+    RUN_TEST(test_phev_timer_stop_before_expiry);
+    RUN_TEST(test_phev_timer_cascades_long_delay);
+    RUN_TEST(test_phev_timer_nextDeadline);
+    RUN_TEST(test_phev_timer_restart_from_callback);
 
 //  PHEV PIPE
     
@@ -96,6 +131,8 @@ int main()
 
     RUN_TEST(test_phev_pipe_splitter_one_encoded_message);
     RUN_TEST(test_phev_pipe_splitter_two_encoded_messages);
+    RUN_TEST(test_phev_pipe_splitter_message_split_across_reads);
+    RUN_TEST(test_phev_pipe_splitter_attaches_decoded_message);
 
     RUN_TEST(test_phev_pipe_publish);
     RUN_TEST(test_phev_pipe_commandResponder);
@@ -103,6 +140,8 @@ int main()
 //    RUN_TEST(test_phev_pipe_commandResponder_reg_update_even_xor);
     RUN_TEST(test_phev_pipe_ping_even_xor);
     RUN_TEST(test_phev_pipe_ping_odd_xor);
+    RUN_TEST(test_phev_pipe_pingReceived_rtt);
+    RUN_TEST(test_phev_pipe_ping_lost);
     RUN_TEST(test_phev_pipe_commandResponder_should_only_respond_to_commands);
 //    RUN_TEST(test_phev_pipe_commandResponder_should_encrypt_with_correct_xor);
     RUN_TEST(test_phev_pipe_no_input_connection);
@@ -110,15 +149,55 @@ int main()
     RUN_TEST(test_phev_pipe_waitForConnection_should_timeout);
     RUN_TEST(test_phev_pipe_waitForConnection);
 #endif
+    RUN_TEST(test_phev_pipe_connectBackoff);
+    RUN_TEST(test_phev_pipe_start_deferred_until_connected);
 //    RUN_TEST(test_phev_pipe_sendMac);
     RUN_TEST(test_phev_pipe_updateRegister);
     RUN_TEST(test_phev_pipe_updateRegisterWithCallback);
     RUN_TEST(test_phev_pipe_updateRegisterWithCallback_encoded);
+    RUN_TEST(test_phev_pipe_updateRegister_more_than_ten_pending);
+    RUN_TEST(test_phev_pipe_updateRegister_retries_then_times_out);
+    RUN_TEST(test_phev_pipe_submitUpdate_sent_when_drained);
+    RUN_TEST(test_phev_pipe_submitUpdate_full);
+#if defined(__linux__)
+    RUN_TEST(test_phev_pipe_submitUpdate_concurrent_producers);
+#endif
     RUN_TEST(test_phev_pipe_registerEventHandler);
     RUN_TEST(test_phev_pipe_register_multiple_registerEventHandlers);
     RUN_TEST(test_phev_pipe_createRegisterEvent_ack);
     RUN_TEST(test_phev_pipe_createRegisterEvent_update);    
 
+//  PHEV_REACTOR
+#if defined(__linux__)
+    RUN_TEST(test_phev_reactor_steps_readable_pipe);
+    RUN_TEST(test_phev_reactor_wakes_for_timer);
+    RUN_TEST(test_phev_reactor_full);
+    RUN_TEST(test_phev_reactor_follows_reconnect);
+    RUN_TEST(test_phev_reactor_waits_for_connect);
+    RUN_TEST(test_phev_reactor_stop_wakes_run);
+#endif
+
+//  PHEV_FLEET
+#if defined(__linux__)
+    RUN_TEST(test_phev_fleet_runs_session_timers);
+    RUN_TEST(test_phev_fleet_steps_readable_session);
+    RUN_TEST(test_phev_fleet_follows_reconnect);
+#endif
+
+//  PHEV_TCPIP
+#if defined(__linux__)
+    RUN_TEST(test_phev_tcpip_connect_does_not_wait);
+    RUN_TEST(test_phev_tcpip_connect_refused);
+    RUN_TEST(test_phev_tcpip_connects_are_independent);
+    RUN_TEST(test_phev_tcpip_connect_socket_waits);
+#endif
+
+//  PHEV_COMMAND
+    RUN_TEST(test_phev_command_success);
+    RUN_TEST(test_phev_command_disconnected);
+    RUN_TEST(test_phev_command_cancel);
+    RUN_TEST(test_phev_command_rejected_when_queue_full);
+
 // PHEV SERVICE
 
     RUN_TEST(test_phev_service_validateCommand);
@@ -166,14 +245,23 @@ int main()
     RUN_TEST(test_phev_service_outputFilter);
     RUN_TEST(test_phev_service_outputFilter_no_change);
     RUN_TEST(test_phev_service_outputFilter_change);
+    RUN_TEST(test_phev_service_outputFilter_repeated_frame);
     RUN_TEST(test_phev_service_inputSplitter_not_null);
     RUN_TEST(test_phev_service_inputSplitter_two_messages_num_messages);
     RUN_TEST(test_phev_service_inputSplitter_two_messages_first);
     RUN_TEST(test_phev_service_inputSplitter_two_messages_second);
+    RUN_TEST(test_phev_service_inputSplitter_drops_invalid_commands);
+    RUN_TEST(test_phev_service_commandInputTransformer_drops_untagged);
     RUN_TEST(test_phev_service_end_to_end_operations);
     RUN_TEST(test_phev_service_end_to_end_updated_register);
     RUN_TEST(test_phev_service_end_to_end_multiple_updated_registers);
     RUN_TEST(test_phev_service_jsonResponseAggregator);
+    RUN_TEST(test_phev_service_jsonResponseAggregator_matches_reprint);
+    RUN_TEST(test_phev_service_binaryOutputTransformer_updated_register);
+    RUN_TEST(test_phev_service_binaryResponseAggregator);
+    RUN_TEST(test_phev_service_create_binary_output);
+    RUN_TEST(test_phev_service_jsonOutputTransformer_compact);
+    RUN_TEST(test_phev_service_jsonOutputTransformer_ack_uses_session_buffer);
     RUN_TEST(test_phev_service_init_settings);
     RUN_TEST(test_phev_service_register_complete_called);
     RUN_TEST(test_phev_service_register_complete_resets_transformers);
@@ -182,6 +270,7 @@ int main()
     RUN_TEST(test_phev_service_setRegister);
     RUN_TEST(test_phev_service_getRegisterJson);
     RUN_TEST(test_phev_service_create_passes_context);
+    RUN_TEST(test_phev_service_create_my18_per_context);
     RUN_TEST(test_phev_service_getDateSync);
     RUN_TEST(test_phev_service_statusAsJson_dateSync);
     RUN_TEST(test_phev_service_statusAsJson_not_charging);
@@ -190,6 +279,7 @@ int main()
     RUN_TEST(test_phev_service_hvacStatus_off);
     RUN_TEST(test_phev_service_statusAsJson_hvac_operating);
     RUN_TEST(test_phev_service_status);
+    RUN_TEST(test_phev_service_statusJson_cached);
     
 //  PHEV_MODEL
 
@@ -201,10 +291,21 @@ int main()
     RUN_TEST(test_phev_model_register_compare);
     RUN_TEST(test_phev_model_register_compare_not_same);
     RUN_TEST(test_phev_model_compare_not_set);
+    RUN_TEST(test_phev_model_register_version);
+    RUN_TEST(test_phev_model_compare_register_data_length);
+    RUN_TEST(test_phev_model_register_in_place);
+    RUN_TEST(test_phev_model_history_latest);
+    RUN_TEST(test_phev_model_history_range);
+    RUN_TEST(test_phev_model_history_capacity);
+    RUN_TEST(test_phev_model_history_enable_while_reading);
+    RUN_TEST(test_phev_model_read_register);
+    RUN_TEST(test_phev_model_snapshot_while_writing);
+    RUN_TEST(test_phev_model_two_writers);
 
 // PHEV
 
     RUN_TEST(test_phev_init_returns_context);
+    RUN_TEST(test_phev_enableRegisterHistory_on_loop);
     RUN_TEST(test_phev_statusAsJson);
    // RUN_TEST(test_phev_calls_connect_event);
    // RUN_TEST(test_phev_registrationEndToEnd);